@@ -91,6 +91,24 @@ ifeq ($(CFG_CORE_LARGE_PHYS_ADDR),y)
 $(call force,CFG_WITH_LPAE,y)
 endif
 
+# Map physically contiguous user TA memory with 2 MiB translation table
+# blocks where the physical and virtual addresses are suitably aligned.
+# TA memory of at least 2 MiB, like large heaps, is allocated at a 2 MiB
+# aligned physical address when possible. Registered shared memory and
+# secure data path buffers qualify where their pages happen to be
+# contiguous and aligned. Paged TA memory (CFG_PAGED_USER_TA=y) is always
+# mapped with small pages. Requires LPAE.
+CFG_CORE_USER_BLOCK_MAP ?= n
+ifeq ($(CFG_CORE_USER_BLOCK_MAP),y)
+$(call force,CFG_WITH_LPAE,y)
+endif
+
+# Max number of translation tables in the user mode page table cache.
+# Without pager the cache grows beyond its static size, which depends on
+# CFG_NUM_THREADS, with tables allocated from the heap up to this limit.
+# 0 keeps the cache at its static size.
+CFG_PGT_CACHE_MAX_SIZE ?= 0
+
 # SPMC configuration "S-EL1 SPMC" where SPM Core is implemented at S-EL1,
 # that is, OP-TEE.
 # Note that this is an experimental feature, ABIs etc may have incompatible
@@ -14,6 +14,7 @@ struct mutex {
 	unsigned spin_lock;	/* used when operating on this struct */
 	struct wait_queue wq;
 	short state;		/* -1: write, 0: unlocked, > 0: readers */
+	short owner;		/* thread id of writer, valid if state == -1 */
 };
 
 #define MUTEX_INITIALIZER { .wq = WAIT_QUEUE_INITIALIZER }
@@ -36,6 +37,34 @@ void mutex_init_recursive(struct recursive_mutex *m);
 void mutex_destroy_recursive(struct recursive_mutex *m);
 unsigned int mutex_get_recursive_lock_depth(struct recursive_mutex *m);
 
+/*
+ * struct mutex_stats - Statistics on contended mutexes
+ * @contended:	Number of locks which found the mutex already locked
+ * @spun:	Number of those which got the mutex while spinning on the
+ *		owner running on another core
+ * @slept:	Number of times a thread waited in normal world for a mutex
+ */
+struct mutex_stats {
+	size_t contended;
+	size_t spun;
+	size_t slept;
+};
+
+#ifdef CFG_WITH_STATS
+/*
+ * mutex_get_stats() - Get and reset mutex statistics
+ * @stats:	Statistics for all mutexes since last call
+ *
+ * The statistics of the most contended mutexes are printed and reset too.
+ */
+void mutex_get_stats(struct mutex_stats *stats);
+#else
+static inline void mutex_get_stats(struct mutex_stats *stats)
+{
+	*stats = (struct mutex_stats){ };
+}
+#endif
+
 #ifdef CFG_MUTEX_DEBUG
 void mutex_unlock_debug(struct mutex *m, const char *fname, int lineno);
 #define mutex_unlock(m) mutex_unlock_debug((m), __FILE__, __LINE__)
@@ -15,6 +15,7 @@
 #include <kernel/mutex.h>
 #include <kernel/vfp.h>
 #include <mm/pgt_cache.h>
+#include <sys/queue.h>
 #endif
 
 #define THREAD_ID_0		0
@@ -44,6 +45,7 @@ struct thread_core_local {
 #endif
 	vaddr_t tmp_stack_va_end;
 	short int curr_thread;
+	short int last_thread; /* Last thread freed on this core or -1 */
 	uint32_t flags;
 	vaddr_t abt_stack_va_end;
 #ifdef CFG_TEE_CORE_DEBUG
@@ -249,6 +251,7 @@ struct thread_specific_data {
 	bool stackcheck_recursion;
 #endif
 	unsigned int syscall_recursion;
+	SLIST_HEAD(, user_ta_claim) ta_claims;
 };
 
 struct user_mode_ctx;
@@ -313,6 +316,35 @@ short int thread_get_id(void);
  */
 short int thread_get_id_may_fail(void);
 
+/*
+ * Returns true if the thread is currently running on a core. The state
+ * is read without locking so it's only a hint.
+ */
+bool thread_is_active(short int thread_id);
+
+/* Number of buckets in the std entry latency histogram */
+#define THREAD_ENTRY_LAT_BUCKETS	64
+
+/*
+ * struct thread_entry_stats - statistics of std SMC entries
+ * @lat_hist:		Entry latency histogram, bucket n counts entries
+ *			which took n counter ticks to select a thread, the
+ *			last bucket counts all longer entries
+ * @lat_max:		Longest entry latency in counter ticks
+ * @last_thread_hits:	Number of entries reusing the thread last freed on
+ *			the same core
+ */
+struct thread_entry_stats {
+	uint32_t lat_hist[THREAD_ENTRY_LAT_BUCKETS];
+	uint32_t lat_max;
+	uint32_t last_thread_hits;
+};
+
+#ifdef CFG_TEE_BENCHMARK
+/* Returns a snapshot of the std SMC entry statistics */
+void thread_get_entry_stats(struct thread_entry_stats *stats);
+#endif
+
 /* Returns Thread Specific Data (TSD) pointer. */
 struct thread_specific_data *thread_get_tsd(void);
 
@@ -739,7 +771,9 @@ enum thread_shm_type {
  * enum thread_shm_cache_user - user of a cache allocation
  * @THREAD_SHM_CACHE_USER_SOCKET - socket communication
  * @THREAD_SHM_CACHE_USER_FS - filesystem access
+ * @THREAD_SHM_CACHE_USER_FS_WRITEV - filesystem vectored writes
  * @THREAD_SHM_CACHE_USER_I2C - I2C communication
+ * @THREAD_SHM_CACHE_USER_RPMB - RPMB write requests
  *
  * To ensure that each user of the shared memory cache doesn't interfere
  * with each other a unique ID per user is used.
@@ -747,7 +781,9 @@ enum thread_shm_type {
 enum thread_shm_cache_user {
 	THREAD_SHM_CACHE_USER_SOCKET,
 	THREAD_SHM_CACHE_USER_FS,
+	THREAD_SHM_CACHE_USER_FS_WRITEV,
 	THREAD_SHM_CACHE_USER_I2C,
+	THREAD_SHM_CACHE_USER_RPMB,
 };
 
 /*
@@ -7,6 +7,7 @@
 #define KERNEL_USER_TA_H
 
 #include <assert.h>
+#include <kernel/handle.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/user_mode_ctx_struct.h>
 #include <kernel/thread.h>
@@ -22,13 +23,32 @@ TAILQ_HEAD(tee_obj_head, tee_obj);
 TAILQ_HEAD(tee_storage_enum_head, tee_storage_enum);
 SLIST_HEAD(load_seg_head, load_seg);
 
+/*
+ * struct user_ta_claim - Use of an object or state of a concurrent TA
+ * @tsd:	Data of the thread using it, NULL if unused
+ * @link:	Link in the claims of that thread
+ *
+ * Objects, cryptographic states and enumerators are claimed by the
+ * thread looking them up and released when the syscall returns, so
+ * another thread of the TA can neither use nor free them meanwhile.
+ */
+struct user_ta_claim {
+	struct thread_specific_data *tsd;
+	SLIST_ENTRY(user_ta_claim) link;
+};
+
 /*
  * struct user_ta_ctx - user TA context
  * @open_sessions:	List of sessions opened by this TA
  * @cryp_states:	List of cryp states created by this TA
  * @objects:		List of storage objects opened by this TA
+ * @cryp_state_db:	Handles of the cryp states in @cryp_states
+ * @object_db:		Handles of the storage objects in @objects
+ * @handle_gen:		Generation count of the last tagged handle
  * @storage_enums:	List of storage enumerators opened by this TA
  * @ta_time_offs:	Time reference used by the TA
+ * @futex_mu:		Protects sleeping in syscall_futex_wait()
+ * @futex_cv:		Threads sleeping in syscall_futex_wait()
  * @uctx:		Generic user mode context
  * @ctx:		Generic TA context
  */
@@ -36,8 +56,13 @@ struct user_ta_ctx {
 	struct tee_ta_session_head open_sessions;
 	struct tee_cryp_state_head cryp_states;
 	struct tee_obj_head objects;
+	struct handle_db cryp_state_db;
+	struct handle_db object_db;
+	uint32_t handle_gen;
 	struct tee_storage_enum_head storage_enums;
 	void *ta_time_offs;
+	struct mutex futex_mu;
+	struct condvar futex_cv;
 	struct user_mode_ctx uctx;
 	struct tee_ta_ctx ta_ctx;
 };
@@ -57,6 +82,41 @@ static inline struct user_ta_ctx *to_user_ta_ctx(struct ts_ctx *ctx)
 	return container_of(ctx, struct user_ta_ctx, ta_ctx.ts_ctx);
 }
 
+/*
+ * user_ta_claim() - Claim an object, state or enumerator for this thread
+ * @utc:	User TA context
+ * @c:		Claim of the object, state or enumerator
+ *
+ * Must be called with @utc->uctx locked, see user_mode_ctx_lock(). Does
+ * nothing unless @utc is concurrent. Returns TEE_ERROR_BUSY if another
+ * thread is using it, waiting could dead-lock as the threads may claim
+ * several handles in any order.
+ */
+TEE_Result user_ta_claim(struct user_ta_ctx *utc, struct user_ta_claim *c);
+
+/*
+ * user_ta_unclaim() - Drop the claim of an object, state or enumerator
+ * @utc:	User TA context
+ * @c:		Claim of the object, state or enumerator
+ *
+ * Called with @utc->uctx locked before what @c is embedded in is freed.
+ */
+void user_ta_unclaim(struct user_ta_ctx *utc, struct user_ta_claim *c);
+
+/*
+ * user_ta_release_claims() - Release all claims of this thread
+ * @utc:	User TA context
+ *
+ * Called when a syscall returns.
+ */
+void user_ta_release_claims(struct user_ta_ctx *utc);
+
+/*
+ * user_ta_futex_wake() - Wake threads sleeping in syscall_futex_wait()
+ * @utc:	User TA context
+ */
+void user_ta_futex_wake(struct user_ta_ctx *utc);
+
 #ifdef CFG_WITH_USER_TA
 TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 			struct tee_ta_session *s);
@@ -423,6 +423,33 @@ uint32_t core_mmu_type_to_attr(enum teecore_memtypes t);
  */
 void core_mmu_create_user_map(struct user_mode_ctx *uctx,
 			      struct core_mmu_user_map *map);
+
+struct mobj;
+
+/*
+ * core_mmu_user_block_pa() - Check if user memory can use a block mapping
+ * @mobj:	Memory object
+ * @offs:	Offset into @mobj of the start of the block
+ * @len:	Length of the mapping starting at @offs
+ * @pa:		If not NULL, physical address of the block
+ *
+ * Returns true if @mobj at @offs is physically contiguous and aligned
+ * so that the first CORE_MMU_PGDIR_SIZE bytes of @len can be mapped in
+ * user space with a single translation table block entry.
+ */
+#ifdef CFG_CORE_USER_BLOCK_MAP
+bool core_mmu_user_block_pa(struct mobj *mobj, size_t offs, size_t len,
+			    paddr_t *pa);
+#else
+static inline bool core_mmu_user_block_pa(struct mobj *mobj __unused,
+					  size_t offs __unused,
+					  size_t len __unused,
+					  paddr_t *pa __unused)
+{
+	return false;
+}
+#endif
+
 /*
  * core_mmu_get_user_map() - Reads current MMU configuration for user VA space
  * @map:	MMU configuration for current user VA space.
@@ -694,9 +721,44 @@ void core_mmu_set_discovered_nsec_ddr(struct core_mmu_phys_mem *start,
 /* Initialize MMU partition */
 void core_init_mmu_prtn(struct mmu_partition *prtn, struct tee_mmap_region *mm);
 
+/*
+ * asid_alloc() - Allocate an ASID pair which is never reclaimed
+ *
+ * Returns the even ASID of the pair or 0 if none is available.
+ */
 unsigned int asid_alloc(void);
 void asid_free(unsigned int asid);
 
+/*
+ * asid_activate() - Assign an ASID pair to a user mode context
+ * @vmi:	VM info of the context
+ *
+ * Must be called by a thread before it activates the user mode mapping
+ * of the context, @vmi->asid is updated if the context has no ASID
+ * assigned in the current generation.
+ */
+void asid_activate(struct vm_info *vmi);
+
+/*
+ * asid_deactivate() - Undo asid_activate() once a thread has deactivated
+ * the user mode mapping of the context.
+ * @vmi:	VM info of the context
+ */
+void asid_deactivate(struct vm_info *vmi);
+
+/*
+ * asid_release() - Release the ASID pair of a user mode context being
+ * destroyed
+ * @vmi:	VM info of the context
+ *
+ * TLB entries using the ASID are invalidated on the next ASID rollover,
+ * before the ASID is used again.
+ */
+void asid_release(struct vm_info *vmi);
+
+/* Returns the number of ASID rollovers since boot */
+unsigned int asid_get_rollovers(void);
+
 #ifdef CFG_SECURE_DATA_PATH
 /* Alloc and fill SDP memory objects table - table is NULL terminated */
 struct mobj **core_sdp_mem_create_mobjs(void);
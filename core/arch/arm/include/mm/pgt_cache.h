@@ -32,6 +32,8 @@ struct pgt {
 #if !defined(CFG_WITH_LPAE)
 	struct pgt_parent *parent;
 #endif
+#else
+	bool dynamic;
 #endif
 	SLIST_ENTRY(pgt) link;
 };
@@ -50,11 +52,45 @@ struct pgt {
 #define PGT_CACHE_SIZE	ROUNDUP(CFG_NUM_THREADS * 2, PGT_NUM_PGT_PER_PAGE)
 #endif
 
+/*
+ * Without pager the cache grows beyond PGT_CACHE_SIZE on demand with page
+ * tables allocated from the heap, up to CFG_PGT_CACHE_MAX_SIZE tables.
+ * Those tables are returned to the heap again when there are enough free
+ * tables left.
+ */
+#if defined(CFG_WITH_PAGER)
+#define PGT_CACHE_MAX_SIZE	PGT_CACHE_SIZE
+#else
+#define PGT_CACHE_MAX_SIZE	\
+	MAX_UNSAFE(PGT_CACHE_SIZE, CFG_PGT_CACHE_MAX_SIZE)
+#endif
+
 SLIST_HEAD(pgt_cache, pgt);
 
+/*
+ * struct pgt_cache_stats - Page table cache statistics
+ * @num_tables:		Number of page tables currently in the pool
+ * @max_tables:		Max value of @num_tables since boot
+ * @allocs:		Number of page tables handed out
+ * @hits:		Number of page tables handed out to the same context
+ *			as before with entries still valid, CFG_PAGED_USER_TA
+ *			only
+ * @evictions:		Number of cached page tables taken from one context
+ *			to be used by another
+ * @waits:		Number of times a thread had to wait for page tables
+ */
+struct pgt_cache_stats {
+	size_t num_tables;
+	size_t max_tables;
+	size_t allocs;
+	size_t hits;
+	size_t evictions;
+	size_t waits;
+};
+
 static inline bool pgt_check_avail(size_t num_tbls)
 {
-	return num_tbls <= PGT_CACHE_SIZE;
+	return num_tbls <= PGT_CACHE_MAX_SIZE;
 }
 
 void pgt_alloc(struct pgt_cache *pgt_cache, struct ts_ctx *owning_ctx,
@@ -75,9 +111,15 @@ static inline void pgt_flush_ctx_range(struct pgt_cache *pgt_cache __unused,
 }
 #endif
 
-
 void pgt_init(void);
 
+/*
+ * pgt_get_stats() - Get and reset page table cache statistics
+ * @stats:	Statistics since last call, @num_tables and @max_tables are
+ *		not reset
+ */
+void pgt_get_stats(struct pgt_cache_stats *stats);
+
 #if defined(CFG_PAGED_USER_TA)
 void pgt_flush_ctx(struct ts_ctx *ctx);
 
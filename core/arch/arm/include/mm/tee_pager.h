@@ -29,6 +29,9 @@ struct tee_pager_area {
 	vaddr_t base;
 	size_t size;
 	struct pgt *pgt;
+	/* Fault-around state, see fault_around() in tee_pager.c */
+	size_t ra_next;
+	size_t ra_pages;
 	TAILQ_ENTRY(tee_pager_area) link;
 	TAILQ_ENTRY(tee_pager_area) fobj_link;
 };
@@ -255,6 +258,10 @@ static inline void tee_pager_release_phys(void *addr __unused,
 }
 #endif
 
+/* Page replacement policies, reported in struct tee_pager_stats */
+#define TEE_PAGER_POLICY_HIDE	0
+#define TEE_PAGER_POLICY_CLOCK	1
+
 /*
  * Statistics on the pager
  */
@@ -265,6 +272,13 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t faults;		/* number of faults handled by the pager */
+	size_t readahead_pages;	/* number of pages loaded by fault-around */
+	size_t readahead_hits;	/* pages loaded by fault-around and used */
+	size_t rw_saved;	/* number of read/write pages saved */
+	size_t rw_same_filled;	/* saved pages that were same-filled */
+	uint64_t save_us;	/* microseconds spent saving pages */
+	unsigned int policy;	/* TEE_PAGER_POLICY_* */
 };
 
 #ifdef CFG_WITH_PAGER
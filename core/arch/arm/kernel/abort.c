@@ -370,8 +370,9 @@ static void handle_user_mode_panic(struct abort_info *ai)
 static void handle_user_mode_vfp(void)
 {
 	struct ts_session *s = ts_get_current_session();
+	struct user_mode_ctx *uctx = to_user_mode_ctx(s->ctx);
 
-	thread_user_enable_vfp(&to_user_mode_ctx(s->ctx)->vfp);
+	thread_user_enable_vfp(user_mode_ctx_get_vfp(uctx));
 }
 #endif /*CFG_WITH_VFP*/
 
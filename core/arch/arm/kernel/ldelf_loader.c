@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <kernel/ldelf_loader.h>
 #include <kernel/ldelf_syscalls.h>
+#include <kernel/user_mode_ctx.h>
 #include <ldelf.h>
 #include <mm/mobj.h>
 #include <mm/vm.h>
@@ -93,6 +94,29 @@ TEE_Result ldelf_load_ldelf(struct user_mode_ctx *uctx)
 	return TEE_SUCCESS;
 }
 
+/*
+ * Several sessions can only execute concurrently in a TA instance which
+ * is shared between sessions. The pager doesn't support more than one
+ * thread faulting in the same context, paged TAs are serialized as
+ * before.
+ */
+static void init_concurrent(struct user_mode_ctx *uctx)
+{
+	struct tee_ta_ctx *ctx = &to_user_ta_ctx(uctx->ts_ctx)->ta_ctx;
+	const uint32_t req_flags = TA_FLAG_SINGLE_INSTANCE |
+				   TA_FLAG_MULTI_SESSION;
+
+	if ((ctx->flags & req_flags) != req_flags ||
+	    IS_ENABLED(CFG_PAGED_USER_TA)) {
+		DMSG("Sessions of TA %pUl are serialized",
+		     (void *)&uctx->ts_ctx->uuid);
+		ctx->flags &= ~TA_FLAG_CONCURRENT;
+		return;
+	}
+
+	user_mode_ctx_init_concurrent(uctx);
+}
+
 TEE_Result ldelf_init_with_ldelf(struct ts_session *sess,
 				 struct user_mode_ctx *uctx)
 {
@@ -143,6 +167,8 @@ TEE_Result ldelf_init_with_ldelf(struct ts_session *sess,
 			return TEE_ERROR_BAD_FORMAT;
 
 		to_user_ta_ctx(uctx->ts_ctx)->ta_ctx.flags = arg->flags;
+		if (arg->flags & TA_FLAG_CONCURRENT)
+			init_concurrent(uctx);
 	}
 
 	uctx->is_32bit = arg->is_32bit;
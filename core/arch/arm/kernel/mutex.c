@@ -3,12 +3,17 @@
  * Copyright (c) 2015-2017, Linaro Limited
  */
 
+#include <atomic.h>
+#include <config.h>
+#include <kernel/delay.h>
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/refcount.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <string.h>
 #include <trace.h>
+#include <util.h>
 
 #include "mutex_lockdep.h"
 
@@ -22,8 +27,141 @@ void mutex_init_recursive(struct recursive_mutex *m)
 	*m = (struct recursive_mutex)RECURSIVE_MUTEX_INITIALIZER;
 }
 
+#ifdef CFG_WITH_STATS
+/* Number of mutexes with individual statistics */
+#define MUTEX_STATS_NUM_HOT	8
+
+struct mutex_hot_entry {
+	struct mutex *m;
+	const char *fname;
+	int lineno;
+	struct mutex_stats stats;
+};
+
+static unsigned int mutex_stats_lock = SPINLOCK_UNLOCK;
+static struct mutex_stats mutex_stats;
+static struct mutex_hot_entry mutex_hot[MUTEX_STATS_NUM_HOT];
+
+static void incr_stats(struct mutex_stats *stats, bool spun, size_t slept)
+{
+	stats->contended++;
+	if (spun)
+		stats->spun++;
+	stats->slept += slept;
+}
+
+/*
+ * Called once a contended mutex is acquired. A mutex without an entry
+ * takes over the entry of the least contended mutex.
+ */
+static void update_stats(struct mutex *m, bool spun, size_t slept,
+			 const char *fname, int lineno)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&mutex_stats_lock);
+	struct mutex_hot_entry *e = mutex_hot;
+	size_t n = 0;
+
+	incr_stats(&mutex_stats, spun, slept);
+
+	for (n = 0; n < ARRAY_SIZE(mutex_hot); n++) {
+		if (mutex_hot[n].m == m) {
+			e = mutex_hot + n;
+			break;
+		}
+		if (mutex_hot[n].stats.contended < e->stats.contended)
+			e = mutex_hot + n;
+	}
+	if (e->m != m)
+		*e = (struct mutex_hot_entry){ .m = m };
+	if (fname) {
+		e->fname = fname;
+		e->lineno = lineno;
+	}
+	incr_stats(&e->stats, spun, slept);
+
+	cpu_spin_unlock_xrestore(&mutex_stats_lock, exceptions);
+}
+
+static void forget_stats(struct mutex *m)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&mutex_stats_lock);
+	size_t n = 0;
+
+	for (n = 0; n < ARRAY_SIZE(mutex_hot); n++)
+		if (mutex_hot[n].m == m)
+			mutex_hot[n] = (struct mutex_hot_entry){ };
+
+	cpu_spin_unlock_xrestore(&mutex_stats_lock, exceptions);
+}
+
+void mutex_get_stats(struct mutex_stats *stats)
+{
+	struct mutex_hot_entry hot[MUTEX_STATS_NUM_HOT] = { };
+	uint32_t exceptions = cpu_spin_lock_xsave(&mutex_stats_lock);
+	size_t n = 0;
+
+	*stats = mutex_stats;
+	memcpy(hot, mutex_hot, sizeof(hot));
+	mutex_stats = (struct mutex_stats){ };
+	memset(mutex_hot, 0, sizeof(mutex_hot));
+
+	cpu_spin_unlock_xrestore(&mutex_stats_lock, exceptions);
+
+	for (n = 0; n < ARRAY_SIZE(hot); n++) {
+		if (!hot[n].m)
+			continue;
+		IMSG("mutex %p: contended %zu spun %zu slept %zu (%s:%d)",
+		     (void *)hot[n].m, hot[n].stats.contended,
+		     hot[n].stats.spun, hot[n].stats.slept,
+		     hot[n].fname ? hot[n].fname : "?", hot[n].lineno);
+	}
+}
+#else
+static void update_stats(struct mutex *m __unused, bool spun __unused,
+			 size_t slept __unused, const char *fname __unused,
+			 int lineno __unused)
+{
+}
+
+static void forget_stats(struct mutex *m __unused)
+{
+}
+#endif
+
+/*
+ * Returns true if the mutex is write locked by a thread running on
+ * another core, called with m->spin_lock held.
+ */
+static bool owner_is_running(struct mutex *m)
+{
+	if (!CFG_MUTEX_SPIN_US || CFG_TEE_CORE_NB_CORE < 2)
+		return false;
+
+	return m->state == -1 && m->owner != thread_get_id() &&
+	       thread_is_active(m->owner);
+}
+
+/*
+ * Spins while the mutex is write locked by a thread running on another
+ * core, but at most CFG_MUTEX_SPIN_US. Such an owner is likely to unlock
+ * the mutex before a round trip to normal world would complete.
+ */
+static void spin_while_owner_runs(struct mutex *m)
+{
+	uint64_t timeout = timeout_init_us(CFG_MUTEX_SPIN_US);
+
+	while (atomic_load_short(&m->state) == -1 &&
+	       thread_is_active(atomic_load_short(&m->owner)) &&
+	       !timeout_elapsed(timeout))
+		;
+}
+
 static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 {
+	bool may_spin = true;
+	bool spun = false;
+	size_t slept = 0;
+
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 	assert(thread_is_in_normal_mode());
@@ -33,6 +171,7 @@ static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 	while (true) {
 		uint32_t old_itr_status;
 		bool can_lock;
+		bool spin = false;
 		struct wait_queue_elem wqe;
 
 		/*
@@ -48,21 +187,36 @@ static void __mutex_lock(struct mutex *m, const char *fname, int lineno)
 
 		can_lock = !m->state;
 		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, false /* wait_read */);
+			spin = may_spin && owner_is_running(m);
+			if (!spin)
+				wq_wait_init(&m->wq, &wqe,
+					     false /* wait_read */);
 		} else {
 			m->state = -1; /* write locked */
+			m->owner = thread_get_id();
 		}
 
 		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
-		if (!can_lock) {
+		if (can_lock) {
+			if (!may_spin)
+				update_stats(m, spun, slept, fname, lineno);
+			return;
+		}
+
+		may_spin = false;
+		if (spin) {
+			spin_while_owner_runs(m);
+			spun = true;
+		} else {
 			/*
 			 * Someone else is holding the lock, wait in normal
 			 * world for the lock to become available.
 			 */
 			wq_wait_final(&m->wq, &wqe, m, fname, lineno);
-		} else
-			return;
+			spun = false;
+			slept++;
+		}
 	}
 }
 
@@ -136,8 +290,10 @@ static bool __mutex_trylock(struct mutex *m, const char *fname __unused,
 	old_itr_status = cpu_spin_lock_xsave(&m->spin_lock);
 
 	can_lock_write = !m->state;
-	if (can_lock_write)
+	if (can_lock_write) {
 		m->state = -1;
+		m->owner = thread_get_id();
+	}
 
 	cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
@@ -171,6 +327,10 @@ static void __mutex_read_unlock(struct mutex *m, const char *fname, int lineno)
 
 static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 {
+	bool may_spin = true;
+	bool spun = false;
+	size_t slept = 0;
+
 	assert_have_no_spinlock();
 	assert(thread_get_id_may_fail() != THREAD_ID_INVALID);
 	assert(thread_is_in_normal_mode());
@@ -178,6 +338,7 @@ static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 	while (true) {
 		uint32_t old_itr_status;
 		bool can_lock;
+		bool spin = false;
 		struct wait_queue_elem wqe;
 
 		/*
@@ -193,21 +354,35 @@ static void __mutex_read_lock(struct mutex *m, const char *fname, int lineno)
 
 		can_lock = m->state != -1;
 		if (!can_lock) {
-			wq_wait_init(&m->wq, &wqe, true /* wait_read */);
+			spin = may_spin && owner_is_running(m);
+			if (!spin)
+				wq_wait_init(&m->wq, &wqe,
+					     true /* wait_read */);
 		} else {
 			m->state++; /* read_locked */
 		}
 
 		cpu_spin_unlock_xrestore(&m->spin_lock, old_itr_status);
 
-		if (!can_lock) {
+		if (can_lock) {
+			if (!may_spin)
+				update_stats(m, spun, slept, fname, lineno);
+			return;
+		}
+
+		may_spin = false;
+		if (spin) {
+			spin_while_owner_runs(m);
+			spun = true;
+		} else {
 			/*
 			 * Someone else is holding the lock, wait in normal
 			 * world for the lock to become available.
 			 */
 			wq_wait_final(&m->wq, &wqe, m, fname, lineno);
-		} else
-			return;
+			spun = false;
+			slept++;
+		}
 	}
 }
 
@@ -327,6 +502,7 @@ void mutex_destroy(struct mutex *m)
 	if (!wq_is_empty(&m->wq))
 		panic("waitqueue not empty");
 	mutex_destroy_check(m);
+	forget_stats(m);
 }
 
 void mutex_destroy_recursive(struct recursive_mutex *m)
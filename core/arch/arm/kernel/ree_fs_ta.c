@@ -38,6 +38,7 @@
 #include <assert.h>
 #include <crypto/crypto.h>
 #include <initcall.h>
+#include <kernel/mutex.h>
 #include <kernel/thread.h>
 #include <kernel/ts_store.h>
 #include <mm/core_memprot.h>
@@ -47,6 +48,7 @@
 #include <signed_hdr.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/queue.h>
 #include <tee_api_defines_extensions.h>
 #include <tee_api_types.h>
 #include <tee/tee_pobj.h>
@@ -55,11 +57,21 @@
 #include <tee/uuid.h>
 #include <utee_defines.h>
 
+/*
+ * The TA binary is fetched from normal world in windows of this size as
+ * it's read, if normal world doesn't support that it's fetched as a whole.
+ */
+#define REE_FS_TA_WINDOW_SIZE	(64 * 1024)
+
 struct ree_fs_ta_handle {
+	TEE_UUID uuid;
 	struct shdr *nw_ta; /* Non-secure (shared memory) */
 	size_t nw_ta_size;
 	struct mobj *mobj;
 	size_t offs;
+	size_t win_offs; /* Offset in the TA binary of the data at @nw_ta */
+	size_t win_size; /* Number of bytes of the TA binary at @nw_ta */
+	size_t win_max; /* Number of bytes @mobj can hold */
 	struct shdr *shdr; /* Verified secure copy of @nw_ta's signed header */
 	void *hash_ctx;
 	void *enc_ctx;
@@ -75,52 +87,107 @@ struct ta_ver_db_hdr {
 static const char ta_ver_db_obj_id[] = "ta_ver.db";
 static struct mutex ta_ver_db_mutex = MUTEX_INITIALIZER;
 
+static TEE_Result rpc_load_ta(const TEE_UUID *uuid, struct mobj *mobj,
+			      size_t offs, size_t *len, bool partial)
+{
+	struct thread_param params[3] = {
+		[1] = THREAD_PARAM_MEMREF(OUT, mobj, 0, *len),
+		[2] = THREAD_PARAM_VALUE(IN, offs, 0, 0),
+	};
+	TEE_Result res = TEE_SUCCESS;
+
+	params[0].attr = THREAD_PARAM_ATTR_VALUE_IN;
+	tee_uuid_to_octets((void *)&params[0].u.value, uuid);
+
+	res = thread_rpc_cmd(OPTEE_RPC_CMD_LOAD_TA, partial ? 3 : 2, params);
+	*len = params[1].u.memref.size;
+
+	return res;
+}
+
 /*
- * Load a TA via RPC with UUID defined by input param @uuid. The virtual
- * address of the raw TA binary is received in out parameter @ta.
+ * Fetch the window of the TA binary starting at @offs into the shared
+ * memory buffer. Returns TEE_ERROR_NOT_SUPPORTED if normal world can't
+ * load a part of the TA.
  */
-static TEE_Result rpc_load(const TEE_UUID *uuid, struct shdr **ta,
-			   size_t *ta_size, struct mobj **mobj)
+static TEE_Result rpc_load_window(struct ree_fs_ta_handle *h, size_t offs)
 {
-	TEE_Result res;
-	struct thread_param params[2];
+	size_t len = MIN(h->win_max, h->nw_ta_size - offs);
+	size_t req_len = len;
+	TEE_Result res = TEE_SUCCESS;
+
+	res = rpc_load_ta(&h->uuid, h->mobj, offs, &len, true);
+	if (res == TEE_ERROR_BAD_PARAMETERS || res == TEE_ERROR_NOT_SUPPORTED)
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (res)
+		return res;
+	if (len != req_len)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	h->win_offs = offs;
+	h->win_size = len;
 
-	if (!uuid || !ta || !mobj || !ta_size)
+	return TEE_SUCCESS;
+}
+
+/*
+ * Load a TA via RPC with UUID defined by input param @uuid. The start of
+ * the raw TA binary is made available at @h->nw_ta, the rest is fetched
+ * with rpc_load_window() as needed.
+ */
+static TEE_Result rpc_load(const TEE_UUID *uuid, struct ree_fs_ta_handle *h)
+{
+	TEE_Result res = TEE_SUCCESS;
+	size_t ta_size = 0;
+
+	if (!uuid || !h)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	memset(params, 0, sizeof(params));
-	params[0].attr = THREAD_PARAM_ATTR_VALUE_IN;
-	tee_uuid_to_octets((void *)&params[0].u.value, uuid);
-	params[1].attr = THREAD_PARAM_ATTR_MEMREF_OUT;
+	h->uuid = *uuid;
 
-	res = thread_rpc_cmd(OPTEE_RPC_CMD_LOAD_TA, 2, params);
+	res = rpc_load_ta(uuid, NULL, 0, &ta_size, false);
 	if (res != TEE_SUCCESS)
 		return res;
+	h->nw_ta_size = ta_size;
+
+	if (ta_size > REE_FS_TA_WINDOW_SIZE) {
+		h->mobj = thread_rpc_alloc_payload(REE_FS_TA_WINDOW_SIZE);
+		if (!h->mobj)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		h->win_max = REE_FS_TA_WINDOW_SIZE;
+		h->nw_ta = mobj_get_va(h->mobj, 0);
+		/* We don't expect NULL as thread_rpc_alloc_payload() was OK */
+		assert(h->nw_ta);
+
+		res = rpc_load_window(h, 0);
+		if (res != TEE_ERROR_NOT_SUPPORTED)
+			goto out;
 
-	*mobj = thread_rpc_alloc_payload(params[1].u.memref.size);
-	if (!*mobj)
+		DMSG("Partial TA load not supported, loading whole TA");
+		thread_rpc_free_payload(h->mobj);
+	}
+
+	h->mobj = thread_rpc_alloc_payload(ta_size);
+	if (!h->mobj)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	if ((*mobj)->size < params[1].u.memref.size) {
+	if (h->mobj->size < ta_size) {
 		res = TEE_ERROR_SHORT_BUFFER;
-		goto exit;
+		goto out;
 	}
 
-	*ta = mobj_get_va(*mobj, 0);
+	h->nw_ta = mobj_get_va(h->mobj, 0);
 	/* We don't expect NULL as thread_rpc_alloc_payload() was successful */
-	assert(*ta);
-	*ta_size = params[1].u.memref.size;
+	assert(h->nw_ta);
+	h->win_max = ta_size;
+	h->win_size = ta_size;
 
-	params[0].attr = THREAD_PARAM_ATTR_VALUE_IN;
-	tee_uuid_to_octets((void *)&params[0].u.value, uuid);
-	params[1].attr = THREAD_PARAM_ATTR_MEMREF_OUT;
-	params[1].u.memref.offs = 0;
-	params[1].u.memref.mobj = *mobj;
-
-	res = thread_rpc_cmd(OPTEE_RPC_CMD_LOAD_TA, 2, params);
-exit:
-	if (res != TEE_SUCCESS)
-		thread_rpc_free_payload(*mobj);
+	res = rpc_load_ta(uuid, h->mobj, 0, &ta_size, false);
+out:
+	if (res != TEE_SUCCESS) {
+		thread_rpc_free_payload(h->mobj);
+		h->mobj = NULL;
+	}
 
 	return res;
 }
@@ -130,7 +197,6 @@ static TEE_Result ree_fs_ta_open(const TEE_UUID *uuid,
 {
 	struct ree_fs_ta_handle *handle;
 	struct shdr *shdr = NULL;
-	struct mobj *mobj = NULL;
 	void *hash_ctx = NULL;
 	struct shdr *ta = NULL;
 	size_t ta_size = 0;
@@ -144,10 +210,14 @@ static TEE_Result ree_fs_ta_open(const TEE_UUID *uuid,
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	/* Request TA from tee-supplicant */
-	res = rpc_load(uuid, &ta, &ta_size, &mobj);
+	res = rpc_load(uuid, handle);
 	if (res != TEE_SUCCESS)
 		goto error;
 
+	/* The headers must be found in the first window */
+	ta = handle->nw_ta;
+	ta_size = handle->win_size;
+
 	/* Make secure copy of signed header */
 	shdr = shdr_alloc_and_copy(ta, ta_size);
 	if (!shdr) {
@@ -252,24 +322,21 @@ static TEE_Result ree_fs_ta_open(const TEE_UUID *uuid,
 		handle->ehdr = ehdr;
 	}
 
-	if (ta_size != offs + shdr->img_size) {
+	if (handle->nw_ta_size != offs + shdr->img_size) {
 		res = TEE_ERROR_SECURITY;
 		goto error_free_hash;
 	}
 
-	handle->nw_ta = ta;
-	handle->nw_ta_size = ta_size;
 	handle->offs = offs;
 	handle->hash_ctx = hash_ctx;
 	handle->shdr = shdr;
-	handle->mobj = mobj;
 	*h = (struct ts_store_handle *)handle;
 	return TEE_SUCCESS;
 
 error_free_hash:
 	crypto_hash_free_ctx(hash_ctx);
 error_free_payload:
-	thread_rpc_free_payload(mobj);
+	thread_rpc_free_payload(handle->mobj);
 error:
 	free(ehdr);
 	free(bs_hdr);
@@ -413,24 +480,20 @@ out:
 	return res;
 }
 
-static TEE_Result ree_fs_ta_read(struct ts_store_handle *h, void *data,
-				 size_t len)
+/*
+ * Decrypt and/or hash @len bytes at @src in the current window, the result
+ * is stored in @data unless it's NULL.
+ */
+static TEE_Result ree_fs_ta_read_window(struct ree_fs_ta_handle *handle,
+					void *data, uint8_t *src, size_t len)
 {
-	struct ree_fs_ta_handle *handle = (struct ree_fs_ta_handle *)h;
-
-	uint8_t *src = (uint8_t *)handle->nw_ta + handle->offs;
-	size_t next_offs = 0;
 	uint8_t *dst = src;
 	TEE_Result res = TEE_SUCCESS;
 
-	if (ADD_OVERFLOW(handle->offs, len, &next_offs) ||
-	    next_offs > handle->nw_ta_size)
-		return TEE_ERROR_BAD_PARAMETERS;
-
 	if (handle->shdr->img_type == SHDR_ENCRYPTED_TA) {
 		if (data) {
 			dst = data; /* Hash secure buffer */
-			res = tee_ta_decrypt_update(handle->enc_ctx, dst, src,
+			res = tee_ta_decrypt_update(handle->enc_ctx, data, src,
 						    len);
 			if (res != TEE_SUCCESS)
 				return TEE_ERROR_SECURITY;
@@ -464,7 +527,7 @@ static TEE_Result ree_fs_ta_read(struct ts_store_handle *h, void *data,
 		}
 	} else if (data) {
 		dst = data; /* Hash secure buffer (shm might be modified) */
-		memcpy(dst, src, len);
+		memcpy(data, src, len);
 	}
 
 	if (dst) {
@@ -473,7 +536,47 @@ static TEE_Result ree_fs_ta_read(struct ts_store_handle *h, void *data,
 			return TEE_ERROR_SECURITY;
 	}
 
-	handle->offs = next_offs;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ree_fs_ta_read(struct ts_store_handle *h, void *data,
+				 size_t len)
+{
+	struct ree_fs_ta_handle *handle = (struct ree_fs_ta_handle *)h;
+	size_t next_offs = 0;
+	size_t num_bytes = 0;
+	size_t win_end = 0;
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	if (ADD_OVERFLOW(handle->offs, len, &next_offs) ||
+	    next_offs > handle->nw_ta_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	while (num_bytes < len) {
+		win_end = handle->win_offs + handle->win_size;
+		if (handle->offs < handle->win_offs ||
+		    handle->offs >= win_end) {
+			res = rpc_load_window(handle, handle->offs);
+			if (res != TEE_SUCCESS)
+				return res;
+			win_end = handle->win_offs + handle->win_size;
+		}
+
+		n = MIN(len - num_bytes, win_end - handle->offs);
+		res = ree_fs_ta_read_window(handle,
+					    data ? (uint8_t *)data + num_bytes :
+						   NULL,
+					    (uint8_t *)handle->nw_ta +
+					    handle->offs - handle->win_offs,
+					    n);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		handle->offs += n;
+		num_bytes += n;
+	}
+
 	if (handle->offs == handle->nw_ta_size) {
 		if (handle->shdr->img_type == SHDR_ENCRYPTED_TA) {
 			/*
@@ -541,17 +644,215 @@ struct buf_ree_fs_ta_handle {
 	size_t offs;
 	uint8_t *tag;
 	unsigned int tag_len;
+	struct buf_ta_cache_entry *ce; /* Owner of @mm and @tag if not NULL */
 };
 
+/*
+ * Cache of verified TA binaries, see CFG_REE_FS_TA_CACHE_ENTRIES.
+ *
+ * An entry is kept after the last handle using it is closed. The most
+ * recently used entry is first in buf_ta_cache, entries unused for the
+ * longest time are evicted first when there are more than
+ * CFG_REE_FS_TA_CACHE_ENTRIES. All unused entries are evicted when the
+ * "Secure DDR" pool runs out of memory, see ree_fs_ta_cache_shrink().
+ *
+ * An entry is identified by the UUID and the tag (the digest in the signed
+ * header) of the binary. The signed header is fetched from normal world
+ * and verified each time a TA is opened, so a TA updated in normal world
+ * replaces the cached binary. The bootstrap header of the binary is kept
+ * to check against rollback each time the entry is used.
+ */
+struct buf_ta_cache_entry {
+	TEE_UUID uuid;
+	size_t ta_size;
+	tee_mm_entry_t *mm;
+	uint8_t *buf;
+	uint8_t *tag;
+	unsigned int tag_len;
+	struct shdr_bootstrap_ta bs_hdr;
+	bool have_bs_hdr;
+	bool cached;
+	unsigned int refc;
+	TAILQ_ENTRY(buf_ta_cache_entry) link;
+};
+
+static TAILQ_HEAD(buf_ta_cache_head, buf_ta_cache_entry) buf_ta_cache =
+	TAILQ_HEAD_INITIALIZER(buf_ta_cache);
+static size_t buf_ta_cache_count;
+static struct ree_fs_ta_cache_stats buf_ta_cache_stats;
+static struct mutex buf_ta_cache_mu = MUTEX_INITIALIZER;
+
+static void buf_ta_cache_free(struct buf_ta_cache_entry *ce)
+{
+	tee_mm_free(ce->mm);
+	free(ce->tag);
+	free(ce);
+}
+
+static void buf_ta_cache_remove(struct buf_ta_cache_entry *ce)
+{
+	TAILQ_REMOVE(&buf_ta_cache, ce, link);
+	buf_ta_cache_count--;
+	ce->cached = false;
+	if (!ce->refc)
+		buf_ta_cache_free(ce);
+}
+
+static void buf_ta_cache_evict(size_t max_count)
+{
+	struct buf_ta_cache_entry *ce = NULL;
+	struct buf_ta_cache_entry *prev = NULL;
+
+	ce = TAILQ_LAST(&buf_ta_cache, buf_ta_cache_head);
+	while (ce && buf_ta_cache_count > max_count) {
+		prev = TAILQ_PREV(ce, buf_ta_cache_head, link);
+		if (!ce->refc)
+			buf_ta_cache_remove(ce);
+		ce = prev;
+	}
+}
+
+/*
+ * Looks up a cached binary of the TA @uuid with the tag in @handle and
+ * lets @handle use it instead of its own tag. A cached binary of @uuid
+ * with another tag is outdated and is removed. Returns
+ * TEE_ERROR_ITEM_NOT_FOUND if the TA must be loaded from normal world.
+ */
+static TEE_Result buf_ta_cache_get(const TEE_UUID *uuid,
+				   struct buf_ree_fs_ta_handle *handle)
+{
+	struct buf_ta_cache_entry *ce = NULL;
+	TEE_Result res = TEE_ERROR_ITEM_NOT_FOUND;
+
+	mutex_lock(&buf_ta_cache_mu);
+
+	TAILQ_FOREACH(ce, &buf_ta_cache, link)
+		if (!memcmp(&ce->uuid, uuid, sizeof(*uuid)))
+			break;
+	if (!ce)
+		goto out;
+
+	if (ce->tag_len != handle->tag_len ||
+	    memcmp(ce->tag, handle->tag, handle->tag_len)) {
+		/* The TA has been updated in normal world */
+		buf_ta_cache_remove(ce);
+		goto out;
+	}
+
+	if (ce->have_bs_hdr) {
+		res = check_update_version(&ce->bs_hdr);
+		if (res == TEE_ERROR_ACCESS_CONFLICT) {
+			/* A later version has been loaded since */
+			buf_ta_cache_remove(ce);
+			res = TEE_ERROR_ITEM_NOT_FOUND;
+		}
+		if (res)
+			goto out;
+	}
+
+	TAILQ_REMOVE(&buf_ta_cache, ce, link);
+	TAILQ_INSERT_HEAD(&buf_ta_cache, ce, link);
+	ce->refc++;
+
+	free(handle->tag);
+	handle->ce = ce;
+	handle->ta_size = ce->ta_size;
+	handle->mm = ce->mm;
+	handle->buf = ce->buf;
+	handle->tag = ce->tag;
+	handle->tag_len = ce->tag_len;
+out:
+	if (res)
+		buf_ta_cache_stats.misses++;
+	else
+		buf_ta_cache_stats.hits++;
+	mutex_unlock(&buf_ta_cache_mu);
+
+	return res;
+}
+
+/*
+ * Adds the freshly verified binary of @handle to the cache, @handle keeps
+ * using it but doesn't own it any longer.
+ */
+static void buf_ta_cache_add(const TEE_UUID *uuid,
+			     struct buf_ree_fs_ta_handle *handle,
+			     const struct shdr_bootstrap_ta *bs_hdr)
+{
+	struct buf_ta_cache_entry *ce = calloc(1, sizeof(*ce));
+
+	if (!ce)
+		return;
+
+	ce->uuid = *uuid;
+	ce->ta_size = handle->ta_size;
+	ce->mm = handle->mm;
+	ce->buf = handle->buf;
+	ce->tag = handle->tag;
+	ce->tag_len = handle->tag_len;
+	if (bs_hdr) {
+		ce->bs_hdr = *bs_hdr;
+		ce->have_bs_hdr = true;
+	}
+	ce->refc = 1;
+	ce->cached = true;
+	handle->ce = ce;
+
+	mutex_lock(&buf_ta_cache_mu);
+	TAILQ_INSERT_HEAD(&buf_ta_cache, ce, link);
+	buf_ta_cache_count++;
+	buf_ta_cache_evict(CFG_REE_FS_TA_CACHE_ENTRIES);
+	mutex_unlock(&buf_ta_cache_mu);
+}
+
+static void buf_ta_cache_put(struct buf_ta_cache_entry *ce)
+{
+	mutex_lock(&buf_ta_cache_mu);
+	assert(ce->refc);
+	ce->refc--;
+	if (!ce->cached) {
+		if (!ce->refc)
+			buf_ta_cache_free(ce);
+	} else {
+		buf_ta_cache_evict(CFG_REE_FS_TA_CACHE_ENTRIES);
+	}
+	mutex_unlock(&buf_ta_cache_mu);
+}
+
+#if CFG_REE_FS_TA_CACHE_ENTRIES
+void ree_fs_ta_get_cache_stats(struct ree_fs_ta_cache_stats *stats)
+{
+	mutex_lock(&buf_ta_cache_mu);
+	*stats = buf_ta_cache_stats;
+	stats->entries = buf_ta_cache_count;
+	mutex_unlock(&buf_ta_cache_mu);
+}
+
+bool ree_fs_ta_cache_shrink(void)
+{
+	size_t count = 0;
+
+	mutex_lock(&buf_ta_cache_mu);
+	count = buf_ta_cache_count;
+	buf_ta_cache_evict(0);
+	count -= buf_ta_cache_count;
+	mutex_unlock(&buf_ta_cache_mu);
+
+	return count;
+}
+#endif
+
 static TEE_Result buf_ta_open(const TEE_UUID *uuid,
 			      struct ts_store_handle **h)
 {
 	struct buf_ree_fs_ta_handle *handle = NULL;
+	struct ree_fs_ta_handle *ree_handle = NULL;
 	TEE_Result res = TEE_SUCCESS;
 
 	handle = calloc(1, sizeof(*handle));
 	if (!handle)
 		return TEE_ERROR_OUT_OF_MEMORY;
+
 	res = ree_fs_ta_open(uuid, &handle->h);
 	if (res)
 		goto err2;
@@ -573,7 +874,18 @@ static TEE_Result buf_ta_open(const TEE_UUID *uuid,
 	if (res)
 		goto err;
 
+	if (CFG_REE_FS_TA_CACHE_ENTRIES) {
+		res = buf_ta_cache_get(uuid, handle);
+		if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+			if (!res)
+				*h = (struct ts_store_handle *)handle;
+			goto err;
+		}
+	}
+
 	handle->mm = tee_mm_alloc(&tee_mm_sec_ddr, handle->ta_size);
+	if (!handle->mm && ree_fs_ta_cache_shrink())
+		handle->mm = tee_mm_alloc(&tee_mm_sec_ddr, handle->ta_size);
 	if (!handle->mm) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto err;
@@ -587,6 +899,10 @@ static TEE_Result buf_ta_open(const TEE_UUID *uuid,
 	res = ree_fs_ta_read(handle->h, handle->buf, handle->ta_size);
 	if (res)
 		goto err;
+	if (CFG_REE_FS_TA_CACHE_ENTRIES) {
+		ree_handle = (struct ree_fs_ta_handle *)handle->h;
+		buf_ta_cache_add(uuid, handle, ree_handle->bs_hdr);
+	}
 	*h = (struct ts_store_handle *)handle;
 err:
 	ree_fs_ta_close(handle->h);
@@ -645,8 +961,12 @@ static void buf_ta_close(struct ts_store_handle *h)
 
 	if (!handle)
 		return;
-	tee_mm_free(handle->mm);
-	free(handle->tag);
+	if (handle->ce) {
+		buf_ta_cache_put(handle->ce);
+	} else {
+		tee_mm_free(handle->mm);
+		free(handle->tag);
+	}
 	free(handle);
 }
 
@@ -472,7 +472,7 @@ static void stmm_dump_state(struct ts_ctx *ctx)
 
 static uint32_t stmm_get_instance_id(struct ts_ctx *ctx)
 {
-	return to_stmm_ctx(ctx)->uctx.vm_info.asid;
+	return to_stmm_ctx(ctx)->uctx.vm_info.id;
 }
 
 static void stmm_ctx_destroy(struct ts_ctx *ctx)
@@ -9,6 +9,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <config.h>
 #include <io.h>
 #include <keep.h>
@@ -22,7 +23,7 @@
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread_defs.h>
 #include <kernel/thread.h>
-#include <kernel/user_mode_ctx_struct.h>
+#include <kernel/user_mode_ctx.h>
 #include <kernel/virtualization.h>
 #include <mm/core_memprot.h>
 #include <mm/mobj.h>
@@ -171,7 +172,9 @@ static uint8_t thread_user_kdata_page[
 #endif
 #endif
 
-static unsigned int thread_global_lock __nex_bss = SPINLOCK_UNLOCK;
+#ifdef CFG_TEE_BENCHMARK
+static struct thread_entry_stats thread_entry_stats __nex_bss;
+#endif
 
 static void init_canaries(void)
 {
@@ -238,16 +241,6 @@ void thread_check_canaries(void)
 #endif/*CFG_WITH_STACK_CANARIES*/
 }
 
-void thread_lock_global(void)
-{
-	cpu_spin_lock(&thread_global_lock);
-}
-
-void thread_unlock_global(void)
-{
-	cpu_spin_unlock(&thread_global_lock);
-}
-
 #ifdef ARM32
 uint32_t __nostackcheck thread_get_exceptions(void)
 {
@@ -527,32 +520,158 @@ void __nostackcheck thread_clr_boot_thread(void)
 	assert(l->curr_thread >= 0 && l->curr_thread < CFG_NUM_THREADS);
 	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
 	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	l->last_thread = l->curr_thread;
 	l->curr_thread = -1;
 }
 
-void thread_alloc_and_run(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+/*
+ * Publishes the updates of the thread context before the new state, pairs
+ * with the acquire in claim_thread().
+ */
+static void set_thread_state(size_t n, unsigned int state)
 {
-	size_t n;
-	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
+	__atomic_store_n(&threads[n].state, state, __ATOMIC_RELEASE);
+}
 
-	assert(l->curr_thread == -1);
+/*
+ * Atomically moves a thread from state @from to THREAD_STATE_ACTIVE. A
+ * thread reserved by thread_reserve_all_free() is only held for a short
+ * while so we wait for it to be released instead of reporting it as busy.
+ */
+static bool claim_thread(size_t n, unsigned int from)
+{
+	unsigned int state = atomic_load_uint(&threads[n].state);
+
+	while (true) {
+		if (state == from) {
+			if (atomic_cas_uint(&threads[n].state, &state,
+					    THREAD_STATE_ACTIVE))
+				return true;
+		} else if (state == THREAD_STATE_RESERVED) {
+			state = atomic_load_uint(&threads[n].state);
+		} else {
+			return false;
+		}
+	}
+}
+
+static bool alloc_thread(struct thread_core_local *l, size_t *thread_id)
+{
+	size_t first = get_core_pos() * CFG_NUM_THREADS / CFG_TEE_CORE_NB_CORE;
+	size_t n = 0;
 
-	thread_lock_global();
+	/*
+	 * The thread last freed on this core is likely to still have its
+	 * stack and context in the caches of this core.
+	 */
+	if (l->last_thread >= 0 &&
+	    claim_thread(l->last_thread, THREAD_STATE_FREE)) {
+		*thread_id = l->last_thread;
+		return true;
+	}
 
+	/*
+	 * Each core starts with its own share of the threads to avoid
+	 * competing with the other cores for the same entries, the shares
+	 * of the other cores are only used once the own share is busy.
+	 */
 	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
+		size_t idx = (first + n) % CFG_NUM_THREADS;
+
+		if (claim_thread(idx, THREAD_STATE_FREE)) {
+			*thread_id = idx;
+			return true;
 		}
 	}
 
-	thread_unlock_global();
+	return false;
+}
+
+bool thread_reserve_all_free(void)
+{
+	unsigned int state = 0;
+	size_t n = 0;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		state = THREAD_STATE_FREE;
+		while (!atomic_cas_uint(&threads[n].state, &state,
+					THREAD_STATE_RESERVED)) {
+			if (state != THREAD_STATE_FREE)
+				goto err;
+		}
+	}
+
+	return true;
+err:
+	while (n)
+		set_thread_state(--n, THREAD_STATE_FREE);
+	return false;
+}
+
+void thread_release_all_reserved(void)
+{
+	size_t n = 0;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		assert(threads[n].state == THREAD_STATE_RESERVED);
+		set_thread_state(n, THREAD_STATE_FREE);
+	}
+}
+
+#ifdef CFG_TEE_BENCHMARK
+static uint64_t entry_timestamp(void)
+{
+	return barrier_read_cntpct();
+}
+
+static void update_entry_stats(uint64_t start, bool last_thread_hit)
+{
+	struct thread_entry_stats *st = &thread_entry_stats;
+	uint32_t ticks = MIN(barrier_read_cntpct() - start,
+			     (uint64_t)UINT32_MAX);
+	uint32_t max = atomic_load_u32(&st->lat_max);
+
+	atomic_inc32(st->lat_hist + MIN(ticks, THREAD_ENTRY_LAT_BUCKETS - 1U));
+	while (ticks > max && !atomic_cas_u32(&st->lat_max, &max, ticks))
+		;
+	if (last_thread_hit)
+		atomic_inc32(&st->last_thread_hits);
+}
+
+void thread_get_entry_stats(struct thread_entry_stats *stats)
+{
+	struct thread_entry_stats *st = &thread_entry_stats;
+	size_t n = 0;
+
+	for (n = 0; n < THREAD_ENTRY_LAT_BUCKETS; n++)
+		stats->lat_hist[n] = atomic_load_u32(st->lat_hist + n);
+	stats->lat_max = atomic_load_u32(&st->lat_max);
+	stats->last_thread_hits = atomic_load_u32(&st->last_thread_hits);
+}
+#else
+static uint64_t entry_timestamp(void)
+{
+	return 0;
+}
+
+static void update_entry_stats(uint64_t start __unused,
+			       bool last_thread_hit __unused)
+{
+}
+#endif
+
+void thread_alloc_and_run(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	uint64_t start = entry_timestamp();
+	struct thread_core_local *l = thread_get_core_local();
+	size_t n = 0;
+
+	assert(l->curr_thread == -1);
 
-	if (!found_thread)
+	if (!alloc_thread(l, &n))
 		return;
 
+	update_entry_stats(start, (short int)n == l->last_thread);
 	l->curr_thread = n;
 
 	threads[n].flags = 0;
@@ -651,20 +770,10 @@ void thread_resume_from_rpc(uint32_t thread_id, uint32_t a0, uint32_t a1,
 {
 	size_t n = thread_id;
 	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
 
 	assert(l->curr_thread == -1);
 
-	thread_lock_global();
-
-	if (n < CFG_NUM_THREADS && threads[n].state == THREAD_STATE_SUSPENDED) {
-		threads[n].state = THREAD_STATE_ACTIVE;
-		found_thread = true;
-	}
-
-	thread_unlock_global();
-
-	if (!found_thread)
+	if (n >= CFG_NUM_THREADS || !claim_thread(n, THREAD_STATE_SUSPENDED))
 		return;
 
 	l->curr_thread = n;
@@ -820,17 +929,15 @@ void thread_state_free(void)
 		(void *)(threads[ct].stack_va_end - STACK_THREAD_SIZE),
 		STACK_THREAD_SIZE);
 
-	thread_lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
-	threads[ct].state = THREAD_STATE_FREE;
 	threads[ct].flags = 0;
+	set_thread_state(ct, THREAD_STATE_FREE);
+	l->last_thread = ct;
 	l->curr_thread = -1;
 
 #ifdef CFG_VIRTUALIZATION
 	virt_unset_guest();
 #endif
-	thread_unlock_global();
 }
 
 #ifdef CFG_WITH_PAGER
@@ -881,13 +988,10 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 	}
 	thread_lazy_restore_ns_vfp();
 
-	thread_lock_global();
-
 	assert(threads[ct].state == THREAD_STATE_ACTIVE);
 	threads[ct].flags |= flags;
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
-	threads[ct].state = THREAD_STATE_SUSPENDED;
 
 	threads[ct].have_user_map = core_mmu_user_mapping_is_active();
 	if (threads[ct].have_user_map) {
@@ -897,14 +1001,13 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 		core_mmu_set_user_map(NULL);
 	}
 
+	set_thread_state(ct, THREAD_STATE_SUSPENDED);
 	l->curr_thread = -1;
 
 #ifdef CFG_VIRTUALIZATION
 	virt_unset_guest();
 #endif
 
-	thread_unlock_global();
-
 	return ct;
 }
 
@@ -972,6 +1075,14 @@ short int thread_get_id(void)
 	return ct;
 }
 
+bool thread_is_active(short int thread_id)
+{
+	assert(thread_id >= 0 && thread_id < CFG_NUM_THREADS);
+
+	return __compiler_atomic_load(&threads[thread_id].state) ==
+	       THREAD_STATE_ACTIVE;
+}
+
 #ifdef CFG_WITH_PAGER
 static void init_thread_stacks(void)
 {
@@ -1071,6 +1182,7 @@ void __nostackcheck thread_init_thread_core_local(void)
 
 	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
 		tcl[n].curr_thread = -1;
+		tcl[n].last_thread = -1;
 		tcl[n].flags = THREAD_CLF_TMP;
 	}
 
@@ -1364,7 +1476,7 @@ void thread_user_save_vfp(void)
 
 void thread_user_clear_vfp(struct user_mode_ctx *uctx)
 {
-	struct thread_user_vfp_state *uvfp = &uctx->vfp;
+	struct thread_user_vfp_state *uvfp = user_mode_ctx_get_vfp(uctx);
 	struct thread_ctx *thr = threads + thread_get_id();
 
 	if (uvfp == thr->vfp_state.uvfp)
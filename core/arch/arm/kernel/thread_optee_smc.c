@@ -233,13 +233,9 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	thread_lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!thread_reserve_all_free()) {
+		rv = false;
+		goto out;
 	}
 
 	rv = true;
@@ -248,14 +244,15 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 			*cookie = mobj_get_cookie(threads[n].rpc_mobj);
 			mobj_put(threads[n].rpc_mobj);
 			threads[n].rpc_arg = NULL;
-			goto out;
+			goto out_release;
 		}
 	}
 
 	*cookie = 0;
 	thread_prealloc_rpc_cache = false;
+out_release:
+	thread_release_all_reserved();
 out:
-	thread_unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
@@ -263,22 +260,14 @@ out:
 bool thread_enable_prealloc_rpc_cache(void)
 {
 	bool rv;
-	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	thread_lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	rv = thread_reserve_all_free();
+	if (rv) {
+		thread_prealloc_rpc_cache = true;
+		thread_release_all_reserved();
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
-	thread_unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
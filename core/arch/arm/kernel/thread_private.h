@@ -19,6 +19,7 @@ enum thread_state {
 	THREAD_STATE_FREE,
 	THREAD_STATE_SUSPENDED,
 	THREAD_STATE_ACTIVE,
+	THREAD_STATE_RESERVED,
 };
 
 #ifdef ARM64
@@ -55,7 +56,7 @@ SLIST_HEAD(thread_shm_cache, thread_shm_cache_entry);
 
 struct thread_ctx {
 	struct thread_ctx_regs regs;
-	enum thread_state state;
+	unsigned int state;	/* enum thread_state, updated atomically */
 	vaddr_t stack_va_end;
 	uint32_t flags;
 	struct core_mmu_user_map user_map;
@@ -189,8 +190,14 @@ void thread_check_canaries(void);
 void thread_alloc_and_run(uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
 void thread_resume_from_rpc(uint32_t thread_id, uint32_t a0, uint32_t a1,
 			    uint32_t a2, uint32_t a3);
-void thread_lock_global(void);
-void thread_unlock_global(void);
+
+/*
+ * Reserves all threads, fails if any thread is in use. While reserved no
+ * thread can be allocated, which allows updating state shared by all
+ * threads. Released with thread_release_all_reserved().
+ */
+bool thread_reserve_all_free(void);
+void thread_release_all_reserved(void);
 
 
 /*
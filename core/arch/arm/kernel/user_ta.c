@@ -144,18 +144,28 @@ static TEE_Result user_ta_enter(struct ts_session *session,
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out_clr_cancel;
 	}
+	/*
+	 * A concurrent TA gives each thread executing in it a stack of its
+	 * own, the others always use the stack set up by ldelf.
+	 */
+	res = user_mode_ctx_enter_thread(&utc->uctx, &usr_stack);
+	if (res) {
+		ta_sess->err_origin = TEE_ORIGIN_TEE;
+		goto out;
+	}
 	if (ta_sess->param) {
 		/* Map user space memory */
+		user_mode_ctx_lock(&utc->uctx);
 		res = vm_map_param(&utc->uctx, ta_sess->param, param_va);
+		user_mode_ctx_unlock(&utc->uctx);
 		if (res != TEE_SUCCESS)
-			goto out;
+			goto out_exit_thread;
 	}
 
 	/* Switch to user ctx */
 	ts_push_current_session(session);
 
 	/* Make room for usr_params at top of stack */
-	usr_stack = utc->uctx.stack_ptr;
 	usr_stack -= ROUNDUP(sizeof(struct utee_params), STACK_ALIGNMENT);
 	usr_params = (struct utee_params *)usr_stack;
 	if (ta_sess->param)
@@ -172,6 +182,9 @@ static TEE_Result user_ta_enter(struct ts_session *session,
 	thread_user_clear_vfp(&utc->uctx);
 
 	if (utc->ta_ctx.panicked) {
+		/* Other threads sleeping on a mutex held by this one */
+		if (utc->uctx.concurrent)
+			user_ta_futex_wake(utc);
 		abort_print_current_ta();
 		DMSG("tee_user_ta_enter: TA panicked with code 0x%x",
 		     utc->ta_ctx.panic_code);
@@ -192,13 +205,17 @@ static TEE_Result user_ta_enter(struct ts_session *session,
 		 * Clear out the parameter mappings added with
 		 * vm_clean_param() above.
 		 */
+		user_mode_ctx_lock(&utc->uctx);
 		vm_clean_param(&utc->uctx);
+		user_mode_ctx_unlock(&utc->uctx);
 	}
 
 
 	ts_sess = ts_pop_current_session();
 	assert(ts_sess == session);
 
+out_exit_thread:
+	user_mode_ctx_exit_thread(&utc->uctx);
 out:
 	dec_recursion();
 out_clr_cancel:
@@ -238,11 +255,14 @@ static void user_ta_dump_state(struct ts_ctx *ctx)
 {
 	struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
 
+	/* ldelf has a single stack, serialize with other threads */
+	user_mode_ctx_lock(&utc->uctx);
+
 	if (utc->uctx.dump_entry_func) {
 		TEE_Result res = ldelf_dump_state(&utc->uctx);
 
 		if (!res || res == TEE_ERROR_TARGET_DEAD)
-			return;
+			goto out;
 		/*
 		 * Fall back to dump_state_no_ldelf_dbg() if
 		 * ldelf_dump_state() fails for some reason.
@@ -254,13 +274,14 @@ static void user_ta_dump_state(struct ts_ctx *ctx)
 	}
 
 	dump_state_no_ldelf_dbg(utc);
+out:
+	user_mode_ctx_unlock(&utc->uctx);
 }
 
 #ifdef CFG_FTRACE_SUPPORT
-static void user_ta_dump_ftrace(struct ts_ctx *ctx)
+static void dump_ftrace(struct user_ta_ctx *utc)
 {
 	uint32_t prot = TEE_MATTR_URW;
-	struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
 	struct thread_param params[3] = { };
 	TEE_Result res = TEE_SUCCESS;
 	struct mobj *mobj = NULL;
@@ -294,7 +315,7 @@ static void user_ta_dump_ftrace(struct ts_ctx *ctx)
 		goto out_free_pl;
 
 	ubuf = (uint8_t *)va + mobj_get_phys_offs(mobj, mobj->phys_granule);
-	memcpy(ubuf, &ctx->uuid, sizeof(TEE_UUID));
+	memcpy(ubuf, &utc->ta_ctx.ts_ctx.uuid, sizeof(TEE_UUID));
 	ubuf += sizeof(TEE_UUID);
 
 	ld_addr_len = snprintk((char *)ubuf, LOAD_ADDR_DUMP_SIZE,
@@ -323,6 +344,22 @@ out_unmap_pl:
 out_free_pl:
 	thread_rpc_free_payload(mobj);
 }
+
+static void user_ta_dump_ftrace(struct ts_ctx *ctx)
+{
+	struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
+
+	/*
+	 * The payload is mapped in the TA, skip the dump while other
+	 * threads are executing in a concurrent TA.
+	 */
+	if (user_mode_ctx_lock_exclusive(&utc->uctx)) {
+		DMSG("TA busy, ftrace not dumped");
+		return;
+	}
+	dump_ftrace(utc);
+	user_mode_ctx_unlock(&utc->uctx);
+}
 #endif /*CFG_FTRACE_SUPPORT*/
 
 #ifdef CFG_TA_GPROF_SUPPORT
@@ -335,6 +372,53 @@ static void user_ta_gprof_set_status(enum ts_gprof_status status)
 }
 #endif /*CFG_TA_GPROF_SUPPORT*/
 
+TEE_Result user_ta_claim(struct user_ta_ctx *utc, struct user_ta_claim *c)
+{
+	struct thread_specific_data *tsd = thread_get_tsd();
+
+	if (!utc->uctx.concurrent || c->tsd == tsd)
+		return TEE_SUCCESS;
+	if (c->tsd)
+		return TEE_ERROR_BUSY;
+
+	c->tsd = tsd;
+	SLIST_INSERT_HEAD(&tsd->ta_claims, c, link);
+	return TEE_SUCCESS;
+}
+
+void user_ta_unclaim(struct user_ta_ctx *utc, struct user_ta_claim *c)
+{
+	if (!utc->uctx.concurrent || !c->tsd)
+		return;
+
+	assert(c->tsd == thread_get_tsd());
+	SLIST_REMOVE(&c->tsd->ta_claims, c, user_ta_claim, link);
+	c->tsd = NULL;
+}
+
+void user_ta_release_claims(struct user_ta_ctx *utc)
+{
+	struct thread_specific_data *tsd = thread_get_tsd();
+	struct user_ta_claim *c = NULL;
+
+	if (SLIST_EMPTY(&tsd->ta_claims))
+		return;
+
+	user_mode_ctx_lock(&utc->uctx);
+	while ((c = SLIST_FIRST(&tsd->ta_claims))) {
+		SLIST_REMOVE_HEAD(&tsd->ta_claims, link);
+		c->tsd = NULL;
+	}
+	user_mode_ctx_unlock(&utc->uctx);
+}
+
+void user_ta_futex_wake(struct user_ta_ctx *utc)
+{
+	mutex_lock(&utc->futex_mu);
+	condvar_broadcast(&utc->futex_cv);
+	mutex_unlock(&utc->futex_mu);
+}
+
 static void free_utc(struct user_ta_ctx *utc)
 {
 	tee_pager_rem_um_areas(&utc->uctx);
@@ -355,8 +439,14 @@ static void free_utc(struct user_ta_ctx *utc)
 	tee_svc_cryp_free_states(utc);
 	/* Close cryp objects opened by this TA */
 	tee_obj_close_all(utc);
+	handle_db_destroy(&utc->cryp_state_db, NULL);
+	handle_db_destroy(&utc->object_db, NULL);
 	/* Free emums created by this TA */
 	tee_svc_storage_close_all_enum(utc);
+	/* Last since the above lock the context */
+	user_mode_ctx_free_threads(&utc->uctx);
+	condvar_destroy(&utc->futex_cv);
+	mutex_destroy(&utc->futex_mu);
 	free(utc);
 }
 
@@ -367,7 +457,7 @@ static void user_ta_ctx_destroy(struct ts_ctx *ctx)
 
 static uint32_t user_ta_get_instance_id(struct ts_ctx *ctx)
 {
-	return to_user_ta_ctx(ctx)->uctx.vm_info.asid;
+	return to_user_ta_ctx(ctx)->uctx.vm_info.id;
 }
 
 static const struct ts_ops user_ta_ops __rodata_unpaged = {
@@ -438,6 +528,8 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 	TAILQ_INIT(&utc->objects);
 	TAILQ_INIT(&utc->storage_enums);
 	condvar_init(&utc->ta_ctx.busy_cv);
+	mutex_init(&utc->futex_mu);
+	condvar_init(&utc->futex_cv);
 	utc->ta_ctx.ref_count = 1;
 
 	utc->uctx.ts_ctx = &utc->ta_ctx.ts_ctx;
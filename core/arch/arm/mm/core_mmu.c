@@ -127,14 +127,26 @@ register_phys_mem(MEM_AREA_NSEC_SHM, TEE_SHMEM_START, TEE_SHMEM_SIZE);
 
 /*
  * Two ASIDs per context, one for kernel mode and one for user mode. ASID 0
- * and 1 are reserved and not used. This means a maximum of 126 loaded user
- * mode contexts. This value can be increased but not beyond the maximum
- * ASID, which is architecture dependent (max 255 for ARMv7-A and ARMv8-A
- * Aarch32). This constant defines number of ASID pairs.
+ * and 1 are reserved and not used. This value can be increased but not
+ * beyond the maximum ASID, which is architecture dependent (max 255 for
+ * ARMv7-A and ARMv8-A Aarch32). This constant defines number of ASID pairs.
+ *
+ * User mode contexts are assigned an ASID pair when they're activated on
+ * a thread, not when they're created. A released ASID pair isn't handed
+ * out again until the bitmap is exhausted, then a new generation is
+ * started by reclaiming all pairs not currently activated or pinned by
+ * asid_alloc() and invalidating the entire TLB. So the number of loaded
+ * user mode contexts is only limited by memory.
  */
 #define MMU_NUM_ASID_PAIRS		64
 
+/* ASID pairs handed out in the current generation */
 static bitstr_t bit_decl(g_asid, MMU_NUM_ASID_PAIRS) __nex_bss;
+/* ASID pairs allocated with asid_alloc(), kept across generations */
+static bitstr_t bit_decl(g_asid_pinned, MMU_NUM_ASID_PAIRS) __nex_bss;
+static struct vm_info *g_asid_owner[MMU_NUM_ASID_PAIRS] __nex_bss;
+static unsigned int g_asid_users[MMU_NUM_ASID_PAIRS] __nex_bss;
+static unsigned int g_asid_rollovers __nex_bss;
 static unsigned int g_asid_spinlock __nex_bss = SPINLOCK_UNLOCK;
 
 static unsigned int mmu_spinlock;
@@ -1551,6 +1563,34 @@ static void set_region(struct core_mmu_table_info *tbl_info,
 	}
 }
 
+/*
+ * Maps the translation table directory entry at @va with a block if
+ * @region covers the entire entry and the memory allows it. Regions split
+ * by vm_set_prot() or similar aren't covering the entry any longer and
+ * are mapped with small pages instead.
+ */
+static bool set_pg_block(struct core_mmu_table_info *dir_info,
+			 struct vm_region *region, vaddr_t va,
+			 struct core_mmu_table_info *pg_info)
+{
+	size_t offset = va - region->va + region->offset;
+	size_t len = region->va + region->size - va;
+	paddr_t pa = 0;
+
+	if (va & CORE_MMU_PGDIR_MASK ||
+	    !core_mmu_user_block_pa(region->mobj, offset, len, &pa))
+		return false;
+
+	core_mmu_set_entry(dir_info, core_mmu_va2idx(dir_info, va), pa,
+			   region->attr);
+
+	/* The next region needs a new translation table */
+	pg_info->va_base = va;
+	pg_info->table = NULL;
+
+	return true;
+}
+
 static void set_pg_region(struct core_mmu_table_info *dir_info,
 			struct vm_region *region, struct pgt **pgt,
 			struct core_mmu_table_info *pg_info)
@@ -1564,6 +1604,11 @@ static void set_pg_region(struct core_mmu_table_info *dir_info,
 	uint32_t pgt_attr = (r.attr & TEE_MATTR_SECURE) | TEE_MATTR_TABLE;
 
 	while (r.va < end) {
+		if (set_pg_block(dir_info, region, r.va, pg_info)) {
+			r.va += CORE_MMU_PGDIR_SIZE;
+			continue;
+		}
+
 		if (!pg_info->table ||
 		     r.va >= (pg_info->va_base + CORE_MMU_PGDIR_SIZE)) {
 			/*
@@ -1901,7 +1946,8 @@ void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 	core_mmu_set_info_table(&pg_info, dir_info->level + 1, 0, NULL);
 
 	TAILQ_FOREACH(r, &uctx->vm_info.regions, link)
-		set_pg_region(dir_info, r, &pgt, &pg_info);
+		if (vm_region_is_visible(r))
+			set_pg_region(dir_info, r, &pgt, &pg_info);
 }
 
 TEE_Result core_mmu_remove_mapping(enum teecore_memtypes type, void *addr,
@@ -2035,18 +2081,67 @@ bool core_mmu_add_mapping(enum teecore_memtypes type, paddr_t addr, size_t len)
 	return true;
 }
 
-unsigned int asid_alloc(void)
+static int asid_to_idx(unsigned int asid)
 {
-	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
-	unsigned int r;
-	int i;
+	/* Only even ASIDs are supposed to be allocated */
+	assert(asid && !(asid & 1));
+
+	return (asid - 1) / 2;
+}
+
+static unsigned int idx_to_asid(int idx)
+{
+	return (idx + 1) * 2;
+}
+
+/*
+ * Starts a new ASID generation. The TLB entries of released contexts may
+ * be left in place until here since their ASIDs aren't handed out again
+ * before the rollover. This is not what keeps the TLB coherent within a
+ * context though: core_mmu_set_user_map() still invalidates the entire
+ * TLB each time the user mapping changes, and the per-thread page tables
+ * of a concurrent TA share the ASID of the context and rely on that.
+ */
+static void asid_rollover(void)
+{
+	int i = 0;
+
+	for (i = 0; i < MMU_NUM_ASID_PAIRS; i++) {
+		if (bit_test(g_asid_pinned, i) || g_asid_users[i])
+			continue;
+		bit_clear(g_asid, i);
+		g_asid_owner[i] = NULL;
+	}
+	g_asid_rollovers++;
+
+	/* Inner shareable, takes care of all cores */
+	tlbi_all();
+}
+
+static int asid_alloc_idx(void)
+{
+	int i = 0;
 
 	bit_ffc(g_asid, MMU_NUM_ASID_PAIRS, &i);
 	if (i == -1) {
-		r = 0;
-	} else {
+		asid_rollover();
+		bit_ffc(g_asid, MMU_NUM_ASID_PAIRS, &i);
+	}
+	if (i != -1)
 		bit_set(g_asid, i);
-		r = (i + 1) * 2;
+
+	return i;
+}
+
+unsigned int asid_alloc(void)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	unsigned int r = 0;
+	int i = asid_alloc_idx();
+
+	if (i != -1) {
+		bit_set(g_asid_pinned, i);
+		r = idx_to_asid(i);
 	}
 
 	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
@@ -2057,19 +2152,78 @@ void asid_free(unsigned int asid)
 {
 	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
 
-	/* Only even ASIDs are supposed to be allocated */
-	assert(!(asid & 1));
-
 	if (asid) {
-		int i = (asid - 1) / 2;
+		int i = asid_to_idx(asid);
 
-		assert(i < MMU_NUM_ASID_PAIRS && bit_test(g_asid, i));
-		bit_clear(g_asid, i);
+		assert(i < MMU_NUM_ASID_PAIRS && bit_test(g_asid_pinned, i));
+		/* Reclaimed and invalidated by asid_rollover() */
+		bit_clear(g_asid_pinned, i);
 	}
 
 	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
 }
 
+void asid_activate(struct vm_info *vmi)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	int i = -1;
+
+	if (vmi->asid) {
+		i = asid_to_idx(vmi->asid);
+		if (g_asid_owner[i] != vmi)
+			i = -1;
+	}
+
+	if (i == -1) {
+		i = asid_alloc_idx();
+		/*
+		 * Only ASIDs in use by a thread survive a rollover, there
+		 * are more ASID pairs than threads.
+		 */
+		if (i == -1)
+			panic("Out of ASIDs");
+		g_asid_owner[i] = vmi;
+		vmi->asid = idx_to_asid(i);
+	}
+	g_asid_users[i]++;
+
+	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
+}
+
+void asid_deactivate(struct vm_info *vmi)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	int i = asid_to_idx(vmi->asid);
+
+	assert(g_asid_owner[i] == vmi && g_asid_users[i]);
+	g_asid_users[i]--;
+
+	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
+}
+
+void asid_release(struct vm_info *vmi)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	int i = 0;
+
+	if (vmi->asid) {
+		i = asid_to_idx(vmi->asid);
+		if (g_asid_owner[i] == vmi) {
+			assert(!g_asid_users[i]);
+			/* Reclaimed and invalidated by asid_rollover() */
+			g_asid_owner[i] = NULL;
+		}
+		vmi->asid = 0;
+	}
+
+	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
+}
+
+unsigned int asid_get_rollovers(void)
+{
+	return g_asid_rollovers;
+}
+
 static bool arm_va2pa_helper(void *va, paddr_t *pa)
 {
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
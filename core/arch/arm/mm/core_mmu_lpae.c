@@ -70,6 +70,7 @@
 #include <kernel/tlb_helpers.h>
 #include <mm/core_memprot.h>
 #include <mm/core_memprot.h>
+#include <mm/mobj.h>
 #include <mm/pgt_cache.h>
 #include <string.h>
 #include <trace.h>
@@ -802,6 +803,42 @@ void core_mmu_get_user_va_range(vaddr_t *base, size_t *size)
 		*size = 1 << L1_XLAT_ADDRESS_SHIFT;
 }
 
+#ifdef CFG_CORE_USER_BLOCK_MAP
+bool core_mmu_user_block_pa(struct mobj *mobj, size_t offs, size_t len,
+			    paddr_t *pa)
+{
+	size_t granule = 0;
+	paddr_t next_p = 0;
+	paddr_t p = 0;
+	size_t n = 0;
+
+	if (mobj_is_paged(mobj) || len < CORE_MMU_PGDIR_SIZE)
+		return false;
+
+	if (mobj_get_pa(mobj, offs, 0, &p) || (p & CORE_MMU_PGDIR_MASK))
+		return false;
+
+	/*
+	 * Memory made of separately allocated pages, like TA memory in
+	 * fobjs or registered shared memory, has a granule of a small page.
+	 * It can still be block mapped where the pages are physically
+	 * contiguous, so each granule covered by the block is checked. This
+	 * costs no more lookups than mapping the same range with small
+	 * pages.
+	 */
+	granule = mobj_get_phys_granule(mobj);
+	for (n = granule - offs % granule; n < CORE_MMU_PGDIR_SIZE;
+	     n += granule)
+		if (mobj_get_pa(mobj, offs + n, 0, &next_p) ||
+		    next_p != p + n)
+			return false;
+
+	if (pa)
+		*pa = p;
+	return true;
+}
+#endif
+
 bool core_mmu_user_mapping_is_active(void)
 {
 	bool ret;
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <kernel/mutex.h>
 #include <kernel/tee_misc.h>
+#include <malloc.h>
 #include <mm/core_mmu.h>
 #include <mm/pgt_cache.h>
 #include <mm/tee_pager.h>
@@ -23,10 +24,12 @@
  * so we need to keep track of how much of an allocated page is used. When
  * a page is completely unused it's returned to the pager.
  *
- * With pager disabled we have a static allocation of page tables instead.
+ * With pager disabled we have a static allocation of PGT_CACHE_SIZE page
+ * tables instead. When those are exhausted more page tables are allocated
+ * from the heap, these are freed again once enough page tables are unused.
  *
  * In all cases we limit the number of active page tables to
- * PGT_CACHE_SIZE.  This pool of page tables are shared between all
+ * PGT_CACHE_MAX_SIZE.  This pool of page tables are shared between all
  * threads. In case a thread can't allocate the needed number of pager
  * tables it will release all its current tables and wait for some more to
  * be freed. A threads allocated tables are freed each time a TA is
@@ -61,6 +64,12 @@ static struct pgt pgt_entries[PGT_CACHE_SIZE];
 static struct mutex pgt_mu = MUTEX_INITIALIZER;
 static struct condvar pgt_cv = CONDVAR_INITIALIZER;
 
+/* Protected by pgt_mu */
+static struct pgt_cache_stats pgt_stats = {
+	.num_tables = PGT_CACHE_SIZE,
+	.max_tables = PGT_CACHE_SIZE,
+};
+
 #if defined(CFG_WITH_PAGER) && defined(CFG_WITH_LPAE)
 void pgt_init(void)
 {
@@ -117,7 +126,7 @@ void pgt_init(void)
 }
 #endif
 
-#if defined(CFG_WITH_LPAE) || !defined(CFG_WITH_PAGER)
+#if defined(CFG_WITH_PAGER) && defined(CFG_WITH_LPAE)
 static struct pgt *pop_from_free_list(void)
 {
 	struct pgt *p = SLIST_FIRST(&pgt_free_list);
@@ -132,9 +141,67 @@ static struct pgt *pop_from_free_list(void)
 static void push_to_free_list(struct pgt *p)
 {
 	SLIST_INSERT_HEAD(&pgt_free_list, p, link);
-#if defined(CFG_WITH_PAGER)
 	tee_pager_release_phys(p->tbl, PGT_SIZE);
-#endif
+}
+#elif !defined(CFG_WITH_PAGER)
+/* Number of page tables in pgt_free_list */
+static size_t pgt_num_free = PGT_CACHE_SIZE;
+
+static struct pgt *alloc_dynamic_pgt(void)
+{
+	struct pgt *p = NULL;
+
+	if (pgt_stats.num_tables >= PGT_CACHE_MAX_SIZE)
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	p->tbl = memalign(PGT_SIZE, PGT_SIZE);
+	if (!p->tbl) {
+		free(p);
+		return NULL;
+	}
+	p->dynamic = true;
+
+	pgt_stats.num_tables++;
+	if (pgt_stats.num_tables > pgt_stats.max_tables)
+		pgt_stats.max_tables = pgt_stats.num_tables;
+
+	return p;
+}
+
+static struct pgt *pop_from_free_list(void)
+{
+	struct pgt *p = SLIST_FIRST(&pgt_free_list);
+
+	if (p) {
+		SLIST_REMOVE_HEAD(&pgt_free_list, link);
+		pgt_num_free--;
+	} else {
+		p = alloc_dynamic_pgt();
+		if (!p)
+			return NULL;
+	}
+	memset(p->tbl, 0, PGT_SIZE);
+	return p;
+}
+
+static void push_to_free_list(struct pgt *p)
+{
+	/*
+	 * Keep some slack in the free list to avoid freeing and
+	 * allocating page tables each time a thread switches context.
+	 */
+	if (p->dynamic && pgt_num_free >= PGT_CACHE_SIZE / 2) {
+		free(p->tbl);
+		free(p);
+		pgt_stats.num_tables--;
+		return;
+	}
+
+	SLIST_INSERT_HEAD(&pgt_free_list, p, link);
+	pgt_num_free++;
 }
 #else
 static struct pgt *pop_from_free_list(void)
@@ -204,27 +271,31 @@ static struct pgt *pop_from_cache_list(vaddr_t vabase, void *ctx)
 	return p;
 }
 
-static struct pgt *pop_least_used_from_cache_list(void)
+/*
+ * Tables are pushed at the head of pgt_cache_list so the tail holds the
+ * least recently used table. A table without used entries is taken
+ * directly since it doesn't hold anything worth keeping.
+ */
+static struct pgt *pop_lru_from_cache_list(void)
 {
-	struct pgt *pgt;
 	struct pgt *p_prev = NULL;
-	size_t least_used;
+	struct pgt *pgt = NULL;
+	struct pgt *p = NULL;
 
 	pgt = SLIST_FIRST(&pgt_cache_list);
 	if (!pgt)
 		return NULL;
 	if (!pgt->num_used_entries)
 		goto out;
-	least_used = pgt->num_used_entries;
 
 	while (true) {
-		if (!SLIST_NEXT(pgt, link))
+		p = SLIST_NEXT(pgt, link);
+		if (!p)
 			break;
-		if (SLIST_NEXT(pgt, link)->num_used_entries <= least_used) {
-			p_prev = pgt;
-			least_used = SLIST_NEXT(pgt, link)->num_used_entries;
-		}
-		pgt = SLIST_NEXT(pgt, link);
+		p_prev = pgt;
+		if (!p->num_used_entries)
+			break;
+		pgt = p;
 	}
 
 out:
@@ -261,13 +332,16 @@ static struct pgt *pop_from_some_list(vaddr_t vabase, void *ctx)
 {
 	struct pgt *p = pop_from_cache_list(vabase, ctx);
 
-	if (p)
+	if (p) {
+		pgt_stats.hits++;
 		return p;
+	}
 	p = pop_from_free_list();
 	if (!p) {
-		p = pop_least_used_from_cache_list();
+		p = pop_lru_from_cache_list();
 		if (!p)
 			return NULL;
+		pgt_stats.evictions++;
 		tee_pager_pgt_save_and_release_entries(p);
 		memset(p->tbl, 0, PGT_SIZE);
 	}
@@ -487,6 +561,7 @@ static bool pgt_alloc_unlocked(struct pgt_cache *pgt_cache, struct ts_ctx *ctx,
 			pgt_free_unlocked(pgt_cache, ctx);
 			return false;
 		}
+		pgt_stats.allocs++;
 
 		if (pp)
 			SLIST_INSERT_AFTER(pp, p, link);
@@ -510,6 +585,7 @@ void pgt_alloc(struct pgt_cache *pgt_cache, struct ts_ctx *ctx,
 	pgt_free_unlocked(pgt_cache, ctx);
 	while (!pgt_alloc_unlocked(pgt_cache, ctx, begin, last)) {
 		DMSG("Waiting for page tables");
+		pgt_stats.waits++;
 		condvar_broadcast(&pgt_cv);
 		condvar_wait(&pgt_cv, &pgt_mu);
 	}
@@ -529,3 +605,16 @@ void pgt_free(struct pgt_cache *pgt_cache, bool save_ctx)
 	condvar_broadcast(&pgt_cv);
 	mutex_unlock(&pgt_mu);
 }
+
+void pgt_get_stats(struct pgt_cache_stats *stats)
+{
+	mutex_lock(&pgt_mu);
+
+	*stats = pgt_stats;
+	pgt_stats.allocs = 0;
+	pgt_stats.hits = 0;
+	pgt_stats.evictions = 0;
+	pgt_stats.waits = 0;
+
+	mutex_unlock(&pgt_mu);
+}
@@ -6,6 +6,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <config.h>
 #include <io.h>
 #include <keep.h>
 #include <kernel/abort.h>
@@ -74,6 +75,7 @@ static size_t tee_pager_npages;
 
 #ifdef CFG_WITH_STATS
 static struct tee_pager_stats pager_stats;
+static uint64_t pager_save_ticks;
 
 static inline void incr_ro_hits(void)
 {
@@ -100,6 +102,31 @@ static inline void incr_npages_all(void)
 	pager_stats.npages_all++;
 }
 
+static inline void incr_faults(void)
+{
+	pager_stats.faults++;
+}
+
+static inline void incr_readahead_pages(void)
+{
+	pager_stats.readahead_pages++;
+}
+
+static inline void incr_readahead_hits(size_t num_pages)
+{
+	pager_stats.readahead_hits += num_pages;
+}
+
+static inline uint64_t save_timestamp(void)
+{
+	return barrier_read_cntpct();
+}
+
+static inline void incr_save_ticks(uint64_t start)
+{
+	pager_save_ticks += barrier_read_cntpct() - start;
+}
+
 static inline void set_npages(void)
 {
 	pager_stats.npages = tee_pager_npages;
@@ -107,12 +134,26 @@ static inline void set_npages(void)
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
+	struct fobj_rwp_stats rwp_stats = { };
+
+	fobj_rwp_get_stats(&rwp_stats);
 	*stats = pager_stats;
+	stats->rw_saved = rwp_stats.saved;
+	stats->rw_same_filled = rwp_stats.same_filled;
+	stats->save_us = (pager_save_ticks * 1000000) / read_cntfrq();
+	if (IS_ENABLED(CFG_PAGER_CLOCK))
+		stats->policy = TEE_PAGER_POLICY_CLOCK;
+	else
+		stats->policy = TEE_PAGER_POLICY_HIDE;
 
 	pager_stats.hidden_hits = 0;
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.faults = 0;
+	pager_stats.readahead_pages = 0;
+	pager_stats.readahead_hits = 0;
+	pager_save_ticks = 0;
 }
 
 #else /* CFG_WITH_STATS */
@@ -121,6 +162,11 @@ static inline void incr_rw_hits(void) { }
 static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
 static inline void incr_npages_all(void) { }
+static inline void incr_faults(void) { }
+static inline void incr_readahead_pages(void) { }
+static inline void incr_readahead_hits(size_t num_pages __unused) { }
+static inline uint64_t save_timestamp(void) { return 0; }
+static inline void incr_save_ticks(uint64_t start __unused) { }
 static inline void set_npages(void) { }
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
@@ -688,6 +734,68 @@ static void tee_pager_save_page(struct tee_pager_pmem *pmem)
 	}
 }
 
+#if CFG_PAGER_WRITEBACK_BATCH > 1
+/*
+ * Saves @pmem together with the hidden dirty pages closest to the head of
+ * tee_pager_pmem_head, those are likely to be evicted soon. Hidden pages
+ * aren't mapped so they're marked clean once saved, they will be mapped
+ * read-only when unhidden and can be reused later without being saved
+ * again.
+ */
+static void tee_pager_save_pages(struct tee_pager_pmem *pmem)
+{
+	struct tee_pager_pmem *batch[CFG_PAGER_WRITEBACK_BATCH] = { };
+	struct fobj_page pages[CFG_PAGER_WRITEBACK_BATCH] = { };
+	struct tee_pager_pmem *p = NULL;
+	size_t num_pages = 0;
+	size_t n = 0;
+
+	if (!pmem_is_dirty(pmem))
+		return;
+
+	batch[num_pages++] = pmem;
+	TAILQ_FOREACH(p, &tee_pager_pmem_head, link) {
+		if (n >= TEE_PAGER_NHIDE ||
+		    num_pages >= CFG_PAGER_WRITEBACK_BATCH)
+			break;
+		n++;
+
+		if (p != pmem && p->fobj && pmem_is_hidden(p) &&
+		    pmem_is_dirty(p))
+			batch[num_pages++] = p;
+	}
+
+	if (num_pages == 1) {
+		tee_pager_save_page(pmem);
+		return;
+	}
+
+	for (n = 0; n < num_pages; n++) {
+		p = batch[n];
+		pages[n].fobj = p->fobj;
+		pages[n].page_idx = p->fobj_pgidx;
+		pages[n].va = p->va_alias;
+		asan_tag_access(p->va_alias,
+				(uint8_t *)p->va_alias + SMALL_PAGE_SIZE);
+	}
+
+	if (fobj_save_pages(pages, num_pages))
+		panic("fobj_save_pages");
+
+	for (n = 0; n < num_pages; n++) {
+		p = batch[n];
+		p->flags &= ~PMEM_FLAG_DIRTY;
+		asan_tag_no_access(p->va_alias,
+				   (uint8_t *)p->va_alias + SMALL_PAGE_SIZE);
+	}
+}
+#else
+static void tee_pager_save_pages(struct tee_pager_pmem *pmem)
+{
+	tee_pager_save_page(pmem);
+}
+#endif
+
 #ifdef CFG_PAGED_USER_TA
 static void unlink_area(struct tee_pager_area_head *area_head,
 			struct tee_pager_area *area)
@@ -1213,7 +1321,7 @@ static bool tee_pager_unhide_page(struct tee_pager_area *area,
 	return true;
 }
 
-static void tee_pager_hide_pages(void)
+static void __maybe_unused tee_pager_hide_pages(void)
 {
 	struct tee_pager_pmem *pmem = NULL;
 	size_t n = 0;
@@ -1287,12 +1395,78 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 	return false;
 }
 
-/* Finds the oldest page and unmaps it from all tables */
+/*
+ * struct pager_policy - page replacement policy
+ * @get_victim:	Returns the page in tee_pager_pmem_head to be reused next
+ * @fault_done:	Called at the end of each handled fault, may be NULL
+ *
+ * Both policies below use hidden pages to tell which pages are in use.
+ * A hidden page is unmapped but keeps its content, an access to it is
+ * handled by tee_pager_unhide_page() which maps it again and moves it to
+ * the tail of tee_pager_pmem_head.
+ */
+struct pager_policy {
+	struct tee_pager_pmem *(*get_victim)(void);
+	void (*fault_done)(void);
+};
+
+#ifdef CFG_PAGER_CLOCK
+/*
+ * CLOCK, or second chance. The head of tee_pager_pmem_head is the clock
+ * hand. A page which isn't hidden has been used since the hand passed
+ * it, it's hidden and moved to the tail. The first hidden (or unused)
+ * page found is reused.
+ *
+ * In contrast with tee_pager_hide_pages() pages are only hidden when a
+ * page is needed, so a fault on a page which is already available
+ * doesn't cause more pages to be hidden.
+ */
+static struct tee_pager_pmem *clock_get_victim(void)
+{
+	struct tee_pager_pmem *pmem = NULL;
+	size_t n = 0;
+
+	for (n = 0; n < tee_pager_npages; n++) {
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (!pmem || !pmem->fobj || pmem_is_hidden(pmem))
+			return pmem;
+
+		pmem->flags |= PMEM_FLAG_HIDDEN;
+		pmem_unmap(pmem, NULL);
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	}
+
+	/* All pages were in use, the oldest is now at the head */
+	return TAILQ_FIRST(&tee_pager_pmem_head);
+}
+
+static const struct pager_policy pager_policy = {
+	.get_victim = clock_get_victim,
+};
+#else
+/*
+ * The oldest page is reused. A third of the pages, the oldest, are
+ * hidden after each fault.
+ */
+static struct tee_pager_pmem *hide_get_victim(void)
+{
+	return TAILQ_FIRST(&tee_pager_pmem_head);
+}
+
+static const struct pager_policy pager_policy = {
+	.get_victim = hide_get_victim,
+	.fault_done = tee_pager_hide_pages,
+};
+#endif
+
+/* Finds the page to reuse and unmaps it from all tables */
 static struct tee_pager_pmem *tee_pager_get_page(enum tee_pager_area_type at)
 {
 	struct tee_pager_pmem *pmem;
+	uint64_t t = 0;
 
-	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+	pmem = pager_policy.get_victim();
 	if (!pmem) {
 		EMSG("No pmem entries");
 		return NULL;
@@ -1300,7 +1474,9 @@ static struct tee_pager_pmem *tee_pager_get_page(enum tee_pager_area_type at)
 
 	if (pmem->fobj) {
 		pmem_unmap(pmem, NULL);
-		tee_pager_save_page(pmem);
+		t = save_timestamp();
+		tee_pager_save_pages(pmem);
+		incr_save_ticks(t);
 	}
 
 	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
@@ -1410,6 +1586,147 @@ static bool pager_update_permissions(struct tee_pager_area *area,
 	return true;
 }
 
+/*
+ * Loads the page at @page_va of @area into @pmem and maps it. @pmem is
+ * supplied by tee_pager_get_page().
+ */
+static void pager_load_and_map(struct tee_pager_area *area, vaddr_t page_va,
+			       struct tee_pager_pmem *pmem,
+			       bool clean_user_cache)
+{
+	uint32_t attr = 0;
+	paddr_t pa = 0;
+	size_t tblidx = 0;
+
+	/* load page code & data */
+	tee_pager_load_page(area, page_va, pmem->va_alias);
+
+	pmem->fobj = area->fobj;
+	pmem->fobj_pgidx = area_va2idx(area, page_va) +
+			   area->fobj_pgoffs -
+			   ((area->base & CORE_MMU_PGDIR_MASK) >>
+				SMALL_PAGE_SHIFT);
+	tblidx = pmem_get_area_tblidx(pmem, area);
+	attr = get_area_mattr(area->flags);
+	/*
+	 * Pages from PAGER_AREA_TYPE_RW starts read-only to be
+	 * able to tell when they are updated and should be tagged
+	 * as dirty.
+	 */
+	if (area->type == PAGER_AREA_TYPE_RW)
+		attr &= ~(TEE_MATTR_PW | TEE_MATTR_UW);
+	pa = get_pmem_pa(pmem);
+
+	/*
+	 * We've updated the page using the aliased mapping and
+	 * some cache maintenence is now needed if it's an
+	 * executable page.
+	 *
+	 * Since the d-cache is a Physically-indexed,
+	 * physically-tagged (PIPT) cache we can clean either the
+	 * aliased address or the real virtual address. In this
+	 * case we choose the real virtual address.
+	 *
+	 * The i-cache can also be PIPT, but may be something else
+	 * too like VIPT. The current code requires the caches to
+	 * implement the IVIPT extension, that is:
+	 * "instruction cache maintenance is required only after
+	 * writing new data to a physical address that holds an
+	 * instruction."
+	 *
+	 * To portably invalidate the icache the page has to
+	 * be mapped at the final virtual address but not
+	 * executable.
+	 */
+	if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
+		uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
+				TEE_MATTR_PW | TEE_MATTR_UW;
+		void *va = (void *)page_va;
+
+		/* Set a temporary read-only mapping */
+		area_set_entry(area, tblidx, pa, attr & ~mask);
+		area_tlbi_entry(area, tblidx);
+
+		dcache_clean_range_pou(va, SMALL_PAGE_SIZE);
+		if (clean_user_cache)
+			icache_inv_user_range(va, SMALL_PAGE_SIZE);
+		else
+			icache_inv_range(va, SMALL_PAGE_SIZE);
+
+		/* Set the final mapping */
+		area_set_entry(area, tblidx, pa, attr);
+		area_tlbi_entry(area, tblidx);
+	} else {
+		area_set_entry(area, tblidx, pa, attr);
+		/*
+		 * No need to flush TLB for this entry, it was
+		 * invalid. We should use a barrier though, to make
+		 * sure that the change is visible.
+		 */
+		dsb_ishst();
+	}
+	pgt_inc_used_entries(area->pgt);
+
+	FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+}
+
+/*
+ * Fault-around for read-only areas. When a fault follows directly after
+ * the previous one in the same area, or after the pages read ahead at
+ * that fault, the access pattern is considered sequential and the
+ * following pages are loaded too. The number of pages read ahead is
+ * doubled for each sequential fault, up to CFG_PAGER_FAULT_AROUND, and
+ * reset by a fault elsewhere. Only unused physical pages are used for
+ * this, no page is evicted to make room for a page read ahead.
+ */
+static void fault_around(struct tee_pager_area *area, vaddr_t page_va,
+			 bool clean_user_cache)
+{
+	size_t tblidx = area_va2idx(area, page_va);
+	struct tee_pager_pmem *pmem = NULL;
+	size_t num_pages = 0;
+	vaddr_t va = page_va;
+	size_t n = 0;
+
+	if (!CFG_PAGER_FAULT_AROUND || area->type != PAGER_AREA_TYPE_RO)
+		return;
+
+	if (tblidx == area->ra_next) {
+		/* The pages read ahead last time were all passed */
+		incr_readahead_hits(area->ra_pages);
+		if (area->ra_pages)
+			num_pages = MIN(area->ra_pages * 2,
+					(size_t)CFG_PAGER_FAULT_AROUND);
+		else
+			num_pages = 1;
+	}
+
+	for (n = 0; n < num_pages; n++) {
+		uint32_t attr = 0;
+
+		va += SMALL_PAGE_SIZE;
+		if (va >= area->base + area->size)
+			break;
+
+		/* Stop at a page which is already available */
+		area_get_entry(area, tblidx + n + 1, NULL, &attr);
+		if ((attr & TEE_MATTR_VALID_BLOCK) ||
+		    pmem_find(area, tblidx + n + 1))
+			break;
+
+		pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+		if (!pmem || pmem->fobj)
+			break;
+
+		pmem = tee_pager_get_page(area->type);
+		pager_load_and_map(area, va, pmem, clean_user_cache);
+		incr_readahead_pages();
+	}
+
+	area->ra_pages = n;
+	area->ra_next = tblidx + n + 1;
+}
+
 #ifdef CFG_TEE_CORE_DEBUG
 static void stat_handle_fault(void)
 {
@@ -1461,6 +1778,7 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 	exceptions = pager_lock(ai);
 
 	stat_handle_fault();
+	incr_faults();
 
 	/* check if the access is valid */
 	if (abort_is_user_exception(ai)) {
@@ -1480,9 +1798,6 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 
 	if (!tee_pager_unhide_page(area, area_va2idx(area, page_va))) {
 		struct tee_pager_pmem *pmem = NULL;
-		uint32_t attr = 0;
-		paddr_t pa = 0;
-		size_t tblidx = 0;
 
 		/*
 		 * The page wasn't hidden, but some other core may have
@@ -1504,81 +1819,13 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 			panic();
 		}
 
-		/* load page code & data */
-		tee_pager_load_page(area, page_va, pmem->va_alias);
-
-
-		pmem->fobj = area->fobj;
-		pmem->fobj_pgidx = area_va2idx(area, page_va) +
-				   area->fobj_pgoffs -
-				   ((area->base & CORE_MMU_PGDIR_MASK) >>
-					SMALL_PAGE_SHIFT);
-		tblidx = pmem_get_area_tblidx(pmem, area);
-		attr = get_area_mattr(area->flags);
-		/*
-		 * Pages from PAGER_AREA_TYPE_RW starts read-only to be
-		 * able to tell when they are updated and should be tagged
-		 * as dirty.
-		 */
-		if (area->type == PAGER_AREA_TYPE_RW)
-			attr &= ~(TEE_MATTR_PW | TEE_MATTR_UW);
-		pa = get_pmem_pa(pmem);
-
-		/*
-		 * We've updated the page using the aliased mapping and
-		 * some cache maintenence is now needed if it's an
-		 * executable page.
-		 *
-		 * Since the d-cache is a Physically-indexed,
-		 * physically-tagged (PIPT) cache we can clean either the
-		 * aliased address or the real virtual address. In this
-		 * case we choose the real virtual address.
-		 *
-		 * The i-cache can also be PIPT, but may be something else
-		 * too like VIPT. The current code requires the caches to
-		 * implement the IVIPT extension, that is:
-		 * "instruction cache maintenance is required only after
-		 * writing new data to a physical address that holds an
-		 * instruction."
-		 *
-		 * To portably invalidate the icache the page has to
-		 * be mapped at the final virtual address but not
-		 * executable.
-		 */
-		if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
-			uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
-					TEE_MATTR_PW | TEE_MATTR_UW;
-			void *va = (void *)page_va;
-
-			/* Set a temporary read-only mapping */
-			area_set_entry(area, tblidx, pa, attr & ~mask);
-			area_tlbi_entry(area, tblidx);
-
-			dcache_clean_range_pou(va, SMALL_PAGE_SIZE);
-			if (clean_user_cache)
-				icache_inv_user_range(va, SMALL_PAGE_SIZE);
-			else
-				icache_inv_range(va, SMALL_PAGE_SIZE);
-
-			/* Set the final mapping */
-			area_set_entry(area, tblidx, pa, attr);
-			area_tlbi_entry(area, tblidx);
-		} else {
-			area_set_entry(area, tblidx, pa, attr);
-			/*
-			 * No need to flush TLB for this entry, it was
-			 * invalid. We should use a barrier though, to make
-			 * sure that the change is visible.
-			 */
-			dsb_ishst();
-		}
-		pgt_inc_used_entries(area->pgt);
-
-		FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+		pager_load_and_map(area, page_va, pmem, clean_user_cache);
+		fault_around(area, page_va, clean_user_cache);
 
 	}
 
-	tee_pager_hide_pages();
+	if (pager_policy.fault_done)
+		pager_policy.fault_done();
 	ret = true;
 out:
 	pager_unlock(exceptions);
@@ -121,6 +121,9 @@ static const struct syscall_entry tee_svc_syscall_table[] = {
 	SYSCALL_ENTRY(syscall_not_supported),
 	SYSCALL_ENTRY(syscall_not_supported),
 	SYSCALL_ENTRY(syscall_cache_operation),
+	SYSCALL_ENTRY(syscall_cipher_update_many),
+	SYSCALL_ENTRY(syscall_futex_wait),
+	SYSCALL_ENTRY(syscall_futex_wake),
 };
 
 /*
@@ -267,6 +270,8 @@ bool user_ta_handle_svc(struct thread_svc_regs *regs)
 	ftrace_syscall_enter(scn);
 
 	set_svc_retval(regs, tee_svc_do_call(regs, scf));
+	/* Objects and states used by the syscall of a concurrent TA */
+	user_ta_release_claims(to_user_ta_ctx(ts_get_current_session()->ctx));
 
 	ftrace_syscall_leave();
 
@@ -66,8 +66,14 @@ static void ghash_update_lengths(struct internal_aes_gcm_state *state,
 	internal_aes_gcm_ghash_update(state, (uint8_t *)len_fields, NULL, 0);
 }
 
+/*
+ * If @gk is supplied it must have been derived from @ek with
+ * internal_aes_gcm_set_key() earlier, it's then copied instead of being
+ * derived again.
+ */
 static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
 			     const struct internal_aes_gcm_key *ek,
+			     const struct internal_ghash_key *gk,
 			     TEE_OperationMode mode, const void *nonce,
 			     size_t nonce_len, size_t tag_len)
 {
@@ -79,7 +85,10 @@ static TEE_Result __gcm_init(struct internal_aes_gcm_state *state,
 	memset(state, 0, sizeof(*state));
 
 	state->tag_len = tag_len;
-	internal_aes_gcm_set_key(state, ek);
+	if (gk)
+		state->ghash_key = *gk;
+	else
+		internal_aes_gcm_set_key(state, ek);
 
 	if (nonce_len == (96 / 8)) {
 		memcpy(state->ctr, nonce, nonce_len);
@@ -134,7 +143,8 @@ TEE_Result internal_aes_gcm_init(struct internal_aes_gcm_ctx *ctx,
 	if (res)
 		return res;
 
-	return __gcm_init(&ctx->state, ek, mode, nonce, nonce_len, tag_len);
+	return __gcm_init(&ctx->state, ek, NULL, mode, nonce, nonce_len,
+			  tag_len);
 }
 
 static TEE_Result __gcm_update_aad(struct internal_aes_gcm_state *state,
@@ -376,8 +386,8 @@ TEE_Result internal_aes_gcm_enc(const struct internal_aes_gcm_key *enc_key,
 	TEE_Result res;
 	struct internal_aes_gcm_state state;
 
-	res = __gcm_init(&state, enc_key, TEE_MODE_ENCRYPT, nonce, nonce_len,
-			 *tag_len);
+	res = __gcm_init(&state, enc_key, NULL, TEE_MODE_ENCRYPT, nonce,
+			 nonce_len, *tag_len);
 	if (res)
 		return res;
 
@@ -399,8 +409,8 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 	TEE_Result res;
 	struct internal_aes_gcm_state state;
 
-	res = __gcm_init(&state, enc_key, TEE_MODE_DECRYPT, nonce, nonce_len,
-			 tag_len);
+	res = __gcm_init(&state, enc_key, NULL, TEE_MODE_DECRYPT, nonce,
+			 nonce_len, tag_len);
 	if (res)
 		return res;
 
@@ -413,6 +423,40 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 	return __gcm_dec_final(&state, enc_key, src, len, dst, tag, tag_len);
 }
 
+TEE_Result internal_aes_gcm_enc_batch(const struct internal_aes_gcm_key *ek,
+				      size_t nonce_len, size_t len,
+				      size_t tag_len,
+				      struct internal_aes_gcm_msg *msgs,
+				      size_t num_msgs)
+{
+	struct internal_aes_gcm_state state = { };
+	struct internal_ghash_key gk = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t tl = 0;
+	size_t n = 0;
+
+	for (n = 0; n < num_msgs; n++) {
+		/*
+		 * The GHASH key only depends on the AES key, derive it
+		 * once for the first message and reuse it for the rest.
+		 */
+		res = __gcm_init(&state, ek, n ? &gk : NULL, TEE_MODE_ENCRYPT,
+				 msgs[n].nonce, nonce_len, tag_len);
+		if (res)
+			return res;
+		if (!n)
+			gk = state.ghash_key;
+
+		tl = tag_len;
+		res = __gcm_enc_final(&state, ek, msgs[n].src, len,
+				      msgs[n].dst, msgs[n].tag, &tl);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 
 #ifndef CFG_CRYPTO_AES_GCM_FROM_CRYPTOLIB
 #include <stdlib.h>
@@ -84,6 +84,31 @@ TEE_Result internal_aes_gcm_dec(const struct internal_aes_gcm_key *enc_key,
 				const void *src, size_t len, void *dst,
 				const void *tag, size_t tag_len);
 
+/*
+ * struct internal_aes_gcm_msg - one message in a batch
+ * @nonce:	Nonce, the length is common for the batch
+ * @src:	Plain text, the length is common for the batch
+ * @dst:	Cipher text, same length as @src
+ * @tag:	Tag, the length is common for the batch
+ */
+struct internal_aes_gcm_msg {
+	const void *nonce;
+	const void *src;
+	void *dst;
+	void *tag;
+};
+
+/*
+ * Encrypts a batch of equally sized messages without AAD using the same
+ * key. This is faster than calling internal_aes_gcm_enc() for each
+ * message since the GHASH key is only derived once.
+ */
+TEE_Result internal_aes_gcm_enc_batch(const struct internal_aes_gcm_key *ek,
+				      size_t nonce_len, size_t len,
+				      size_t tag_len,
+				      struct internal_aes_gcm_msg *msgs,
+				      size_t num_msgs);
+
 void internal_aes_gcm_gfmul(const uint64_t X[2], const uint64_t Y[2],
 			    uint64_t product[2]);
 
@@ -9,12 +9,24 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * struct handle_db - database of handles
+ * @ptrs:	Array of pointers indexed by handle, unused locations are
+ *		linked in a list of free locations
+ * @max_ptrs:	Number of locations in @ptrs
+ * @num_used:	Number of used locations in @ptrs
+ * @free_head:	Index + 1 of the first free location, 0 if there's none
+ *
+ * Allocating, releasing and looking up a handle are all O(1) operations.
+ */
 struct handle_db {
 	void **ptrs;
 	size_t max_ptrs;
+	size_t num_used;
+	size_t free_head;
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, 0, 0, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -24,12 +36,12 @@ struct handle_db {
  */
 void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr));
 
-/* Checks if the associated pointers of all handles in the database are NULL. */
+/* Checks if there are no allocated handles in the database. */
 bool handle_db_is_empty(struct handle_db *db);
 
 /*
  * Allocates a new handle and assigns the supplied pointer to it,
- * ptr must not be NULL.
+ * ptr must not be NULL and must be at least 2 byte aligned.
  * The function returns
  * >= 0 on success and
  * -1 on failure
@@ -38,7 +50,8 @@ int handle_get(struct handle_db *db, void *ptr);
 
 /*
  * Deallocates a handle. Returns the assiciated pointer of the handle
- * if the handle was valid or NULL if it's invalid.
+ * if the handle was valid or NULL if it's invalid. The database may be
+ * shrunk when enough handles have been deallocated.
  */
 void *handle_put(struct handle_db *db, int handle);
 
@@ -49,4 +62,24 @@ void *handle_put(struct handle_db *db, int handle);
  */
 void *handle_lookup(struct handle_db *db, int handle);
 
+/*
+ * A tagged handle combines a handle with a generation count in the upper
+ * bits, this allows detecting a stale tagged handle even if the handle
+ * itself has been reused. The handle is stored with an offset of one so
+ * a tagged handle is never 0.
+ */
+#define HANDLE_TAG_HANDLE_BITS	16
+#define HANDLE_TAG_MAX_HANDLE	((1 << HANDLE_TAG_HANDLE_BITS) - 2)
+
+static inline uint32_t handle_tag(int handle, uint32_t gen)
+{
+	return (gen << HANDLE_TAG_HANDLE_BITS) | (uint32_t)(handle + 1);
+}
+
+/* Returns the handle of a tagged handle, -1 if it can't be a valid handle */
+static inline int handle_untag(uint32_t tagged)
+{
+	return (int)(tagged & ((1 << HANDLE_TAG_HANDLE_BITS) - 1)) - 1;
+}
+
 #endif /*KERNEL_HANDLE_H*/
@@ -75,6 +75,7 @@ struct tee_ta_ctx {
 	bool busy;		/* Context is busy and cannot be entered */
 	bool initializing;	/* Context is initializing */
 	struct condvar busy_cv;	/* CV used when context is busy */
+	size_t num_active;	/* Threads executing in a concurrent user TA */
 };
 
 struct tee_ta_session {
@@ -6,6 +6,7 @@
 #ifndef __KERNEL_TS_STORE_H
 #define __KERNEL_TS_STORE_H
 
+#include <string.h>
 #include <tee_api_types.h>
 
 struct ts_store_handle;
@@ -81,4 +82,40 @@ struct ts_store_ops {
 	int __tee_sp_store_##prio __unused; \
 	SCATTERED_ARRAY_DEFINE_PG_ITEM_ORDERED(sp_stores, prio, \
 					       struct ts_store_ops)
+
+/*
+ * struct ree_fs_ta_cache_stats - statistics of the verified TA cache
+ * @hits:	number of TA loads served from the cache
+ * @misses:	number of TA loads that needed normal world
+ * @entries:	number of TAs currently cached
+ */
+struct ree_fs_ta_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t entries;
+};
+
+#if defined(CFG_REE_FS_TA_BUFFERED) && CFG_REE_FS_TA_CACHE_ENTRIES
+void ree_fs_ta_get_cache_stats(struct ree_fs_ta_cache_stats *stats);
+
+/*
+ * ree_fs_ta_cache_shrink() - free the cached TA binaries not in use
+ *
+ * Called when an allocation from the "Secure DDR" pool has failed.
+ * Returns true if memory was released and the allocation may be retried.
+ */
+bool ree_fs_ta_cache_shrink(void);
+#else
+static inline void
+ree_fs_ta_get_cache_stats(struct ree_fs_ta_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+static inline bool ree_fs_ta_cache_shrink(void)
+{
+	return false;
+}
+#endif
+
 #endif /*__KERNEL_TS_STORE_H*/
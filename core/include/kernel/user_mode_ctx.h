@@ -11,6 +11,7 @@
 #include <kernel/user_mode_ctx_struct.h>
 #include <kernel/user_ta.h>
 #include <stdbool.h>
+#include <tee_api_types.h>
 
 static inline bool is_user_mode_ctx(struct ts_ctx *ctx)
 {
@@ -27,4 +28,83 @@ static inline struct user_mode_ctx *to_user_mode_ctx(struct ts_ctx *ctx)
 
 void user_mode_ctx_print_mappings(struct user_mode_ctx *umctx);
 
+/*
+ * user_mode_ctx_init_concurrent() - Let several threads execute in a context
+ * @uctx:	User mode context
+ *
+ * Must be called before the context is entered the first time.
+ */
+void user_mode_ctx_init_concurrent(struct user_mode_ctx *uctx);
+
+/*
+ * user_mode_ctx_free_threads() - Free the thread entries of a context
+ * @uctx:	User mode context
+ *
+ * The stacks of the threads are unmapped with the rest of @uctx->vm_info.
+ */
+void user_mode_ctx_free_threads(struct user_mode_ctx *uctx);
+
+/*
+ * user_mode_ctx_lock() - Lock the memory map and handles of a context
+ * @uctx:	User mode context
+ *
+ * Only needed for concurrent contexts, does nothing for others. The lock
+ * is recursive and may be taken again by the thread holding it. Memory
+ * found accessible with the lock held stays mapped after it's released
+ * as long as the current thread executes in @uctx, since other threads
+ * only unmap their own parameters meanwhile.
+ */
+static inline void user_mode_ctx_lock(struct user_mode_ctx *uctx)
+{
+	if (uctx->concurrent)
+		mutex_lock_recursive(&uctx->mu);
+}
+
+static inline void user_mode_ctx_unlock(struct user_mode_ctx *uctx)
+{
+	if (uctx->concurrent)
+		mutex_unlock_recursive(&uctx->mu);
+}
+
+/*
+ * user_mode_ctx_lock_exclusive() - Lock a context executed by one thread only
+ * @uctx:	User mode context
+ *
+ * Used before changes of the memory map which other threads executing in
+ * the context couldn't cope with, such as unmapping or loading libraries.
+ * Returns TEE_ERROR_BUSY without holding the lock if other threads are
+ * executing in @uctx, else TEE_SUCCESS with the lock held. Release with
+ * user_mode_ctx_unlock().
+ */
+TEE_Result user_mode_ctx_lock_exclusive(struct user_mode_ctx *uctx);
+
+/*
+ * user_mode_ctx_enter_thread() - Reserve a stack for the current thread
+ * @uctx:	User mode context
+ * @stack_ptr:	Returned initial stack pointer
+ *
+ * Contexts that aren't concurrent always use @uctx->stack_ptr. Returns
+ * TEE_ERROR_BUSY if the current thread is already executing in a
+ * concurrent context.
+ */
+TEE_Result user_mode_ctx_enter_thread(struct user_mode_ctx *uctx,
+				      vaddr_t *stack_ptr);
+
+/*
+ * user_mode_ctx_exit_thread() - Release the stack of the current thread
+ * @uctx:	User mode context
+ *
+ * Undoes a successful user_mode_ctx_enter_thread().
+ */
+void user_mode_ctx_exit_thread(struct user_mode_ctx *uctx);
+
+#if defined(CFG_WITH_VFP)
+/*
+ * user_mode_ctx_get_vfp() - Get the user VFP state of the current thread
+ * @uctx:	User mode context
+ */
+struct thread_user_vfp_state *
+user_mode_ctx_get_vfp(struct user_mode_ctx *uctx);
+#endif
+
 #endif /*__KERNEL_USER_MODE_CTX_H*/
@@ -7,10 +7,26 @@
 #ifndef __KERNEL_USER_MODE_CTX_STRUCT_H
 #define __KERNEL_USER_MODE_CTX_STRUCT_H
 
+#include <kernel/mutex.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <mm/tee_mmu_types.h>
 
+/*
+ * struct user_mode_thread - additional thread executing in a concurrent
+ * user mode context
+ * @vfp:		State of VFP registers
+ * @stack_ptr:		Stack pointer
+ * @thread_id:		Thread using this entry or THREAD_ID_INVALID
+ */
+struct user_mode_thread {
+#if defined(CFG_WITH_VFP)
+	struct thread_user_vfp_state vfp;
+#endif
+	vaddr_t stack_ptr;
+	short int thread_id;
+};
+
 /*
  * struct user_mode_ctx - user mode context
  * @vm_info:		Virtual memory map of this context
@@ -27,6 +43,15 @@
  * @is_32bit:		True if 32-bit TS, false if 64-bit TS
  * @is_initializing:	True if TS is not fully loaded
  * @stack_ptr:		Stack pointer
+ * @concurrent:		True if several threads may execute in this context
+ * @thread_id:		Thread using @stack_ptr and @vfp if @concurrent
+ * @num_threads:	Number of threads executing in this context if
+ *			@concurrent
+ * @threads:		Additional threads of a concurrent context, allocated
+ *			on demand
+ * @mu:			Protects @vm_info and the handles of the user TA if
+ *			@concurrent, only held while they're looked up or
+ *			updated
  */
 struct user_mode_ctx {
 	struct vm_info vm_info;
@@ -45,6 +70,11 @@ struct user_mode_ctx {
 	bool is_32bit;
 	bool is_initializing;
 	vaddr_t stack_ptr;
+	bool concurrent;
+	short int thread_id;
+	size_t num_threads;
+	struct user_mode_thread *threads[CFG_NUM_THREADS - 1];
+	struct recursive_mutex mu;
 };
 #endif /*__KERNEL_USER_MODE_CTX_STRUCT_H*/
 
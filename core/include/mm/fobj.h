@@ -138,6 +138,60 @@ static inline TEE_Result fobj_save_page(struct fobj *fobj,
 
 	return TEE_ERROR_GENERIC;
 }
+
+/* Maximum number of pages encrypted in one pass by fobj_save_pages() */
+#define FOBJ_SAVE_BATCH_MAX	8
+
+/*
+ * struct fobj_page - a page of a fobj
+ * @fobj:	Fobj pointer
+ * @page_idx:	Index of page in @fobj
+ * @va:		Address of the page
+ */
+struct fobj_page {
+	struct fobj *fobj;
+	unsigned int page_idx;
+	const void *va;
+};
+
+/*
+ * fobj_save_pages() - Save several pages into storage
+ * @pages:	Pages to save, may belong to different fobjs
+ * @num_pages:	Number of elements in @pages
+ *
+ * Gives the same result as calling fobj_save_page() for each page, but
+ * pages of fobjs allocated with fobj_rw_paged_alloc() are encrypted
+ * together in batches of up to FOBJ_SAVE_BATCH_MAX pages.
+ *
+ * Returns TEE_SUCCESS on success or TEE_ERROR_* on failure.
+ */
+TEE_Result fobj_save_pages(const struct fobj_page *pages, size_t num_pages);
+
+/*
+ * struct fobj_rwp_stats - statistics on pages saved by read/write paged
+ * fobjs
+ * @saved:		Number of pages saved
+ * @same_filled:	Number of saved pages filled with a repeated 64-bit
+ *			value, kept in the page state instead of being
+ *			encrypted and stored
+ */
+struct fobj_rwp_stats {
+	size_t saved;
+	size_t same_filled;
+};
+
+#ifdef CFG_WITH_STATS
+/*
+ * fobj_rwp_get_stats() - Get and reset statistics on saved pages
+ * @stats:	Statistics since last call
+ */
+void fobj_rwp_get_stats(struct fobj_rwp_stats *stats);
+#else
+static inline void fobj_rwp_get_stats(struct fobj_rwp_stats *stats)
+{
+	*stats = (struct fobj_rwp_stats){ };
+}
+#endif
 #endif
 
 /*
@@ -79,6 +79,7 @@ struct vm_region {
 	size_t size;
 	uint16_t attr; /* TEE_MATTR_* above */
 	uint16_t flags; /* VM_FLAGS_* above */
+	short int thread_id; /* Only mapped for this thread if valid */
 	TAILQ_ENTRY(vm_region) link;
 };
 
@@ -87,6 +88,7 @@ TAILQ_HEAD(vm_region_head, vm_region);
 struct vm_info {
 	struct vm_region_head regions;
 	unsigned int asid;
+	uint32_t id;
 };
 
 static inline void mattr_perm_to_str(char *str, size_t size, uint32_t attr)
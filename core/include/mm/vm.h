@@ -10,7 +10,8 @@
 #include <kernel/user_ta.h>
 
 /*-----------------------------------------------------------------------------
- * Allocate context resources like ASID and MMU table information
+ * Allocate context resources like MMU table information, the ASID is
+ * assigned when the context is activated with vm_set_ctx()
  *---------------------------------------------------------------------------*/
 TEE_Result vm_info_init(struct user_mode_ctx *uctx);
 
@@ -76,14 +77,17 @@ void vm_rem_rwmem(struct user_mode_ctx *uctx, struct mobj *mobj, vaddr_t va);
  * mapped to user mode are memref parameters. These later are considered
  * outside user mode private memory as it might be accessed by the user
  * mode context and its client(s).
+ *
+ * These functions and vm_check_access_rights() lock the memory map of a
+ * concurrent context while looking it up, see user_mode_ctx_lock().
  */
-bool vm_buf_is_inside_um_private(const struct user_mode_ctx *uctx,
+bool vm_buf_is_inside_um_private(struct user_mode_ctx *uctx,
 				 const void *va, size_t size);
 
-bool vm_buf_intersects_um_private(const struct user_mode_ctx *uctx,
+bool vm_buf_intersects_um_private(struct user_mode_ctx *uctx,
 				  const void *va, size_t size);
 
-TEE_Result vm_buf_to_mboj_offs(const struct user_mode_ctx *uctx,
+TEE_Result vm_buf_to_mboj_offs(struct user_mode_ctx *uctx,
 			       const void *va, size_t size,
 			       struct mobj **mobj, size_t *offs);
 
@@ -101,7 +105,7 @@ TEE_Result vm_va2pa(const struct user_mode_ctx *uctx, void *ua, paddr_t *pa);
  *---------------------------------------------------------------------------*/
 TEE_Result vm_pa2va(const struct user_mode_ctx *uctx, paddr_t pa, void **va);
 
-TEE_Result vm_check_access_rights(const struct user_mode_ctx *uctx,
+TEE_Result vm_check_access_rights(struct user_mode_ctx *uctx,
 				  uint32_t flags, uaddr_t uaddr, size_t len);
 
 /*-----------------------------------------------------------------------------
@@ -109,4 +113,38 @@ TEE_Result vm_check_access_rights(const struct user_mode_ctx *uctx,
  *---------------------------------------------------------------------------*/
 void vm_set_ctx(struct ts_ctx *ctx);
 
+/*
+ * Returns true if the region is mapped for the current thread. The
+ * parameters of a concurrent context are only mapped for the thread
+ * executing the entry point they were supplied to.
+ */
+static inline bool vm_region_is_visible(const struct vm_region *r)
+{
+	return r->thread_id == THREAD_ID_INVALID ||
+	       r->thread_id == thread_get_id();
+}
+
+/*
+ * struct vm_switch_stats - Statistics on vm_set_ctx()
+ * @switches:	Number of calls
+ * @switch_us:	Total time spent in the calls in microseconds
+ */
+struct vm_switch_stats {
+	size_t switches;
+	uint64_t switch_us;
+};
+
+#ifdef CFG_WITH_STATS
+/*
+ * vm_get_switch_stats() - Get and reset context switch statistics
+ * @stats:	Statistics since last call
+ */
+void vm_get_switch_stats(struct vm_switch_stats *stats);
+#else
+static inline void vm_get_switch_stats(struct vm_switch_stats *stats)
+{
+	*stats = (struct vm_switch_stats){ };
+}
+#endif
+
 #endif /*TEE_MMU_H*/
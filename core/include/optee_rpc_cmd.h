@@ -24,6 +24,12 @@
  *
  * [in]     value[0].a-b    UUID
  * [out]    memref[1]	    Buffer with TA
+ * [in]     value[2].a	    Optional offset into the TA
+ *
+ * When the optional third parameter is supplied only memref[1].size bytes
+ * of the TA starting at offset value[2].a are returned, this allows
+ * loading the TA in parts. Normal world not supporting this returns
+ * an error or updates memref[1].size to the full size of the TA.
  */
 #define OPTEE_RPC_CMD_LOAD_TA		0
 
@@ -274,6 +280,21 @@
  */
 #define OPTEE_RPC_FS_READDIR		10
 
+/*
+ * Write a list of extents to a file
+ *
+ * Each extent in memref[1] starts with a header of two 64-bit fields, the
+ * offset into the file followed by the number of data bytes. The data
+ * bytes follow the header and the next extent starts at the following
+ * 8-byte aligned offset. The extents are written in order.
+ *
+ * [in]     value[0].a	    OPTEE_RPC_FS_WRITEV
+ * [in]     value[0].b	    File descriptor of open file
+ * [in]     value[0].c	    Number of extents
+ * [in]     memref[1]	    Buffer holding the extents
+ */
+#define OPTEE_RPC_FS_WRITEV		11
+
 /* End of definition of protocol for command OPTEE_RPC_CMD_FS */
 
 /*
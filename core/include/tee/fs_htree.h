@@ -78,6 +78,9 @@ struct tee_fs_rpc_operation;
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_write_flush:	optional, complete the writes that @rpc_write_final
+ *			has deferred. Called before anything is read and
+ *			before and after the head is written.
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
  * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
@@ -94,6 +97,7 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	TEE_Result (*rpc_write_flush)(void *aux);
 };
 
 struct tee_fs_htree;
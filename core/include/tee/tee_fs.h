@@ -6,8 +6,10 @@
 #ifndef TEE_FS_H
 #define TEE_FS_H
 
+#include <compiler.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <tee_api_types.h>
 
 #define TEE_FS_NAME_MAX 350
@@ -50,6 +52,20 @@ struct tee_file_operations {
 	void (*closedir)(struct tee_fs_dir *d);
 };
 
+/*
+ * struct tee_rpmb_fs_stats - RPMB write statistics
+ * @frames:	number of data frames written
+ * @requests:	number of write requests sent to the device
+ * @bytes:	number of data bytes written
+ * @time_us:	time spent in write requests, in microseconds
+ */
+struct tee_rpmb_fs_stats {
+	uint64_t frames;
+	uint64_t requests;
+	uint64_t bytes;
+	uint64_t time_us;
+};
+
 #ifdef CFG_REE_FS
 extern const struct tee_file_operations ree_fs_ops;
 #endif
@@ -59,12 +75,21 @@ extern const struct tee_file_operations rpmb_fs_ops;
 TEE_Result tee_rpmb_fs_raw_open(const char *fname, bool create,
 				struct tee_file_handle **fh);
 
+/* Returns the RPMB write statistics, which are cleared if @reset is true */
+void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats, bool reset);
+
 /**
  * Weak function which can be overridden by platforms to indicate that the RPMB
  * key is ready to be written. Defaults to true, platforms can return false to
  * prevent a RPMB key write in the wrong state.
  */
 bool plat_rpmb_key_is_ready(void);
+#else
+static inline void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats,
+					 bool reset __unused)
+{
+	memset(stats, 0, sizeof(*stats));
+}
 #endif
 
 #endif /*TEE_FS_H*/
@@ -22,6 +22,33 @@ struct tee_fs_rpc_operation {
 	size_t num_params;
 };
 
+/* Size of the buffer carrying the extents of a vectored write */
+#define TEE_FS_RPC_WRITEV_BUF_SIZE	(64 * 1024)
+
+/*
+ * Header of an extent in a vectored write, see OPTEE_RPC_FS_WRITEV
+ */
+struct tee_fs_rpc_extent {
+	uint64_t offset;
+	uint64_t length;
+};
+
+/*
+ * struct tee_fs_rpc_writev - vectored write in progress
+ * @mobj:		shared memory object of @buf, NULL if not for an RPC
+ * @buf:		buffer holding the extents
+ * @buf_size:		size of @buf
+ * @used:		number of bytes of @buf used by the extents
+ * @num_extents:	number of extents in @buf
+ */
+struct tee_fs_rpc_writev {
+	struct mobj *mobj;
+	uint8_t *buf;
+	size_t buf_size;
+	size_t used;
+	uint32_t num_extents;
+};
+
 struct tee_fs_dirfile_fileh;
 
 TEE_Result tee_fs_rpc_open(uint32_t id, struct tee_pobj *po, int *fd);
@@ -44,6 +71,23 @@ TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op,
 				 size_t data_len, void **data);
 TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op);
 
+/*
+ * Vectored writes: tee_fs_rpc_writev_init() gets a buffer from the shared
+ * memory cache of the current thread, tee_fs_rpc_writev_add() reserves
+ * room for one more extent and tee_fs_rpc_writev_final() writes all the
+ * extents with a single RPC. If normal world doesn't support
+ * OPTEE_RPC_FS_WRITEV the extents are written one by one instead.
+ *
+ * tee_fs_rpc_writev_add() returns TEE_ERROR_SHORT_BUFFER when @wv is full,
+ * the extents are then to be written before adding more.
+ */
+TEE_Result tee_fs_rpc_writev_init(struct tee_fs_rpc_writev *wv);
+TEE_Result tee_fs_rpc_writev_add(struct tee_fs_rpc_writev *wv,
+				 tee_fs_off_t offset, size_t data_len,
+				 void **data);
+TEE_Result tee_fs_rpc_writev_final(struct tee_fs_rpc_writev *wv,
+				   uint32_t id, int fd);
+
 
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len);
 TEE_Result tee_fs_rpc_remove(uint32_t id, struct tee_pobj *po);
@@ -7,6 +7,7 @@
 #define TEE_OBJ_H
 
 #include <kernel/tee_ta_manager.h>
+#include <kernel/user_ta.h>
 #include <sys/queue.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
@@ -15,6 +16,7 @@
 
 struct tee_obj {
 	TAILQ_ENTRY(tee_obj) link;
+	uint32_t id;		/* tagged handle in utc->object_db */
 	TEE_ObjectInfo info;
 	bool busy;		/* true if used by an operation */
 	uint32_t have_attrs;	/* bitfield identifying set properties */
@@ -22,11 +24,22 @@ struct tee_obj {
 	size_t ds_pos;
 	struct tee_pobj *pobj;	/* ptr to persistant object */
 	struct tee_file_handle *fh;
+	struct user_ta_claim claim;
 };
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
+/*
+ * Registers @o with the TA context and assigns the object id returned to
+ * the TA in @o->id. @o is claimed by the current thread just as if it had
+ * been looked up with tee_obj_get().
+ */
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o);
 
-TEE_Result tee_obj_get(struct user_ta_ctx *utc, vaddr_t obj_id,
+/*
+ * Looks up the object with id @obj_id. The object of a concurrent TA is
+ * claimed by the current thread until the syscall returns, returns
+ * TEE_ERROR_BUSY if it's used by another thread.
+ */
+TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj);
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o);
@@ -71,6 +71,9 @@ TEE_Result syscall_mask_cancellation(uint32_t *old_mask);
 
 TEE_Result syscall_wait(unsigned long timeout);
 
+TEE_Result syscall_futex_wait(unsigned int *uaddr, unsigned long val);
+TEE_Result syscall_futex_wake(void);
+
 TEE_Result syscall_get_time(unsigned long cat, TEE_Time *time);
 TEE_Result syscall_set_ta_time(const TEE_Time *time);
 
@@ -50,6 +50,8 @@ TEE_Result syscall_cipher_update(unsigned long state, const void *src,
 			size_t src_len, void *dest, uint64_t *dest_len);
 TEE_Result syscall_cipher_final(unsigned long state, const void *src,
 			size_t src_len, void *dest, uint64_t *dest_len);
+TEE_Result syscall_cipher_update_many(unsigned long state,
+			const struct utee_cipher_seg *segs, size_t num_segs);
 
 TEE_Result syscall_cryp_derive_key(unsigned long state,
 			const struct utee_attribute *params,
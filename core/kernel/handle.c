@@ -3,6 +3,8 @@
  * Copyright (c) 2014, Linaro Limited
  * Copyright (c) 2020, Arm Limited
  */
+#include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
@@ -15,6 +17,99 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+/*
+ * Unused locations in db->ptrs form a singly linked list starting at
+ * db->free_head. An unused location holds the index + 1 of the next
+ * unused location shifted left one bit with bit 0 set, this can't be
+ * mistaken for a pointer since those are at least 2 byte aligned. Index
+ * + 1 is used so that 0 terminates the list, db->free_head is encoded in
+ * the same way.
+ */
+static void *free_slot(size_t next_free)
+{
+	return (void *)((next_free << 1) | 1);
+}
+
+static bool is_free_slot(void *p)
+{
+	return (uintptr_t)p & 1;
+}
+
+static size_t next_free(void *p)
+{
+	return (uintptr_t)p >> 1;
+}
+
+static bool is_valid_handle(struct handle_db *db, int handle)
+{
+	return db && handle >= 0 && (size_t)handle < db->max_ptrs &&
+	       !is_free_slot(db->ptrs[handle]);
+}
+
+/* Links the unused locations [begin, end) in ascending order */
+static void link_free_slots(struct handle_db *db, size_t begin, size_t end)
+{
+	size_t n = 0;
+
+	for (n = end; n > begin; n--) {
+		db->ptrs[n - 1] = free_slot(db->free_head);
+		db->free_head = n;
+	}
+}
+
+/* Truncates the ptrs array, all dropped locations must be unused */
+static void shrink(struct handle_db *db, size_t new_max_ptrs)
+{
+	size_t n = 0;
+	void *p = NULL;
+
+	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	if (!p)
+		return;
+	db->ptrs = p;
+	db->max_ptrs = new_max_ptrs;
+
+	/* Rebuild the list of unused locations without the dropped ones */
+	db->free_head = 0;
+	for (n = new_max_ptrs; n > 0; n--) {
+		if (is_free_slot(db->ptrs[n - 1])) {
+			db->ptrs[n - 1] = free_slot(db->free_head);
+			db->free_head = n;
+		}
+	}
+}
+
+/*
+ * Shrinks the ptrs array to the initial capacity when the database
+ * becomes empty, or to half its size when the number of used handles
+ * drops to a quarter of the capacity and the upper half is unused. The
+ * latter is only checked when crossing the threshold so the array is
+ * scanned at most once per a number of operations proportional to its
+ * size.
+ */
+static void maybe_shrink(struct handle_db *db)
+{
+	size_t new_max_ptrs = db->max_ptrs / 2;
+	size_t n = 0;
+
+	if (db->max_ptrs <= HANDLE_DB_INITIAL_MAX_PTRS)
+		return;
+
+	if (!db->num_used) {
+		shrink(db, HANDLE_DB_INITIAL_MAX_PTRS);
+		return;
+	}
+
+	if (db->num_used != db->max_ptrs / 4)
+		return;
+
+	for (n = new_max_ptrs; n < db->max_ptrs; n++)
+		if (!is_free_slot(db->ptrs[n]))
+			return;
+
+	shrink(db, new_max_ptrs);
+}
+
 void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 {
 	if (db) {
@@ -22,26 +117,20 @@ void handle_db_destroy(struct handle_db *db, void (*ptr_destructor)(void *ptr))
 			size_t n = 0;
 
 			for (n = 0; n < db->max_ptrs; n++)
-				if (db->ptrs[n])
+				if (!is_free_slot(db->ptrs[n]))
 					ptr_destructor(db->ptrs[n]);
 		}
 		free(db->ptrs);
 		db->ptrs = NULL;
 		db->max_ptrs = 0;
+		db->num_used = 0;
+		db->free_head = 0;
 	}
 }
 
 bool handle_db_is_empty(struct handle_db *db)
 {
-	size_t n = 0;
-
-	if (db) {
-		for (n = 0; n < db->max_ptrs; n++) {
-			if (db->ptrs[n])
-				return false;
-		}
-	}
-	return true;
+	return !db || !db->num_used;
 }
 
 int handle_get(struct handle_db *db, void *ptr)
@@ -50,32 +139,30 @@ int handle_get(struct handle_db *db, void *ptr)
 	void *p;
 	size_t new_max_ptrs;
 
-	if (!db || !ptr)
+	if (!db || !ptr || is_free_slot(ptr))
 		return -1;
 
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
+	if (!db->free_head) {
+		/* No location available, grow the ptrs array */
+		if (db->max_ptrs)
+			new_max_ptrs = db->max_ptrs * 2;
+		else
+			new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+		if (new_max_ptrs > INT_MAX)
+			return -1;
+		p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+		if (!p)
+			return -1;
+		db->ptrs = p;
+		link_free_slots(db, db->max_ptrs, new_max_ptrs);
+		db->max_ptrs = new_max_ptrs;
 	}
 
-	/* No location available, grow the ptrs array */
-	if (db->max_ptrs)
-		new_max_ptrs = db->max_ptrs * 2;
-	else
-		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
-		return -1;
-	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
-	db->max_ptrs = new_max_ptrs;
-
-	/* Since n stopped at db->max_ptrs there is an empty location there */
+	n = db->free_head - 1;
+	db->free_head = next_free(db->ptrs[n]);
 	db->ptrs[n] = ptr;
+	db->num_used++;
+
 	return n;
 }
 
@@ -83,17 +170,23 @@ void *handle_put(struct handle_db *db, int handle)
 {
 	void *p;
 
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!is_valid_handle(db, handle))
 		return NULL;
 
 	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	db->ptrs[handle] = free_slot(db->free_head);
+	db->free_head = handle + 1;
+	assert(db->num_used);
+	db->num_used--;
+
+	maybe_shrink(db);
+
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, int handle)
 {
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!is_valid_handle(db, handle))
 		return NULL;
 
 	return db->ptrs[handle];
@@ -60,6 +60,11 @@ static bool has_single_instance_lock(void)
 {
 	return false;
 }
+
+static bool can_lock_single_instance(void)
+{
+	return true;
+}
 #else
 static void lock_single_instance(void)
 {
@@ -94,6 +99,13 @@ static bool has_single_instance_lock(void)
 	/* Requires tee_ta_mutex to be held */
 	return tee_ta_single_instance_thread == thread_get_id();
 }
+
+static bool can_lock_single_instance(void)
+{
+	/* Requires tee_ta_mutex to be held */
+	return tee_ta_single_instance_thread == THREAD_ID_INVALID ||
+	       has_single_instance_lock();
+}
 #endif
 
 struct tee_ta_session *__noprof to_ta_session(struct ts_session *sess)
@@ -113,15 +125,120 @@ static struct tee_ta_ctx *ts_to_ta_ctx(struct ts_ctx *ctx)
 	panic("bad context");
 }
 
-static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx)
+/*
+ * A concurrent user TA is entered exclusively until the first session has
+ * been opened, after that any number of threads can execute in it at the
+ * same time. Only ldelf_init_with_ldelf() leaves TA_FLAG_CONCURRENT set
+ * for user TAs which can support that.
+ */
+static bool is_concurrent_user_ta(struct tee_ta_ctx *ctx)
+{
+	return (ctx->flags & TA_FLAG_CONCURRENT) &&
+	       is_user_ta_ctx(&ctx->ts_ctx);
+}
+
+/* How a TA context is entered, see set_busy_concurrent() */
+enum ta_entry {
+	TA_ENTRY_OPEN,
+	TA_ENTRY_INVOKE,
+	TA_ENTRY_CLOSE,
+};
+
+/*
+ * Returns true if the current thread has entered a concurrent user TA
+ * exclusively, that is while opening or closing a session or initializing
+ * the instance. Only this thread can have set ctx->busy of a concurrent TA
+ * it's executing in, as an exclusive entry waits for all other threads to
+ * leave the TA.
+ */
+static bool holds_concurrent_busy(void)
+{
+	struct ts_session *s = NULL;
+	struct tee_ta_ctx *ctx = NULL;
+
+	TAILQ_FOREACH(s, &thread_get_tsd()->sess_stack, link_tsd) {
+		if (!is_ta_ctx(s->ctx))
+			continue;
+		ctx = to_ta_ctx(s->ctx);
+		if (is_concurrent_user_ta(ctx) && ctx->busy)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Invocations of an initialized concurrent user TA are counted in
+ * ctx->num_active and run in parallel. Opening a session is entered
+ * exclusively by setting ctx->busy, so the TA instance can't be
+ * initialized or uninitialized by libutee while another entry is running.
+ * Closing the last session uninitializes the instance and is entered
+ * exclusively too, other sessions are closed like invocations since
+ * libutee only removes a session after its close entry point has
+ * returned.
+ *
+ * Waiting here must not dead-lock with threads waiting for something held
+ * by the current thread, in that case false is returned and the caller
+ * gets TEE_ERROR_BUSY:
+ * - an exclusive entry only waits for other threads when called from
+ *   normal world, any TA the current thread executes in may be needed
+ *   by the threads executing in @ctx
+ * - other entries wait for ctx->busy to be cleared unless the current
+ *   thread holds ctx->busy of a concurrent TA itself. The holder of
+ *   ctx->busy never waits for anything, see tee_ta_try_set_busy(), so
+ *   the wait always ends.
+ */
+static bool set_busy_concurrent(struct tee_ta_ctx *ctx, enum ta_entry entry)
+{
+	bool exclusive = entry == TA_ENTRY_OPEN ||
+			 (entry == TA_ENTRY_CLOSE && ctx->ref_count == 1);
+	bool may_wait = false;
+
+	if (exclusive) {
+		may_wait = TAILQ_EMPTY(&thread_get_tsd()->sess_stack);
+		if (!may_wait && (ctx->busy || ctx->num_active))
+			return false;
+		while (ctx->busy || ctx->num_active)
+			condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
+		ctx->busy = true;
+	} else {
+		may_wait = !holds_concurrent_busy();
+		if (!may_wait && ctx->busy)
+			return false;
+		while (ctx->busy)
+			condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
+		ctx->num_active++;
+	}
+
+	return true;
+}
+
+static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx, enum ta_entry entry)
 {
 	bool rc = true;
 
-	if (ctx->flags & TA_FLAG_CONCURRENT)
+	if ((ctx->flags & TA_FLAG_CONCURRENT) && !is_concurrent_user_ta(ctx))
 		return true;
 
 	mutex_lock(&tee_ta_mutex);
 
+	if (is_concurrent_user_ta(ctx) && !ctx->initializing)
+		goto out_concurrent;
+
+	if (holds_concurrent_busy()) {
+		/*
+		 * Other threads may be waiting for the concurrent TA we've
+		 * entered exclusively, as waiting for the single-instance
+		 * lock or for this TA could cause a dead-lock we return
+		 * false instead.
+		 */
+		if (ctx->busy || ((ctx->flags & TA_FLAG_SINGLE_INSTANCE) &&
+				  !can_lock_single_instance())) {
+			mutex_unlock(&tee_ta_mutex);
+			return false;
+		}
+	}
+
 	if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
 		lock_single_instance();
 
@@ -145,29 +262,57 @@ static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx)
 			condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
 	}
 
+	if (rc && is_concurrent_user_ta(ctx) && !ctx->initializing) {
+		/* Initialized while we were waiting */
+		if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
+			unlock_single_instance();
+		goto out_concurrent;
+	}
+
 	/* Either it's already true or we should set it to true */
 	ctx->busy = true;
 
 	mutex_unlock(&tee_ta_mutex);
 	return rc;
+
+out_concurrent:
+	rc = set_busy_concurrent(ctx, entry);
+	mutex_unlock(&tee_ta_mutex);
+	return rc;
 }
 
-static void tee_ta_set_busy(struct tee_ta_ctx *ctx)
+static void tee_ta_set_busy(struct tee_ta_ctx *ctx, enum ta_entry entry)
 {
-	if (!tee_ta_try_set_busy(ctx))
+	if (!tee_ta_try_set_busy(ctx, entry))
 		panic();
 }
 
 static void tee_ta_clear_busy(struct tee_ta_ctx *ctx)
 {
-	if (ctx->flags & TA_FLAG_CONCURRENT)
+	if ((ctx->flags & TA_FLAG_CONCURRENT) && !is_concurrent_user_ta(ctx))
 		return;
 
 	mutex_lock(&tee_ta_mutex);
 
+	if (is_concurrent_user_ta(ctx) && !ctx->initializing) {
+		if (ctx->busy) {
+			ctx->busy = false;
+		} else {
+			assert(ctx->num_active);
+			ctx->num_active--;
+		}
+		if (!ctx->num_active)
+			condvar_broadcast(&ctx->busy_cv);
+		mutex_unlock(&tee_ta_mutex);
+		return;
+	}
+
 	assert(ctx->busy);
 	ctx->busy = false;
-	condvar_signal(&ctx->busy_cv);
+	if (is_concurrent_user_ta(ctx))
+		condvar_broadcast(&ctx->busy_cv);
+	else
+		condvar_signal(&ctx->busy_cv);
 
 	if (!ctx->initializing && (ctx->flags & TA_FLAG_SINGLE_INSTANCE))
 		unlock_single_instance();
@@ -320,12 +465,30 @@ static void destroy_ta_ctx_from_session(struct tee_ta_session *s)
 	struct tee_ta_session_head *open_sessions = NULL;
 	struct tee_ta_ctx *ctx = NULL;
 	struct user_ta_ctx *utc = NULL;
-	struct ts_ctx *ts_ctx = s->ts_sess.ctx;
+	struct ts_ctx *ts_ctx = NULL;
 	size_t count = 1; /* start counting the references to the context */
 
+	mutex_lock(&tee_ta_mutex);
+
+	/*
+	 * Wait for the other threads to leave a concurrent TA. One of them
+	 * may have seen the panic too and destroyed the context already.
+	 */
+	while (true) {
+		ts_ctx = s->ts_sess.ctx;
+		if (!ts_ctx) {
+			mutex_unlock(&tee_ta_mutex);
+			return;
+		}
+		ctx = ts_to_ta_ctx(ts_ctx);
+		if (!ctx->num_active &&
+		    !(is_concurrent_user_ta(ctx) && ctx->busy))
+			break;
+		condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
+	}
+
 	DMSG("Remove references to context (%#"PRIxVA")", (vaddr_t)ts_ctx);
 
-	mutex_lock(&tee_ta_mutex);
 	nsec_sessions_list_head(&open_sessions);
 
 	/*
@@ -542,7 +705,7 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 	if (ctx->panicked) {
 		destroy_session(sess, open_sessions);
 	} else {
-		tee_ta_set_busy(ctx);
+		tee_ta_set_busy(ctx, TA_ENTRY_CLOSE);
 		set_invoke_timeout(sess, TEE_TIMEOUT_INFINITE);
 		ts_ctx->ops->enter_close_session(&sess->ts_sess);
 		destroy_session(sess, open_sessions);
@@ -739,18 +902,19 @@ TEE_Result tee_ta_open_session(TEE_ErrorOrigin *err,
 	/* Save identity of the owner of the session */
 	s->clnt_id = *clnt_id;
 
-	if (tee_ta_try_set_busy(ctx)) {
+	if (tee_ta_try_set_busy(ctx, TA_ENTRY_OPEN)) {
 		s->param = param;
 		set_invoke_timeout(s, cancel_req_to);
 		res = ts_ctx->ops->enter_open_session(&s->ts_sess);
+		panicked = ctx->panicked;
 		tee_ta_clear_busy(ctx);
 	} else {
 		/* Deadlock avoided */
 		res = TEE_ERROR_BUSY;
 		was_busy = true;
+		panicked = ctx->panicked;
 	}
 
-	panicked = ctx->panicked;
 	s->param = NULL;
 
 	tee_ta_put_session(s);
@@ -781,6 +945,7 @@ TEE_Result tee_ta_invoke_command(TEE_ErrorOrigin *err,
 	struct tee_ta_ctx *ta_ctx = NULL;
 	struct ts_ctx *ts_ctx = NULL;
 	TEE_Result res = TEE_SUCCESS;
+	bool panicked = false;
 
 	if (check_client(sess, clnt_id) != TEE_SUCCESS)
 		return TEE_ERROR_BAD_PARAMETERS; /* intentional generic error */
@@ -803,16 +968,22 @@ TEE_Result tee_ta_invoke_command(TEE_ErrorOrigin *err,
 		return TEE_ERROR_TARGET_DEAD;
 	}
 
-	tee_ta_set_busy(ta_ctx);
+	if (!tee_ta_try_set_busy(ta_ctx, TA_ENTRY_INVOKE)) {
+		/* Deadlock avoided */
+		*err = TEE_ORIGIN_TEE;
+		return TEE_ERROR_BUSY;
+	}
 
 	sess->param = param;
 	set_invoke_timeout(sess, cancel_req_to);
 	res = ts_ctx->ops->enter_invoke_cmd(&sess->ts_sess, cmd);
 
 	sess->param = NULL;
+	/* Once cleared another thread may destroy a panicked context */
+	panicked = ta_ctx->panicked;
 	tee_ta_clear_busy(ta_ctx);
 
-	if (ta_ctx->panicked) {
+	if (panicked) {
 		destroy_ta_ctx_from_session(sess);
 		*err = TEE_ORIGIN_TEE;
 		return TEE_ERROR_TARGET_DEAD;
@@ -881,8 +1052,13 @@ void tee_ta_gprof_sample_pc(vaddr_t pc)
 		return; /* PC sampling is not enabled */
 
 	idx = (((uint64_t)pc - sbuf->offset)/2 * sbuf->scale)/65536;
-	if (idx < sbuf->nsamples) {
-		utc = to_user_ta_ctx(s->ctx);
+	utc = to_user_ta_ctx(s->ctx);
+	/*
+	 * The memory map of a concurrent TA can only be checked with
+	 * uctx->mu held which can't be taken here with exceptions masked,
+	 * such samples are only counted.
+	 */
+	if (idx < sbuf->nsamples && !utc->uctx.concurrent) {
 		res = vm_check_access_rights(&utc->uctx,
 					     TEE_MEMORY_ACCESS_READ |
 					     TEE_MEMORY_ACCESS_WRITE |
@@ -3,9 +3,14 @@
  * Copyright (c) 2019, Linaro Limited
  */
 
+#include <atomic.h>
 #include <kernel/user_mode_ctx.h>
-#include <trace.h>
+#include <mm/fobj.h>
 #include <mm/mobj.h>
+#include <mm/vm.h>
+#include <stdlib.h>
+#include <trace.h>
+#include <util.h>
 
 void user_mode_ctx_print_mappings(struct user_mode_ctx *uctx)
 {
@@ -27,3 +32,205 @@ void user_mode_ctx_print_mappings(struct user_mode_ctx *uctx)
 		n++;
 	}
 }
+
+void user_mode_ctx_init_concurrent(struct user_mode_ctx *uctx)
+{
+	mutex_init_recursive(&uctx->mu);
+	uctx->thread_id = THREAD_ID_INVALID;
+	uctx->concurrent = true;
+}
+
+void user_mode_ctx_free_threads(struct user_mode_ctx *uctx)
+{
+	size_t n = 0;
+
+	if (!uctx->concurrent)
+		return;
+
+	for (n = 0; n < ARRAY_SIZE(uctx->threads); n++) {
+		free(uctx->threads[n]);
+		uctx->threads[n] = NULL;
+	}
+	mutex_destroy_recursive(&uctx->mu);
+}
+
+TEE_Result user_mode_ctx_lock_exclusive(struct user_mode_ctx *uctx)
+{
+	if (!uctx->concurrent)
+		return TEE_SUCCESS;
+
+	mutex_lock_recursive(&uctx->mu);
+	if (uctx->num_threads > 1) {
+		mutex_unlock_recursive(&uctx->mu);
+		return TEE_ERROR_BUSY;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * The thread entries are only updated with @uctx->mu held, but are also
+ * looked up without it when the VFP state of the current thread is
+ * needed. That's still safe since an entry owned by the current thread
+ * can't change under our feet, and entries are added in order and kept
+ * until the context is destroyed so it's found before any entry still
+ * being added by another thread.
+ */
+static struct user_mode_thread *find_thread(struct user_mode_ctx *uctx,
+					    short int thread_id)
+{
+	struct user_mode_thread *thr = NULL;
+	size_t n = 0;
+
+	for (n = 0; n < ARRAY_SIZE(uctx->threads); n++) {
+		thr = __compiler_atomic_load(uctx->threads + n);
+		if (thr && atomic_load_short(&thr->thread_id) == thread_id)
+			return thr;
+	}
+
+	return NULL;
+}
+
+/*
+ * Allocates a new thread entry with a stack of the same size as the one
+ * ldelf set up for the context. A guard page is left unmapped below the
+ * stack.
+ */
+static TEE_Result alloc_thread(struct user_mode_ctx *uctx,
+			       struct user_mode_thread **thr_ret)
+{
+	struct user_mode_thread *thr = NULL;
+	struct vm_region *r = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	struct mobj *mobj = NULL;
+	struct fobj *f = NULL;
+	size_t stack_size = 0;
+	vaddr_t va = 0;
+	size_t n = 0;
+
+	for (n = 0; n < ARRAY_SIZE(uctx->threads); n++)
+		if (!uctx->threads[n])
+			break;
+	if (n == ARRAY_SIZE(uctx->threads))
+		return TEE_ERROR_BUSY;
+
+	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
+		if (uctx->stack_ptr > r->va &&
+		    uctx->stack_ptr <= r->va + r->size) {
+			stack_size = uctx->stack_ptr - r->va;
+			break;
+		}
+	}
+	if (!stack_size)
+		return TEE_ERROR_GENERIC;
+
+	thr = calloc(1, sizeof(*thr));
+	if (!thr)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	f = fobj_ta_mem_alloc(ROUNDUP_DIV(stack_size, SMALL_PAGE_SIZE));
+	if (!f) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto err;
+	}
+	mobj = mobj_with_fobj_alloc(f, NULL);
+	fobj_put(f);
+	if (!mobj) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto err;
+	}
+	res = vm_map_pad(uctx, &va, stack_size, TEE_MATTR_URW | TEE_MATTR_PRW,
+			 0, mobj, 0, SMALL_PAGE_SIZE, 0, 0);
+	mobj_put(mobj);
+	if (res)
+		goto err;
+
+	thr->stack_ptr = va + stack_size;
+	thr->thread_id = THREAD_ID_INVALID;
+	__compiler_atomic_store(uctx->threads + n, thr);
+	*thr_ret = thr;
+
+	return TEE_SUCCESS;
+err:
+	free(thr);
+	return res;
+}
+
+TEE_Result user_mode_ctx_enter_thread(struct user_mode_ctx *uctx,
+				      vaddr_t *stack_ptr)
+{
+	short int ct = thread_get_id();
+	struct user_mode_thread *thr = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!uctx->concurrent) {
+		*stack_ptr = uctx->stack_ptr;
+		return TEE_SUCCESS;
+	}
+
+	mutex_lock_recursive(&uctx->mu);
+
+	if (uctx->thread_id == ct || find_thread(uctx, ct)) {
+		res = TEE_ERROR_BUSY;
+		goto out;
+	}
+
+	if (uctx->thread_id == THREAD_ID_INVALID) {
+		atomic_store_short(&uctx->thread_id, ct);
+		*stack_ptr = uctx->stack_ptr;
+	} else {
+		thr = find_thread(uctx, THREAD_ID_INVALID);
+		if (!thr) {
+			res = alloc_thread(uctx, &thr);
+			if (res)
+				goto out;
+		}
+		atomic_store_short(&thr->thread_id, ct);
+		*stack_ptr = thr->stack_ptr;
+	}
+	uctx->num_threads++;
+out:
+	mutex_unlock_recursive(&uctx->mu);
+
+	return res;
+}
+
+void user_mode_ctx_exit_thread(struct user_mode_ctx *uctx)
+{
+	short int ct = thread_get_id();
+	struct user_mode_thread *thr = NULL;
+
+	if (!uctx->concurrent)
+		return;
+
+	mutex_lock_recursive(&uctx->mu);
+
+	if (uctx->thread_id == ct) {
+		atomic_store_short(&uctx->thread_id, THREAD_ID_INVALID);
+	} else {
+		thr = find_thread(uctx, ct);
+		assert(thr);
+		atomic_store_short(&thr->thread_id, THREAD_ID_INVALID);
+	}
+	assert(uctx->num_threads);
+	uctx->num_threads--;
+
+	mutex_unlock_recursive(&uctx->mu);
+}
+
+#if defined(CFG_WITH_VFP)
+struct thread_user_vfp_state *
+user_mode_ctx_get_vfp(struct user_mode_ctx *uctx)
+{
+	short int ct = thread_get_id();
+	struct user_mode_thread *thr = NULL;
+
+	if (uctx->concurrent && atomic_load_short(&uctx->thread_id) != ct) {
+		thr = find_thread(uctx, ct);
+		if (thr)
+			return &thr->vfp;
+	}
+
+	return &uctx->vfp;
+}
+#endif
@@ -3,11 +3,13 @@
  * Copyright (c) 2019, Linaro Limited
  */
 
+#include <config.h>
 #include <crypto/crypto.h>
 #include <crypto/internal_aes-gcm.h>
 #include <initcall.h>
 #include <kernel/boot.h>
 #include <kernel/panic.h>
+#include <kernel/ts_store.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
 #include <mm/fobj.h>
@@ -18,6 +20,17 @@
 #include <types_ext.h>
 #include <util.h>
 
+/* Cached TA binaries not in use are dropped before giving up */
+static tee_mm_entry_t *sec_ddr_alloc(size_t size)
+{
+	tee_mm_entry_t *mm = tee_mm_alloc(&tee_mm_sec_ddr, size);
+
+	if (!mm && ree_fs_ta_cache_shrink())
+		mm = tee_mm_alloc(&tee_mm_sec_ddr, size);
+
+	return mm;
+}
+
 #ifdef CFG_WITH_PAGER
 
 #define RWP_AE_KEY_BITS		256
@@ -28,6 +41,13 @@ struct rwp_aes_gcm_iv {
 
 #define RWP_AES_GCM_TAG_LEN	16
 
+/*
+ * Set in struct rwp_state::iv when the page was filled with a repeated
+ * 64-bit value when saved, the value is kept in the first 8 bytes of
+ * struct rwp_state::tag instead of storing an encrypted page.
+ */
+#define RWP_IV_SAME_FILLED	BIT64(63)
+
 struct rwp_state {
 	uint64_t iv;
 	uint8_t tag[RWP_AES_GCM_TAG_LEN];
@@ -43,6 +63,27 @@ static const struct fobj_ops ops_rw_paged;
 
 static struct internal_aes_gcm_key rwp_ae_key;
 
+#ifdef CFG_WITH_STATS
+static struct fobj_rwp_stats rwp_stats;
+
+static void incr_rwp_stats(bool same_filled)
+{
+	rwp_stats.saved++;
+	if (same_filled)
+		rwp_stats.same_filled++;
+}
+
+void fobj_rwp_get_stats(struct fobj_rwp_stats *stats)
+{
+	*stats = rwp_stats;
+	memset(&rwp_stats, 0, sizeof(rwp_stats));
+}
+#else
+static void incr_rwp_stats(bool same_filled __unused)
+{
+}
+#endif
+
 /*
  * fobj_generate_authenc_key() - Generate authentication key
  *
@@ -98,7 +139,7 @@ struct fobj *fobj_rw_paged_alloc(unsigned int num_pages)
 
 	if (MUL_OVERFLOW(num_pages, SMALL_PAGE_SIZE, &size))
 		goto err;
-	mm = tee_mm_alloc(&tee_mm_sec_ddr, size);
+	mm = sec_ddr_alloc(size);
 	if (!mm)
 		goto err;
 	rwp->store = phys_to_virt(tee_mm_get_smem(mm), MEM_AREA_TA_RAM);
@@ -157,22 +198,46 @@ static TEE_Result rwp_load_page(struct fobj *fobj, unsigned int page_idx,
 		return TEE_SUCCESS;
 	}
 
+	if (state->iv & RWP_IV_SAME_FILLED) {
+		uint64_t *p = va;
+		uint64_t v = 0;
+		size_t n = 0;
+
+		memcpy(&v, state->tag, sizeof(v));
+		for (n = 0; n < SMALL_PAGE_SIZE / sizeof(*p); n++)
+			p[n] = v;
+		return TEE_SUCCESS;
+	}
+
 	return internal_aes_gcm_dec(&rwp_ae_key, &iv, sizeof(iv),
 				    NULL, 0, src, SMALL_PAGE_SIZE, va,
 				    state->tag, sizeof(state->tag));
 }
 DECLARE_KEEP_PAGER(rwp_load_page);
 
-static TEE_Result rwp_save_page(struct fobj *fobj, unsigned int page_idx,
-				const void *va)
+static bool page_is_same_filled(const void *va, uint64_t *val)
+{
+	const uint64_t *p = va;
+	size_t n = 0;
+
+	for (n = 1; n < SMALL_PAGE_SIZE / sizeof(*p); n++)
+		if (p[n] != p[0])
+			return false;
+
+	*val = p[0];
+	return true;
+}
+
+/*
+ * Prepares saving of a page by updating the IV of the page. Returns false
+ * if the page at @va doesn't need to be encrypted.
+ */
+static bool rwp_prepare_save(struct fobj *fobj, unsigned int page_idx,
+			     const void *va, struct rwp_aes_gcm_iv *iv)
 {
 	struct fobj_rwp *rwp = to_rwp(fobj);
 	struct rwp_state *state = rwp->state + page_idx;
-	size_t tag_len = sizeof(state->tag);
-	uint8_t *dst = rwp->store + page_idx * SMALL_PAGE_SIZE;
-	struct rwp_aes_gcm_iv iv;
-
-	memset(&iv, 0, sizeof(iv));
+	uint64_t val = 0;
 
 	if (!refcount_val(&fobj->refc)) {
 		/*
@@ -180,13 +245,28 @@ static TEE_Result rwp_save_page(struct fobj *fobj, unsigned int page_idx,
 		 * to call tee_pager_invalidate_fobj() yet.
 		 */
 		assert(TAILQ_EMPTY(&fobj->areas));
-		return TEE_SUCCESS;
+		return false;
 	}
 
 	assert(page_idx < fobj->num_pages);
-	assert(state->iv + 1 > state->iv);
 
+	state->iv &= ~RWP_IV_SAME_FILLED;
+	assert(state->iv + 1 < RWP_IV_SAME_FILLED);
 	state->iv++;
+
+	if (IS_ENABLED(CFG_PAGER_SAME_FILLED) &&
+	    page_is_same_filled(va, &val)) {
+		/*
+		 * The IV is still consumed so it isn't reused if the page
+		 * is encrypted next time it's saved.
+		 */
+		state->iv |= RWP_IV_SAME_FILLED;
+		memcpy(state->tag, &val, sizeof(val));
+		incr_rwp_stats(true);
+		return false;
+	}
+	incr_rwp_stats(false);
+
 	/*
 	 * IV is constructed as recommended in section "8.2.1 Deterministic
 	 * Construction" of "Recommendation for Block Cipher Modes of
@@ -194,9 +274,24 @@ static TEE_Result rwp_save_page(struct fobj *fobj, unsigned int page_idx,
 	 * http://csrc.nist.gov/publications/nistpubs/800-38D/SP-800-38D.pdf
 	 */
 
-	iv.iv[0] = (vaddr_t)state;
-	iv.iv[1] = state->iv >> 32;
-	iv.iv[2] = state->iv;
+	iv->iv[0] = (vaddr_t)state;
+	iv->iv[1] = state->iv >> 32;
+	iv->iv[2] = state->iv;
+
+	return true;
+}
+
+static TEE_Result rwp_save_page(struct fobj *fobj, unsigned int page_idx,
+				const void *va)
+{
+	struct fobj_rwp *rwp = to_rwp(fobj);
+	struct rwp_state *state = rwp->state + page_idx;
+	size_t tag_len = sizeof(state->tag);
+	uint8_t *dst = rwp->store + page_idx * SMALL_PAGE_SIZE;
+	struct rwp_aes_gcm_iv iv = { };
+
+	if (!rwp_prepare_save(fobj, page_idx, va, &iv))
+		return TEE_SUCCESS;
 
 	return internal_aes_gcm_enc(&rwp_ae_key, &iv, sizeof(iv),
 				    NULL, 0, va, SMALL_PAGE_SIZE, dst,
@@ -210,6 +305,60 @@ static const struct fobj_ops ops_rw_paged __rodata_unpaged = {
 	.save_page = rwp_save_page,
 };
 
+static TEE_Result rwp_save_batch(struct internal_aes_gcm_msg *msgs,
+				 size_t num_msgs)
+{
+	return internal_aes_gcm_enc_batch(&rwp_ae_key,
+					  sizeof(struct rwp_aes_gcm_iv),
+					  SMALL_PAGE_SIZE, RWP_AES_GCM_TAG_LEN,
+					  msgs, num_msgs);
+}
+
+TEE_Result fobj_save_pages(const struct fobj_page *pages, size_t num_pages)
+{
+	struct internal_aes_gcm_msg msgs[FOBJ_SAVE_BATCH_MAX] = { };
+	struct rwp_aes_gcm_iv ivs[FOBJ_SAVE_BATCH_MAX] = { };
+	const struct fobj_page *p = NULL;
+	struct fobj_rwp *rwp = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_msgs = 0;
+	size_t n = 0;
+
+	for (n = 0; n < num_pages; n++) {
+		p = pages + n;
+		if (p->fobj->ops != &ops_rw_paged) {
+			res = fobj_save_page(p->fobj, p->page_idx, p->va);
+			if (res)
+				return res;
+			continue;
+		}
+
+		if (!rwp_prepare_save(p->fobj, p->page_idx, p->va,
+				      ivs + num_msgs))
+			continue;
+
+		rwp = to_rwp(p->fobj);
+		msgs[num_msgs].nonce = ivs + num_msgs;
+		msgs[num_msgs].src = p->va;
+		msgs[num_msgs].dst = rwp->store + p->page_idx * SMALL_PAGE_SIZE;
+		msgs[num_msgs].tag = rwp->state[p->page_idx].tag;
+		num_msgs++;
+
+		if (num_msgs == FOBJ_SAVE_BATCH_MAX) {
+			res = rwp_save_batch(msgs, num_msgs);
+			if (res)
+				return res;
+			num_msgs = 0;
+		}
+	}
+
+	if (num_msgs)
+		return rwp_save_batch(msgs, num_msgs);
+
+	return TEE_SUCCESS;
+}
+DECLARE_KEEP_PAGER(fobj_save_pages);
+
 struct fobj_rop {
 	uint8_t *hashes;
 	uint8_t *store;
@@ -533,6 +682,37 @@ struct fobj_sec_mem {
 
 static const struct fobj_ops ops_sec_mem;
 
+#ifdef CFG_CORE_USER_BLOCK_MAP
+/*
+ * Memory of at least a translation table block is placed at a block
+ * aligned physical address when there's room for it, so that it can be
+ * mapped with blocks in user space, see core_mmu_user_block_pa().
+ */
+static tee_mm_entry_t *sec_ddr_alloc_block_aligned(size_t size)
+{
+	tee_mm_entry_t *mm = NULL;
+	paddr_t pa = 0;
+
+	if (size < CORE_MMU_PGDIR_SIZE)
+		return NULL;
+
+	pa = ROUNDUP(tee_mm_sec_ddr.lo, CORE_MMU_PGDIR_SIZE);
+	while (pa < tee_mm_sec_ddr.hi && tee_mm_sec_ddr.hi - pa >= size) {
+		mm = tee_mm_alloc2(&tee_mm_sec_ddr, pa, size);
+		if (mm)
+			return mm;
+		pa += CORE_MMU_PGDIR_SIZE;
+	}
+
+	return NULL;
+}
+#else
+static tee_mm_entry_t *sec_ddr_alloc_block_aligned(size_t size __unused)
+{
+	return NULL;
+}
+#endif
+
 struct fobj *fobj_sec_mem_alloc(unsigned int num_pages)
 {
 	struct fobj_sec_mem *f = calloc(1, sizeof(*f));
@@ -545,7 +725,9 @@ struct fobj *fobj_sec_mem_alloc(unsigned int num_pages)
 	if (MUL_OVERFLOW(num_pages, SMALL_PAGE_SIZE, &size))
 		goto err;
 
-	f->mm = tee_mm_alloc(&tee_mm_sec_ddr, size);
+	f->mm = sec_ddr_alloc_block_aligned(size);
+	if (!f->mm)
+		f->mm = sec_ddr_alloc(size);
 	if (!f->mm)
 		goto err;
 
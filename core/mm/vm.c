@@ -6,6 +6,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <initcall.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
@@ -45,6 +46,49 @@
 #define TEE_MMU_UCACHE_DEFAULT_ATTR	(TEE_MATTR_CACHE_CACHED << \
 					 TEE_MATTR_CACHE_SHIFT)
 
+#ifdef CFG_WITH_STATS
+static unsigned int switch_stats_lock = SPINLOCK_UNLOCK;
+static size_t switch_count;
+static uint64_t switch_ticks;
+
+static uint64_t switch_timestamp(void)
+{
+	return barrier_read_cntpct();
+}
+
+static void incr_switch_stats(uint64_t start)
+{
+	uint64_t ticks = barrier_read_cntpct() - start;
+	uint32_t exceptions = cpu_spin_lock_xsave(&switch_stats_lock);
+
+	switch_count++;
+	switch_ticks += ticks;
+
+	cpu_spin_unlock_xrestore(&switch_stats_lock, exceptions);
+}
+
+void vm_get_switch_stats(struct vm_switch_stats *stats)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&switch_stats_lock);
+
+	stats->switches = switch_count;
+	stats->switch_us = (switch_ticks * 1000000) / read_cntfrq();
+	switch_count = 0;
+	switch_ticks = 0;
+
+	cpu_spin_unlock_xrestore(&switch_stats_lock, exceptions);
+}
+#else
+static uint64_t switch_timestamp(void)
+{
+	return 0;
+}
+
+static void incr_switch_stats(uint64_t start __unused)
+{
+}
+#endif
+
 static vaddr_t select_va_in_range(const struct vm_region *prev_reg,
 				  const struct vm_region *next_reg,
 				  const struct vm_region *reg,
@@ -290,8 +334,22 @@ TEE_Result vm_map_pad(struct user_mode_ctx *uctx, vaddr_t *va, size_t len,
 	reg->size = ROUNDUP(len, SMALL_PAGE_SIZE);
 	reg->attr = attr | prot;
 	reg->flags = flags;
+	reg->thread_id = THREAD_ID_INVALID;
+	if ((flags & VM_FLAG_EPHEMERAL) && uctx->concurrent)
+		reg->thread_id = thread_get_id();
 
-	res = umap_add_region(&uctx->vm_info, reg, pad_begin, pad_end, align);
+	/*
+	 * Memory which can be mapped with translation table blocks is
+	 * placed at a block aligned address if there's room for it.
+	 */
+	res = TEE_ERROR_ACCESS_CONFLICT;
+	if (!reg->va && align < CORE_MMU_PGDIR_SIZE &&
+	    core_mmu_user_block_pa(mobj, offs, reg->size, NULL))
+		res = umap_add_region(&uctx->vm_info, reg, pad_begin, pad_end,
+				      CORE_MMU_PGDIR_SIZE);
+	if (res)
+		res = umap_add_region(&uctx->vm_info, reg, pad_begin, pad_end,
+				      align);
 	if (res)
 		goto err_free_reg;
 
@@ -336,9 +394,13 @@ static struct vm_region *find_vm_region(struct vm_info *vm_info, vaddr_t va)
 {
 	struct vm_region *r = NULL;
 
-	TAILQ_FOREACH(r, &vm_info->regions, link)
-		if (va >= r->va && va < r->va + r->size)
+	/* Regions are sorted on virtual address */
+	TAILQ_FOREACH(r, &vm_info->regions, link) {
+		if (va < r->va)
+			break;
+		if (va < r->va + r->size && vm_region_is_visible(r))
 			return r;
+	}
 
 	return NULL;
 }
@@ -398,6 +460,7 @@ static TEE_Result split_vm_region(struct user_mode_ctx *uctx,
 	r2->size = r->size - diff;
 	r2->attr = r->attr;
 	r2->flags = r->flags;
+	r2->thread_id = r->thread_id;
 
 	r->size = diff;
 
@@ -487,7 +550,8 @@ static void merge_vm_range(struct user_mode_ctx *uctx, vaddr_t va, size_t len)
 			continue;
 		if (r->mobj != r_next->mobj ||
 		    r->flags != r_next->flags ||
-		    r->attr != r_next->attr)
+		    r->attr != r_next->attr ||
+		    r->thread_id != r_next->thread_id)
 			continue;
 		if (r->offset + r->size != r_next->offset)
 			continue;
@@ -816,17 +880,15 @@ static TEE_Result map_kinit(struct user_mode_ctx *uctx)
 
 TEE_Result vm_info_init(struct user_mode_ctx *uctx)
 {
+	static uint32_t next_id;
 	TEE_Result res;
-	uint32_t asid = asid_alloc();
-
-	if (!asid) {
-		DMSG("Failed to allocate ASID");
-		return TEE_ERROR_GENERIC;
-	}
 
 	memset(&uctx->vm_info, 0, sizeof(uctx->vm_info));
 	TAILQ_INIT(&uctx->vm_info.regions);
-	uctx->vm_info.asid = asid;
+	/* The ASID is assigned by asid_activate() in vm_set_ctx() */
+	do {
+		uctx->vm_info.id = atomic_inc32(&next_id);
+	} while (!uctx->vm_info.id);
 
 	res = map_kinit(uctx);
 	if (res)
@@ -840,7 +902,7 @@ void vm_clean_param(struct user_mode_ctx *uctx)
 	struct vm_region *r;
 
 	TAILQ_FOREACH_SAFE(r, &uctx->vm_info.regions, link, next_r) {
-		if (r->flags & VM_FLAG_EPHEMERAL) {
+		if ((r->flags & VM_FLAG_EPHEMERAL) && vm_region_is_visible(r)) {
 			rem_um_region(uctx, r);
 			umap_remove_region(&uctx->vm_info, r);
 		}
@@ -852,7 +914,8 @@ static void check_param_map_empty(struct user_mode_ctx *uctx __maybe_unused)
 	struct vm_region *r = NULL;
 
 	TAILQ_FOREACH(r, &uctx->vm_info.regions, link)
-		assert(!(r->flags & VM_FLAG_EPHEMERAL));
+		assert(!(r->flags & VM_FLAG_EPHEMERAL) ||
+		       !vm_region_is_visible(r));
 }
 
 static TEE_Result param_mem_to_user_va(struct user_mode_ctx *uctx,
@@ -864,7 +927,8 @@ static TEE_Result param_mem_to_user_va(struct user_mode_ctx *uctx,
 		vaddr_t va = 0;
 		size_t phys_offs = 0;
 
-		if (!(region->flags & VM_FLAG_EPHEMERAL))
+		if (!(region->flags & VM_FLAG_EPHEMERAL) ||
+		    !vm_region_is_visible(region))
 			continue;
 		if (mem->mobj != region->mobj)
 			continue;
@@ -1025,6 +1089,7 @@ TEE_Result vm_add_rwmem(struct user_mode_ctx *uctx, struct mobj *mobj,
 	reg->offset = 0;
 	reg->va = 0;
 	reg->size = ROUNDUP(mobj->size, SMALL_PAGE_SIZE);
+	reg->thread_id = THREAD_ID_INVALID;
 	if (mobj_is_secure(mobj))
 		reg->attr = TEE_MATTR_SECURE;
 	else
@@ -1060,13 +1125,10 @@ void vm_rem_rwmem(struct user_mode_ctx *uctx, struct mobj *mobj, vaddr_t va)
 
 void vm_info_final(struct user_mode_ctx *uctx)
 {
-	if (!uctx->vm_info.asid)
+	if (!uctx->vm_info.id)
 		return;
 
-	/* clear MMU entries to avoid clash when asid is reused */
-	tlbi_asid(uctx->vm_info.asid);
-
-	asid_free(uctx->vm_info.asid);
+	asid_release(&uctx->vm_info);
 	while (!TAILQ_EMPTY(&uctx->vm_info.regions))
 		umap_remove_region(&uctx->vm_info,
 				   TAILQ_FIRST(&uctx->vm_info.regions));
@@ -1074,45 +1136,60 @@ void vm_info_final(struct user_mode_ctx *uctx)
 }
 
 /* return true only if buffer fits inside TA private memory */
-bool vm_buf_is_inside_um_private(const struct user_mode_ctx *uctx,
+bool vm_buf_is_inside_um_private(struct user_mode_ctx *uctx,
 				 const void *va, size_t size)
 {
 	struct vm_region *r = NULL;
+	bool ret = false;
 
+	user_mode_ctx_lock(uctx);
 	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
+		if ((vaddr_t)va < r->va)
+			break;
 		if (r->flags & VM_FLAGS_NONPRIV)
 			continue;
-		if (core_is_buffer_inside((vaddr_t)va, size, r->va, r->size))
-			return true;
+		if (core_is_buffer_inside((vaddr_t)va, size, r->va, r->size)) {
+			ret = true;
+			break;
+		}
 	}
+	user_mode_ctx_unlock(uctx);
 
-	return false;
+	return ret;
 }
 
 /* return true only if buffer intersects TA private memory */
-bool vm_buf_intersects_um_private(const struct user_mode_ctx *uctx,
+bool vm_buf_intersects_um_private(struct user_mode_ctx *uctx,
 				  const void *va, size_t size)
 {
 	struct vm_region *r = NULL;
+	bool ret = false;
 
+	user_mode_ctx_lock(uctx);
 	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
 		if (r->attr & VM_FLAGS_NONPRIV)
 			continue;
-		if (core_is_buffer_intersect((vaddr_t)va, size, r->va, r->size))
-			return true;
+		if (core_is_buffer_intersect((vaddr_t)va, size, r->va,
+					     r->size)) {
+			ret = true;
+			break;
+		}
 	}
+	user_mode_ctx_unlock(uctx);
 
-	return false;
+	return ret;
 }
 
-TEE_Result vm_buf_to_mboj_offs(const struct user_mode_ctx *uctx,
+TEE_Result vm_buf_to_mboj_offs(struct user_mode_ctx *uctx,
 			       const void *va, size_t size,
 			       struct mobj **mobj, size_t *offs)
 {
+	TEE_Result res = TEE_ERROR_BAD_PARAMETERS;
 	struct vm_region *r = NULL;
 
+	user_mode_ctx_lock(uctx);
 	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
-		if (!r->mobj)
+		if (!r->mobj || !vm_region_is_visible(r))
 			continue;
 		if (core_is_buffer_inside((vaddr_t)va, size, r->va, r->size)) {
 			size_t poffs;
@@ -1121,11 +1198,13 @@ TEE_Result vm_buf_to_mboj_offs(const struct user_mode_ctx *uctx,
 						   CORE_MMU_USER_PARAM_SIZE);
 			*mobj = r->mobj;
 			*offs = (vaddr_t)va - r->va + r->offset - poffs;
-			return TEE_SUCCESS;
+			res = TEE_SUCCESS;
+			break;
 		}
 	}
+	user_mode_ctx_unlock(uctx);
 
-	return TEE_ERROR_BAD_PARAMETERS;
+	return res;
 }
 
 static TEE_Result tee_mmu_user_va2pa_attr(const struct user_mode_ctx *uctx,
@@ -1134,8 +1213,11 @@ static TEE_Result tee_mmu_user_va2pa_attr(const struct user_mode_ctx *uctx,
 	struct vm_region *region = NULL;
 
 	TAILQ_FOREACH(region, &uctx->vm_info.regions, link) {
+		if ((vaddr_t)ua < region->va)
+			break;
 		if (!core_is_buffer_inside((vaddr_t)ua, 1, region->va,
-					   region->size))
+					   region->size) ||
+		    !vm_region_is_visible(region))
 			continue;
 
 		if (pa) {
@@ -1191,7 +1273,7 @@ TEE_Result vm_pa2va(const struct user_mode_ctx *uctx, paddr_t pa, void **va)
 		size_t ofs = 0;
 
 		/* pa2va is expected only for memory tracked through mobj */
-		if (!region->mobj)
+		if (!region->mobj || !vm_region_is_visible(region))
 			continue;
 
 		/* Physically granulated memory object must be scanned */
@@ -1228,13 +1310,29 @@ TEE_Result vm_pa2va(const struct user_mode_ctx *uctx, paddr_t pa, void **va)
 	return TEE_ERROR_ACCESS_DENIED;
 }
 
-TEE_Result vm_check_access_rights(const struct user_mode_ctx *uctx,
+static bool attr_has_access_rights(uint32_t attr, uint32_t flags)
+{
+	if ((flags & TEE_MEMORY_ACCESS_NONSECURE) && (attr & TEE_MATTR_SECURE))
+		return false;
+
+	if ((flags & TEE_MEMORY_ACCESS_SECURE) && !(attr & TEE_MATTR_SECURE))
+		return false;
+
+	if ((flags & TEE_MEMORY_ACCESS_WRITE) && !(attr & TEE_MATTR_UW))
+		return false;
+	if ((flags & TEE_MEMORY_ACCESS_READ) && !(attr & TEE_MATTR_UR))
+		return false;
+
+	return true;
+}
+
+TEE_Result vm_check_access_rights(struct user_mode_ctx *uctx,
 				  uint32_t flags, uaddr_t uaddr, size_t len)
 {
-	uaddr_t a = 0;
+	TEE_Result res = TEE_ERROR_ACCESS_DENIED;
+	struct vm_region *r = NULL;
 	uaddr_t end_addr = 0;
-	size_t addr_incr = MIN(CORE_MMU_USER_CODE_SIZE,
-			       CORE_MMU_USER_PARAM_SIZE);
+	uaddr_t a = 0;
 
 	if (ADD_OVERFLOW(uaddr, len, &end_addr))
 		return TEE_ERROR_ACCESS_DENIED;
@@ -1251,34 +1349,35 @@ TEE_Result vm_check_access_rights(const struct user_mode_ctx *uctx,
 	   !vm_buf_is_inside_um_private(uctx, (void *)uaddr, len))
 		return TEE_ERROR_ACCESS_DENIED;
 
-	for (a = ROUNDDOWN(uaddr, addr_incr); a < end_addr; a += addr_incr) {
-		uint32_t attr;
-		TEE_Result res;
-
-		res = tee_mmu_user_va2pa_attr(uctx, (void *)a, NULL, &attr);
-		if (res != TEE_SUCCESS)
-			return res;
-
-		if ((flags & TEE_MEMORY_ACCESS_NONSECURE) &&
-		    (attr & TEE_MATTR_SECURE))
-			return TEE_ERROR_ACCESS_DENIED;
-
-		if ((flags & TEE_MEMORY_ACCESS_SECURE) &&
-		    !(attr & TEE_MATTR_SECURE))
-			return TEE_ERROR_ACCESS_DENIED;
-
-		if ((flags & TEE_MEMORY_ACCESS_WRITE) && !(attr & TEE_MATTR_UW))
-			return TEE_ERROR_ACCESS_DENIED;
-		if ((flags & TEE_MEMORY_ACCESS_READ) && !(attr & TEE_MATTR_UR))
-			return TEE_ERROR_ACCESS_DENIED;
+	/*
+	 * Regions are sorted on virtual address, so the range is covered by
+	 * a sequence of adjacent regions, the first one holding @a. Each
+	 * region is checked once regardless of how much of the range it
+	 * covers.
+	 */
+	a = ROUNDDOWN(uaddr, SMALL_PAGE_SIZE);
+	user_mode_ctx_lock(uctx);
+	TAILQ_FOREACH(r, &uctx->vm_info.regions, link) {
+		if (a >= end_addr)
+			break;
+		if (r->va + r->size <= a || !vm_region_is_visible(r))
+			continue;
+		if (r->va > a || !attr_has_access_rights(r->attr, flags))
+			goto out;
+		a = r->va + r->size;
 	}
 
-	return TEE_SUCCESS;
+	if (a >= end_addr)
+		res = TEE_SUCCESS;
+out:
+	user_mode_ctx_unlock(uctx);
+	return res;
 }
 
 void vm_set_ctx(struct ts_ctx *ctx)
 {
 	struct thread_specific_data *tsd = thread_get_tsd();
+	uint64_t t = switch_timestamp();
 
 	core_mmu_set_user_map(NULL);
 	/*
@@ -1287,18 +1386,27 @@ void vm_set_ctx(struct ts_ctx *ctx)
 	 * This function has to be called before there's a chance that
 	 * pgt_free_unlocked() is called.
 	 *
-	 * Save translation tables in a cache if it's a user TA.
+	 * Save translation tables in a cache if it's a user TA. The tables
+	 * of a concurrent TA may hold parameters of this thread which must
+	 * not be picked up by another thread.
 	 */
-	pgt_free(&tsd->pgt_cache, is_user_ta_ctx(tsd->ctx));
+	pgt_free(&tsd->pgt_cache, is_user_ta_ctx(tsd->ctx) &&
+				  !to_user_mode_ctx(tsd->ctx)->concurrent);
+	if (is_user_mode_ctx(tsd->ctx))
+		asid_deactivate(&to_user_mode_ctx(tsd->ctx)->vm_info);
 
 	if (is_user_mode_ctx(ctx)) {
 		struct core_mmu_user_map map = { };
 		struct user_mode_ctx *uctx = to_user_mode_ctx(ctx);
 
+		asid_activate(&uctx->vm_info);
+		user_mode_ctx_lock(uctx);
 		core_mmu_create_user_map(uctx, &map);
+		user_mode_ctx_unlock(uctx);
 		core_mmu_set_user_map(&map);
 		tee_pager_assign_um_tables(uctx);
 	}
 	tsd->ctx = ctx;
+	incr_switch_stats(t);
 }
 
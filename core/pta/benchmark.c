@@ -2,11 +2,13 @@
 /*
  * Copyright (c) 2017, Linaro Limited
  */
+#include <arm.h>
 #include <bench.h>
 #include <compiler.h>
 #include <kernel/misc.h>
 #include <kernel/mutex.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/thread.h>
 #include <malloc.h>
 #include <mm/core_memprot.h>
 #include <mm/mobj.h>
@@ -19,6 +21,7 @@
 #include <string_ext.h>
 #include <string.h>
 #include <trace.h>
+#include <util.h>
 
 #define TA_NAME		"benchmark.ta"
 #define TA_PRINT_PREFIX	"Benchmark: "
@@ -159,6 +162,63 @@ static TEE_Result unregister_benchmark(uint32_t type,
 	return res;
 }
 
+static uint32_t ticks_to_ns(uint64_t ticks)
+{
+	return MIN(ticks * 1000000000 / read_cntfrq(), (uint64_t)UINT32_MAX);
+}
+
+/* Returns the upper bound in nanoseconds of the @pct percentile */
+static uint32_t lat_percentile_ns(struct thread_entry_stats *st,
+				  uint64_t count, unsigned int pct)
+{
+	uint64_t target = (count * pct + 99) / 100;
+	uint64_t sum = 0;
+	size_t n = 0;
+
+	for (n = 0; n < THREAD_ENTRY_LAT_BUCKETS - 1; n++) {
+		sum += st->lat_hist[n];
+		if (sum >= target)
+			return ticks_to_ns(n);
+	}
+
+	return ticks_to_ns(st->lat_max);
+}
+
+static TEE_Result get_entry_latency(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	struct thread_entry_stats st = { };
+	uint64_t count = 0;
+	size_t n = 0;
+
+	if (type != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	thread_get_entry_stats(&st);
+	for (n = 0; n < THREAD_ENTRY_LAT_BUCKETS; n++)
+		count += st.lat_hist[n];
+
+	if (count) {
+		p[0].value.a = lat_percentile_ns(&st, count, 50);
+		p[0].value.b = lat_percentile_ns(&st, count, 90);
+		p[1].value.a = lat_percentile_ns(&st, count, 99);
+		p[1].value.b = ticks_to_ns(st.lat_max);
+	} else {
+		p[0].value.a = 0;
+		p[0].value.b = 0;
+		p[1].value.a = 0;
+		p[1].value.b = 0;
+	}
+	p[2].value.a = MIN(count, (uint64_t)UINT32_MAX);
+	p[2].value.b = st.last_thread_hits;
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result invoke_command(void *session_ctx __unused,
 		uint32_t cmd_id, uint32_t param_types,
 		TEE_Param params[TEE_NUM_PARAMS])
@@ -170,6 +230,8 @@ static TEE_Result invoke_command(void *session_ctx __unused,
 		return get_benchmark_memref(param_types, params);
 	case BENCHMARK_CMD_UNREGISTER:
 		return unregister_benchmark(param_types, params);
+	case BENCHMARK_CMD_GET_ENTRY_LATENCY:
+		return get_entry_latency(param_types, params);
 	default:
 		break;
 	}
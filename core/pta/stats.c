@@ -5,10 +5,16 @@
 #include <compiler.h>
 #include <stdio.h>
 #include <trace.h>
+#include <kernel/mutex.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/ts_store.h>
+#include <mm/core_mmu.h>
+#include <mm/pgt_cache.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
+#include <mm/vm.h>
 #include <string.h>
+#include <tee/tee_fs.h>
 #include <string_ext.h>
 #include <malloc.h>
 
@@ -21,6 +27,11 @@
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
 #define STATS_CMD_MEMLEAK_STATS		2
+#define STATS_CMD_RPMB_STATS		3
+#define STATS_CMD_TA_CACHE_STATS	4
+#define STATS_CMD_PAGER_SAVE_STATS	5
+#define STATS_CMD_VM_STATS		6
+#define STATS_CMD_MUTEX_STATS		7
 
 #define STATS_NB_POOLS			4
 
@@ -104,12 +115,23 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
 	struct tee_pager_stats stats;
+	bool with_faults = false;
 
+	/*
+	 * p[3] is optional, if supplied:
+	 * p[3].value.a = replacement policy, TEE_PAGER_POLICY_*
+	 * p[3].value.b = number of faults handled by the pager
+	 */
 	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_NONE) != type) {
-		EMSG("expect 3 output values as argument");
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) == type) {
+		with_faults = true;
+	} else if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+				   TEE_PARAM_TYPE_VALUE_OUTPUT,
+				   TEE_PARAM_TYPE_VALUE_OUTPUT,
+				   TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 3 or 4 output values as argument");
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
@@ -120,6 +142,78 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	p[1].value.b = stats.rw_hits;
 	p[2].value.a = stats.hidden_hits;
 	p[2].value.b = stats.zi_released;
+	if (with_faults) {
+		p[3].value.a = stats.policy;
+		p[3].value.b = stats.faults;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_pager_save_stats(uint32_t type,
+				       TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_stats stats = { };
+
+	/*
+	 * p[0].value.a = number of read/write pages saved
+	 * p[0].value.b = number of those which were same-filled and thus
+	 *		  not encrypted nor stored
+	 * p[1].value.a = microseconds spent saving pages
+	 *
+	 * Note that the other pager statistics are reset too.
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_pager_get_stats(&stats);
+	p[0].value.a = stats.rw_saved;
+	p[0].value.b = stats.rw_same_filled;
+	p[1].value.a = stats.save_us;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_vm_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct vm_switch_stats switch_stats = { };
+	struct pgt_cache_stats pgt_stats = { };
+
+	/*
+	 * p[0].value.a = number of user mode context switches
+	 * p[0].value.b = average context switch time in nanoseconds
+	 * p[1].value.a = number of page tables handed out
+	 * p[1].value.b = number of those still valid from the page table
+	 *		  cache
+	 * p[2].value.a = number of page tables currently allocated
+	 * p[2].value.b = max number of page tables allocated since boot
+	 * p[3].value.a = number of times a thread waited for page tables
+	 * p[3].value.b = number of ASID rollovers since boot
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	vm_get_switch_stats(&switch_stats);
+	pgt_get_stats(&pgt_stats);
+
+	p[0].value.a = switch_stats.switches;
+	p[0].value.b = 0;
+	if (switch_stats.switches)
+		p[0].value.b = (switch_stats.switch_us * 1000) /
+			       switch_stats.switches;
+	p[1].value.a = pgt_stats.allocs;
+	p[1].value.b = pgt_stats.hits;
+	p[2].value.a = pgt_stats.num_tables;
+	p[2].value.b = pgt_stats.max_tables;
+	p[3].value.a = pgt_stats.waits;
+	p[3].value.b = asid_get_rollovers();
 
 	return TEE_SUCCESS;
 }
@@ -137,6 +231,86 @@ static TEE_Result get_memleak_stats(uint32_t type,
 	return TEE_SUCCESS;
 }
 
+static TEE_Result get_rpmb_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_rpmb_fs_stats stats = { };
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = number of data frames written
+	 * p[1].value.b = number of write requests
+	 * p[2].value.a = number of bytes written
+	 * p[2].value.b = bytes per second while writing
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_rpmb_fs_get_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.frames;
+	p[1].value.b = stats.requests;
+	p[2].value.a = stats.bytes;
+	p[2].value.b = 0;
+	if (stats.time_us)
+		p[2].value.b = (stats.bytes * 1000000) / stats.time_us;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_ta_cache_stats(uint32_t type,
+				     TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct ree_fs_ta_cache_stats stats = { };
+
+	/*
+	 * p[0].value.a = number of TA loads served from the cache
+	 * p[0].value.b = number of TA loads from normal world
+	 * p[1].value.a = number of TAs currently cached
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	ree_fs_ta_get_cache_stats(&stats);
+	p[0].value.a = stats.hits;
+	p[0].value.b = stats.misses;
+	p[1].value.a = stats.entries;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_mutex_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct mutex_stats stats = { };
+
+	/*
+	 * p[0].value.a = number of contended lock calls
+	 * p[0].value.b = number of those that spun on a running owner
+	 * p[1].value.a = number of sleeps in normal world
+	 *
+	 * The statistics are reset and the most contended mutexes are
+	 * printed on the secure console.
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	mutex_get_stats(&stats);
+	p[0].value.a = stats.contended;
+	p[0].value.b = stats.spun;
+	p[1].value.a = stats.slept;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
 /*
  * Trusted Application Entry Points
  */
@@ -152,6 +326,16 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_alloc_stats(ptypes, params);
 	case STATS_CMD_MEMLEAK_STATS:
 		return get_memleak_stats(ptypes, params);
+	case STATS_CMD_RPMB_STATS:
+		return get_rpmb_stats(ptypes, params);
+	case STATS_CMD_TA_CACHE_STATS:
+		return get_ta_cache_stats(ptypes, params);
+	case STATS_CMD_PAGER_SAVE_STATS:
+		return get_pager_save_stats(ptypes, params);
+	case STATS_CMD_VM_STATS:
+		return get_vm_stats(ptypes, params);
+	case STATS_CMD_MUTEX_STATS:
+		return get_mutex_stats(ptypes, params);
 	default:
 		break;
 	}
@@ -299,13 +299,10 @@ static TEE_Result open_session(uint32_t param_types __unused,
 	return TEE_SUCCESS;
 }
 
-static TEE_Result invoke_command(void *sess_ctx __unused, uint32_t cmd_id,
-				 uint32_t param_types,
-				 TEE_Param params[TEE_NUM_PARAMS])
+static TEE_Result do_invoke_command(struct user_mode_ctx *uctx,
+				    uint32_t cmd_id, uint32_t param_types,
+				    TEE_Param params[TEE_NUM_PARAMS])
 {
-	struct ts_session *s = ts_get_calling_session();
-	struct user_mode_ctx *uctx = to_user_mode_ctx(s->ctx);
-
 	switch (cmd_id) {
 	case PTA_SYSTEM_ADD_RNG_ENTROPY:
 		return system_rng_reseed(param_types, params);
@@ -328,6 +325,41 @@ static TEE_Result invoke_command(void *sess_ctx __unused, uint32_t cmd_id,
 	return TEE_ERROR_NOT_IMPLEMENTED;
 }
 
+static TEE_Result invoke_command(void *sess_ctx __unused, uint32_t cmd_id,
+				 uint32_t param_types,
+				 TEE_Param params[TEE_NUM_PARAMS])
+{
+	struct ts_session *s = ts_get_calling_session();
+	struct user_mode_ctx *uctx = to_user_mode_ctx(s->ctx);
+	TEE_Result res = TEE_SUCCESS;
+
+	switch (cmd_id) {
+	case PTA_SYSTEM_MAP_ZI:
+	case PTA_SYSTEM_UNMAP:
+	case PTA_SYSTEM_DLOPEN:
+		/*
+		 * The page tables of other threads executing in a
+		 * concurrent TA aren't updated, the memory map can only be
+		 * changed while the calling thread is alone in the TA.
+		 */
+		res = user_mode_ctx_lock_exclusive(uctx);
+		if (res)
+			return res;
+		break;
+	case PTA_SYSTEM_DLSYM:
+		/* ldelf has a single stack */
+		user_mode_ctx_lock(uctx);
+		break;
+	default:
+		return do_invoke_command(uctx, cmd_id, param_types, params);
+	}
+
+	res = do_invoke_command(uctx, cmd_id, param_types, params);
+	user_mode_ctx_unlock(uctx);
+
+	return res;
+}
+
 pseudo_ta_register(.uuid = PTA_SYSTEM_UUID, .name = "system.pta",
 		   .flags = PTA_DEFAULT_FLAGS | TA_FLAG_CONCURRENT,
 		   .open_session_entry_point = open_session,
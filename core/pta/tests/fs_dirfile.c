@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <tee/fs_dirfile.h>
+#include <trace.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+/*
+ * The dirfile is stored in a buffer supplied by the caller, the core heap
+ * is normally too small to hold the directory entries of several thousand
+ * objects.
+ */
+struct test_file {
+	uint8_t *data;
+	size_t data_len;
+	size_t data_alloced;
+};
+
+static struct test_file test_file;
+
+static TEE_Result test_open(bool create, uint8_t *hash __unused,
+			    const TEE_UUID *uuid __unused,
+			    struct tee_fs_dirfile_fileh *dfh __unused,
+			    struct tee_file_handle **fh)
+{
+	if (create)
+		test_file.data_len = 0;
+	*fh = (struct tee_file_handle *)&test_file;
+
+	return TEE_SUCCESS;
+}
+
+static void test_close(struct tee_file_handle *fh __unused)
+{
+}
+
+static TEE_Result test_read(struct tee_file_handle *fh, size_t pos,
+			    void *buf, size_t *len)
+{
+	struct test_file *f = (struct test_file *)fh;
+
+	if (pos >= f->data_len)
+		*len = 0;
+	else
+		*len = MIN(*len, f->data_len - pos);
+	memcpy(buf, f->data + pos, *len);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result test_write(struct tee_file_handle *fh, size_t pos,
+			     const void *buf, size_t len)
+{
+	struct test_file *f = (struct test_file *)fh;
+	size_t end = 0;
+
+	if (ADD_OVERFLOW(pos, len, &end) || end > f->data_alloced) {
+		EMSG("out of bounds, buffer is %zu bytes", f->data_alloced);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	memcpy(f->data + pos, buf, len);
+	if (end > f->data_len)
+		f->data_len = end;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result test_commit_writes(struct tee_file_handle *fh __unused,
+				     uint8_t *hash __unused)
+{
+	return TEE_SUCCESS;
+}
+
+static const struct tee_fs_dirfile_operations test_dirf_ops = {
+	.open = test_open,
+	.close = test_close,
+	.read = test_read,
+	.write = test_write,
+	.commit_writes = test_commit_writes,
+};
+
+static const TEE_UUID test_uuid = {
+	0x8aaaf200, 0x2450, 0x11e4,
+	{ 0xab, 0xe2, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b }
+};
+
+static size_t test_oid(char *oid, size_t len, size_t n)
+{
+	int r = snprintf(oid, len, "test-object-%zu", n);
+
+	assert(r > 0 && (size_t)r < len);
+	return r;
+}
+
+static TEE_Result populate(size_t num_objs)
+{
+	struct tee_fs_dirfile_dirh *dirh = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	char oid[32] = { };
+	size_t oidlen = 0;
+	size_t n = 0;
+
+	res = tee_fs_dirfile_open(true, NULL, &test_dirf_ops, &dirh);
+	if (res)
+		return res;
+
+	for (n = 0; n < num_objs; n++) {
+		struct tee_fs_dirfile_fileh dfh = { };
+
+		res = tee_fs_dirfile_get_tmp(dirh, &dfh);
+		if (res)
+			goto out;
+		dfh.idx = -1;
+		oidlen = test_oid(oid, sizeof(oid), n);
+		res = tee_fs_dirfile_rename(dirh, &test_uuid, &dfh, oid,
+					    oidlen);
+		if (res)
+			goto out;
+	}
+
+	res = tee_fs_dirfile_commit_writes(dirh, NULL);
+out:
+	tee_fs_dirfile_close(dirh);
+	return res;
+}
+
+TEE_Result core_fs_dirfile_perf_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_MEMREF_INOUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	struct tee_fs_dirfile_dirh *dirh = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t open_ns = 0;
+	uint64_t find_ns = 0;
+	size_t num_objs = 0;
+	uint64_t t = 0;
+	char oid[32] = { };
+	size_t oidlen = 0;
+	size_t n = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_objs = params[0].value.a;
+	if (!num_objs)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	test_file.data = params[1].memref.buffer;
+	test_file.data_alloced = params[1].memref.size;
+
+	res = populate(num_objs);
+	if (res)
+		goto out;
+
+	t = test_timestamp();
+	res = tee_fs_dirfile_open(false, NULL, &test_dirf_ops, &dirh);
+	open_ns = test_elapsed_ns(t);
+	if (res)
+		goto out;
+
+	t = test_timestamp();
+	for (n = 0; n < num_objs; n++) {
+		struct tee_fs_dirfile_fileh dfh = { };
+
+		oidlen = test_oid(oid, sizeof(oid), n);
+		res = tee_fs_dirfile_find(dirh, &test_uuid, oid, oidlen, &dfh);
+		if (res) {
+			EMSG("object %zu not found", n);
+			goto out;
+		}
+	}
+	find_ns = test_elapsed_ns(t);
+
+	IMSG("dirfile with %zu objects: open %" PRIu64 " us, find %" PRIu64
+	     " ns/object", num_objs, open_ns / 1000, find_ns / num_objs);
+
+	params[2].value.a = open_ns / 1000;
+	params[2].value.b = find_ns / num_objs;
+out:
+	tee_fs_dirfile_close(dirh);
+	test_file.data = NULL;
+	test_file.data_alloced = 0;
+	return res;
+}
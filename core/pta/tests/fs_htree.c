@@ -20,11 +20,16 @@
  */
 #define TEST_BLOCK_SIZE		144
 
+/* Small enough to need several vectored writes for a few blocks */
+#define TEST_WRITEV_BUF_SIZE	1024
+
 struct test_aux {
 	uint8_t *data;
 	size_t data_len;
 	size_t data_alloced;
 	uint8_t *block;
+	struct tee_fs_rpc_writev wv;
+	size_t num_rpc;
 };
 
 static TEE_Result test_get_offs_size(enum tee_fs_htree_type type, size_t idx,
@@ -122,6 +127,8 @@ static TEE_Result test_read_final(struct tee_fs_rpc_operation *op,
 	size_t offs = op->params[0].u.value.b;
 	size_t sz = op->params[0].u.value.c;
 
+	a->num_rpc++;
+
 	if (offs + sz <= a->data_len)
 		*bytes = sz;
 	else if (offs <= a->data_len)
@@ -140,11 +147,9 @@ static TEE_Result test_write_init(void *aux, struct tee_fs_rpc_operation *op,
 	return test_read_init(aux, op, type, idx, vers, data);
 }
 
-static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
+static TEE_Result test_write_data(struct test_aux *a, size_t offs,
+				  const void *data, size_t sz)
 {
-	struct test_aux *a = uint_to_ptr(op->params[0].u.value.a);
-	size_t offs = op->params[0].u.value.b;
-	size_t sz = op->params[0].u.value.c;
 	size_t end = offs + sz;
 
 	if (end > a->data_alloced) {
@@ -152,11 +157,19 @@ static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
 		return TEE_ERROR_GENERIC;
 	}
 
-	memcpy(a->data + offs, a->block, sz);
+	memcpy(a->data + offs, data, sz);
 	if (end > a->data_len)
 		a->data_len = end;
 	return TEE_SUCCESS;
+}
 
+static TEE_Result test_write_final(struct tee_fs_rpc_operation *op)
+{
+	struct test_aux *a = uint_to_ptr(op->params[0].u.value.a);
+
+	a->num_rpc++;
+	return test_write_data(a, op->params[0].u.value.b, a->block,
+			       op->params[0].u.value.c);
 }
 
 static const struct tee_fs_htree_storage test_htree_ops = {
@@ -167,6 +180,79 @@ static const struct tee_fs_htree_storage test_htree_ops = {
 	.rpc_write_final = test_write_final,
 };
 
+/*
+ * Stands in for the handling of OPTEE_RPC_FS_WRITEV in normal world: the
+ * extents collected by test_writev_write_init() are written one after
+ * another.
+ */
+static TEE_Result test_writev_flush(void *aux)
+{
+	struct test_aux *a = aux;
+	struct tee_fs_rpc_extent ext = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t pos = 0;
+	uint32_t n = 0;
+
+	if (!a->wv.num_extents)
+		return TEE_SUCCESS;
+
+	a->num_rpc++;
+	for (n = 0; n < a->wv.num_extents; n++) {
+		memcpy(&ext, a->wv.buf + pos, sizeof(ext));
+		pos += sizeof(ext);
+		res = test_write_data(a, ext.offset, a->wv.buf + pos,
+				      ext.length);
+		if (res)
+			break;
+		pos = ROUNDUP(pos + ext.length, sizeof(uint64_t));
+	}
+
+	a->wv.used = 0;
+	a->wv.num_extents = 0;
+	return res;
+}
+
+static TEE_Result test_writev_write_init(void *aux,
+					 struct tee_fs_rpc_operation *op,
+					 enum tee_fs_htree_type type,
+					 size_t idx, uint8_t vers, void **data)
+{
+	TEE_Result res;
+	struct test_aux *a = aux;
+	size_t offs;
+	size_t sz;
+
+	res = test_get_offs_size(type, idx, vers, &offs, &sz);
+	if (res)
+		return res;
+
+	memset(op, 0, sizeof(*op));
+	res = tee_fs_rpc_writev_add(&a->wv, offs, sz, data);
+	if (res == TEE_ERROR_SHORT_BUFFER) {
+		res = test_writev_flush(aux);
+		if (res)
+			return res;
+		res = tee_fs_rpc_writev_add(&a->wv, offs, sz, data);
+	}
+
+	return res;
+}
+
+static TEE_Result test_writev_write_final(struct tee_fs_rpc_operation *op
+					  __unused)
+{
+	return TEE_SUCCESS;
+}
+
+static const struct tee_fs_htree_storage test_htree_writev_ops = {
+	.block_size = TEST_BLOCK_SIZE,
+	.rpc_read_init = test_read_init,
+	.rpc_read_final = test_read_final,
+	.rpc_write_init = test_writev_write_init,
+	.rpc_write_final = test_writev_write_final,
+	.rpc_write_flush = test_writev_flush,
+};
+
 #define CHECK_RES(res, cleanup)						\
 		do {							\
 			TEE_Result _res = (res);			\
@@ -397,6 +483,7 @@ static void aux_free(struct test_aux *aux)
 	if (aux) {
 		free(aux->data);
 		free(aux->block);
+		free(aux->wv.buf);
 		free(aux);
 	}
 }
@@ -423,6 +510,11 @@ static struct test_aux *aux_alloc(size_t num_blocks)
 	if (!aux->block)
 		goto err;
 
+	aux->wv.buf_size = TEST_WRITEV_BUF_SIZE;
+	aux->wv.buf = malloc(aux->wv.buf_size);
+	if (!aux->wv.buf)
+		goto err;
+
 	return aux;
 err:
 	aux_free(aux);
@@ -607,6 +699,69 @@ out:
 	return res;
 }
 
+/*
+ * Syncs the same hash tree once with an RPC per element and once with
+ * vectored writes, the latter must need fewer RPCs and leave a hash tree
+ * which reads back as expected.
+ */
+static TEE_Result test_writev(size_t num_blocks)
+{
+	struct ts_session *sess = ts_get_current_session();
+	const TEE_UUID *uuid = &sess->ctx->uuid;
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_fs_htree *ht = NULL;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE] = { 0 };
+	struct test_aux *aux = NULL;
+	size_t num_rpc = 0;
+
+	aux = aux_alloc(num_blocks);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	aux->data_len = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+	num_rpc = aux->num_rpc;
+
+	aux->data_len = 0;
+	aux->num_rpc = 0;
+	memset(aux->data, 0xce, aux->data_alloced);
+	res = tee_fs_htree_open(true, hash, uuid, &test_htree_writev_ops, aux,
+				&ht);
+	CHECK_RES(res, goto out);
+	res = do_range(write_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	tee_fs_htree_close(&ht);
+
+	DMSG("%zu blocks written with %zu RPCs, %zu RPCs with vectored writes",
+	     num_blocks, num_rpc, aux->num_rpc);
+	if (aux->num_rpc >= num_rpc) {
+		EMSG("error: vectored writes didn't reduce the number of RPCs");
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+	res = do_range(read_block, &ht, 0, num_blocks, 1);
+	CHECK_RES(res, goto out);
+
+out:
+	tee_fs_htree_close(&ht);
+	aux_free(aux);
+	if (res == TEE_ERROR_TIME_NOT_SET)
+		res = TEE_ERROR_SECURITY;
+	return res;
+}
+
 TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 			       TEE_Param pParams[TEE_NUM_PARAMS] __unused)
 {
@@ -619,5 +774,9 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 	if (res)
 		return res;
 
+	res = test_writev(10);
+	if (res)
+		return res;
+
 	return test_corrupt(5);
 }
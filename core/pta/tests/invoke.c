@@ -4,9 +4,11 @@
  */
 
 #include <compiler.h>
+#include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/pseudo_ta.h>
 #include <kernel/tee_ta_manager.h>
+#include <kernel/tee_time.h>
 #include <kernel/ts_manager.h>
 #include <mm/core_memprot.h>
 #include <pta_invoke_tests.h>
@@ -379,6 +381,58 @@ static TEE_Result test_dump_sdp(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
  * Trusted Application Entry Points
  */
 
+static struct mutex rendezvous_mu = MUTEX_INITIALIZER;
+static size_t rendezvous_count;
+static unsigned int rendezvous_gen;
+
+/*
+ * Returns once @p[0].value.a callers are in this function at the same
+ * time, or with TEE_ERROR_BUSY after @p[0].value.b milliseconds. Used to
+ * check that sessions of a concurrent TA execute in parallel.
+ */
+static TEE_Result test_rendezvous(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int gen = 0;
+	uint32_t ms = 0;
+
+	if (type != exp_pt || !p[0].value.a)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	mutex_lock(&rendezvous_mu);
+	gen = rendezvous_gen;
+	rendezvous_count++;
+	if (rendezvous_count >= p[0].value.a) {
+		rendezvous_count = 0;
+		rendezvous_gen++;
+		mutex_unlock(&rendezvous_mu);
+		return TEE_SUCCESS;
+	}
+	mutex_unlock(&rendezvous_mu);
+
+	while (true) {
+		tee_time_wait(1);
+		ms++;
+
+		mutex_lock(&rendezvous_mu);
+		if (rendezvous_gen != gen)
+			break;
+		if (ms >= p[0].value.b) {
+			rendezvous_count--;
+			res = TEE_ERROR_BUSY;
+			break;
+		}
+		mutex_unlock(&rendezvous_mu);
+	}
+	mutex_unlock(&rendezvous_mu);
+
+	return res;
+}
+
 static TEE_Result create_ta(void)
 {
 	DMSG("create entry point for pseudo TA \"%s\"", TA_NAME);
@@ -434,6 +488,20 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 		return core_lockdep_tests(nParamTypes, pParams);
 	case PTA_INVOKE_TEST_CMD_AES_PERF:
 		return core_aes_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_FS_DIRFILE_PERF:
+		return core_fs_dirfile_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MALLOC_PERF:
+		return core_malloc_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_REE_FS_PERF:
+		return core_ree_fs_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_PAGER_SAVE_PERF:
+		return core_pager_save_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_VM_ACCESS_PERF:
+		return core_vm_access_perf_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_VM_PRIVATE_PAGE:
+		return core_vm_private_page_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_RENDEZVOUS:
+		return test_rendezvous(nParamTypes, pParams);
 	default:
 		break;
 	}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <malloc.h>
+#include <tee_api_defines.h>
+#include <tee_api_types.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "misc.h"
+
+/* Number of buffers kept allocated at the same time */
+#define NUM_BUFS	16
+
+/* Deterministic sequence of allocation sizes, a simple LCG is enough */
+static uint32_t next_size(uint32_t *seed, size_t max_size)
+{
+	*seed = *seed * 1664525 + 1013904223;
+
+	return (*seed >> 8) % max_size + 1;
+}
+
+TEE_Result core_malloc_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+	void *bufs[NUM_BUFS] = { NULL };
+	TEE_Result res = TEE_SUCCESS;
+	size_t iterations = 0;
+	size_t max_size = 0;
+	uint32_t seed = 0;
+	uint64_t ns = 0;
+	uint64_t t = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	iterations = params[0].value.a;
+	max_size = params[0].value.b;
+	if (!iterations || !max_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* Different seeds for concurrent invocations */
+	seed = (vaddr_t)bufs;
+
+	t = test_timestamp();
+	for (n = 0; n < iterations; n++) {
+		m = n % NUM_BUFS;
+		free(bufs[m]);
+		bufs[m] = malloc(next_size(&seed, max_size));
+		if (!bufs[m]) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			break;
+		}
+	}
+	ns = test_elapsed_ns(t);
+
+	for (m = 0; m < NUM_BUFS; m++)
+		free(bufs[m]);
+
+	if (res)
+		return res;
+
+	DMSG("%zu malloc/free pairs of max %zu bytes: %" PRIu64 " ns/pair",
+	     iterations, max_size, ns / iterations);
+	params[1].value.a = ns / iterations;
+
+	return TEE_SUCCESS;
+}
@@ -5,10 +5,25 @@
 #ifndef CORE_PTA_TESTS_MISC_H
 #define CORE_PTA_TESTS_MISC_H
 
+#include <arm.h>
 #include <compiler.h>
 #include <tee_api_types.h>
 #include <tee_api_defines.h>
 
+/* Timestamp in counter ticks, to be passed to test_elapsed_ns() */
+static inline uint64_t test_timestamp(void)
+{
+	return barrier_read_cntpct();
+}
+
+/* Nanoseconds elapsed since @start was returned by test_timestamp() */
+static inline uint64_t test_elapsed_ns(uint64_t start)
+{
+	uint64_t cnt = barrier_read_cntpct() - start;
+
+	return (cnt * 1000000) / (read_cntfrq() / 1000);
+}
+
 /* basic run-time tests */
 TEE_Result core_self_tests(uint32_t nParamTypes,
 			   TEE_Param pParams[TEE_NUM_PARAMS]);
@@ -34,4 +49,61 @@ static inline TEE_Result core_lockdep_tests(
 TEE_Result core_aes_perf_tests(uint32_t param_types,
 			       TEE_Param params[TEE_NUM_PARAMS]);
 
+TEE_Result core_malloc_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS]);
+
+#ifdef CFG_REE_FS
+TEE_Result core_fs_dirfile_perf_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS]);
+TEE_Result core_ree_fs_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS]);
+#else
+static inline TEE_Result core_fs_dirfile_perf_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+
+static inline TEE_Result core_ree_fs_perf_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif
+
+#ifdef CFG_WITH_PAGER
+TEE_Result core_pager_save_perf_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS]);
+#else
+static inline TEE_Result core_pager_save_perf_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif
+
+#ifdef CFG_WITH_USER_TA
+TEE_Result core_vm_access_perf_tests(uint32_t param_types,
+				     TEE_Param params[TEE_NUM_PARAMS]);
+TEE_Result core_vm_private_page_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS]);
+#else
+static inline TEE_Result core_vm_access_perf_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+
+static inline TEE_Result core_vm_private_page_tests(
+		uint32_t param_types __unused,
+		TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+#endif
+
 #endif /*CORE_PTA_TESTS_MISC_H*/
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <malloc.h>
+#include <mm/fobj.h>
+#include <tee_api_defines.h>
+#include <tee_api_types.h>
+#include <trace.h>
+#include <types_ext.h>
+#include <util.h>
+
+#include "misc.h"
+
+static uint64_t pages_per_sec(size_t num_pages, uint64_t ns)
+{
+	if (!ns)
+		return 0;
+
+	return num_pages * 1000000000ULL / ns;
+}
+
+static TEE_Result save_single(struct fobj *fobj, size_t rounds,
+			      const void *va, uint64_t *ns)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t t = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	t = test_timestamp();
+	for (n = 0; n < rounds; n++) {
+		for (m = 0; m < fobj->num_pages; m++) {
+			res = fobj_save_page(fobj, m, va);
+			if (res)
+				return res;
+		}
+	}
+	*ns = test_elapsed_ns(t);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result save_batched(struct fobj *fobj, size_t rounds,
+			       const void *va, uint64_t *ns)
+{
+	struct fobj_page pages[FOBJ_SAVE_BATCH_MAX] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t num_pages = 0;
+	uint64_t t = 0;
+	size_t n = 0;
+	size_t m = 0;
+	size_t k = 0;
+
+	t = test_timestamp();
+	for (n = 0; n < rounds; n++) {
+		for (m = 0; m < fobj->num_pages; m += num_pages) {
+			num_pages = MIN(fobj->num_pages - m,
+					(size_t)FOBJ_SAVE_BATCH_MAX);
+			for (k = 0; k < num_pages; k++) {
+				pages[k].fobj = fobj;
+				pages[k].page_idx = m + k;
+				pages[k].va = va;
+			}
+			res = fobj_save_pages(pages, num_pages);
+			if (res)
+				return res;
+		}
+	}
+	*ns = test_elapsed_ns(t);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_pager_save_perf_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+	TEE_Result res = TEE_SUCCESS;
+	struct fobj *fobj = NULL;
+	uint64_t single_ns = 0;
+	uint64_t batch_ns = 0;
+	size_t num_pages = 0;
+	size_t rounds = 0;
+	size_t total = 0;
+	uint8_t *va = NULL;
+	size_t n = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_pages = params[0].value.a;
+	rounds = params[0].value.b;
+	if (!num_pages || !rounds ||
+	    MUL_OVERFLOW(num_pages, rounds, &total))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	va = malloc(SMALL_PAGE_SIZE);
+	if (!va)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	/* Not same-filled, the page must be encrypted each time */
+	for (n = 0; n < SMALL_PAGE_SIZE; n++)
+		va[n] = n;
+
+	fobj = fobj_rw_paged_alloc(num_pages);
+	if (!fobj) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	res = save_single(fobj, rounds, va, &single_ns);
+	if (res)
+		goto out;
+	res = save_batched(fobj, rounds, va, &batch_ns);
+	if (res)
+		goto out;
+
+	IMSG("%zu pages saved: %" PRIu64 " pages/s one at a time, %" PRIu64
+	     " pages/s in batches of %d", total,
+	     pages_per_sec(total, single_ns),
+	     pages_per_sec(total, batch_ns), FOBJ_SAVE_BATCH_MAX);
+
+	params[1].value.a = pages_per_sec(total, single_ns);
+	params[1].value.b = pages_per_sec(total, batch_ns);
+out:
+	fobj_put(fobj);
+	free(va);
+	return res;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <malloc.h>
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_pobj.h>
+#include <trace.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+static const TEE_UUID test_uuid = {
+	0x8aaaf200, 0x2450, 0x11e4,
+	{ 0xab, 0xe2, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b }
+};
+
+static const char test_obj_id[] = "ree_fs_perf";
+
+/* Appends @count writes of @len bytes each to the file at @pos */
+static TEE_Result write_seq(struct tee_file_handle *fh, size_t *pos,
+			    const void *buf, size_t len, size_t count,
+			    uint64_t *ns)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t t = test_timestamp();
+	size_t n = 0;
+
+	for (n = 0; n < count; n++) {
+		res = ree_fs_ops.write(fh, *pos, buf, len);
+		if (res)
+			return res;
+		*pos += len;
+	}
+	*ns = test_elapsed_ns(t);
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result core_ree_fs_perf_tests(uint32_t param_types,
+				  TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_MEMREF_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	struct tee_pobj po = {
+		.uuid = test_uuid,
+		.obj_id = (void *)test_obj_id,
+		.obj_id_len = sizeof(test_obj_id),
+		.fops = &ree_fs_ops,
+	};
+	struct tee_file_handle *fh = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	uint8_t *small_buf = NULL;
+	size_t small_len = 0;
+	uint64_t small_ns = 0;
+	uint64_t large_ns = 0;
+	size_t count = 0;
+	size_t pos = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	count = params[0].value.a;
+	small_len = params[0].value.b;
+	if (!count || !small_len || !params[1].memref.size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	small_buf = malloc(small_len);
+	if (!small_buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memset(small_buf, 0xa5, small_len);
+
+	res = ree_fs_ops.create(&po, true, NULL, 0, NULL, 0, NULL, 0, &fh);
+	if (res)
+		goto out;
+
+	res = write_seq(fh, &pos, small_buf, small_len, count, &small_ns);
+	if (res)
+		goto out_close;
+
+	res = write_seq(fh, &pos, params[1].memref.buffer,
+			params[1].memref.size, count, &large_ns);
+	if (res)
+		goto out_close;
+
+	IMSG("%zu writes of %zu bytes: %" PRIu64 " us, of %" PRIu32
+	     " bytes: %" PRIu64 " us", count, small_len, small_ns / 1000,
+	     params[1].memref.size, large_ns / 1000);
+
+	params[2].value.a = small_ns / 1000;
+	params[2].value.b = large_ns / 1000;
+
+out_close:
+	ree_fs_ops.close(&fh);
+	if (ree_fs_ops.remove(&po) && !res)
+		res = TEE_ERROR_GENERIC;
+out:
+	free(small_buf);
+	return res;
+}
@@ -1,4 +1,6 @@
 srcs-$(CFG_WITH_USER_TA) += fs_htree.c
+srcs-$(CFG_REE_FS) += fs_dirfile.c
+srcs-$(CFG_REE_FS) += ree_fs_perf.c
 srcs-y += interrupt.c
 srcs-y += invoke.c
 srcs-$(CFG_LOCKDEP) += lockdep.c
@@ -6,3 +8,7 @@ srcs-y += misc.c
 cflags-misc.c-y += -fno-builtin
 srcs-y += mutex.c
 srcs-y += aes_perf.c
+srcs-y += malloc_perf.c
+srcs-$(CFG_WITH_PAGER) += pager_save_perf.c
+srcs-$(CFG_WITH_USER_TA) += vm_access_perf.c
+srcs-$(CFG_WITH_USER_TA) += vm_private_page.c
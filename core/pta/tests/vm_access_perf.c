@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <kernel/ts_manager.h>
+#include <kernel/user_mode_ctx.h>
+#include <mm/vm.h>
+#include <tee_api_defines.h>
+#include <tee_api_types.h>
+#include <trace.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+TEE_Result core_vm_access_perf_tests(uint32_t param_types,
+				     TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_INPUT,
+						   TEE_PARAM_TYPE_VALUE_OUTPUT,
+						   TEE_PARAM_TYPE_NONE);
+	const uint32_t flags = TEE_MEMORY_ACCESS_READ |
+			       TEE_MEMORY_ACCESS_WRITE |
+			       TEE_MEMORY_ACCESS_ANY_OWNER;
+	struct ts_session *s = ts_get_calling_session();
+	struct user_mode_ctx *uctx = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t iterations = 0;
+	uaddr_t uaddr = 0;
+	uint64_t ns = 0;
+	uint64_t t = 0;
+	size_t len = 0;
+	size_t n = 0;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* The buffer is checked in the address space of the calling TA */
+	if (!s || !is_user_mode_ctx(s->ctx))
+		return TEE_ERROR_ACCESS_DENIED;
+	uctx = to_user_mode_ctx(s->ctx);
+
+	uaddr = params[0].value.a;
+	len = params[0].value.b;
+	iterations = params[1].value.a;
+	if (!iterations)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* Other threads of a concurrent TA may map parameters meanwhile */
+	user_mode_ctx_lock(uctx);
+	t = test_timestamp();
+	for (n = 0; n < iterations; n++) {
+		res = vm_check_access_rights(uctx, flags, uaddr, len);
+		if (res)
+			break;
+	}
+	ns = test_elapsed_ns(t);
+	user_mode_ctx_unlock(uctx);
+	if (res)
+		return res;
+
+	DMSG("access check of %zu bytes: %" PRIu64 " ns/check",
+	     len, ns / iterations);
+	params[2].value.a = ns / iterations;
+
+	return TEE_SUCCESS;
+}
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <kernel/ts_manager.h>
+#include <kernel/user_mode_ctx.h>
+#include <mm/fobj.h>
+#include <mm/mobj.h>
+#include <mm/vm.h>
+#include <tee_api_defines.h>
+#include <tee_api_types.h>
+#include <trace.h>
+#include <types_ext.h>
+
+#include "misc.h"
+
+#define NUM_PAGES	3
+
+static TEE_Result map_pages(struct user_mode_ctx *uctx, vaddr_t *va,
+			    size_t num_pages, uint32_t prot, uint32_t flags)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct mobj *mobj = NULL;
+	struct fobj *f = NULL;
+
+	f = fobj_ta_mem_alloc(num_pages);
+	if (!f)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	mobj = mobj_with_fobj_alloc(f, NULL);
+	fobj_put(f);
+	if (!mobj)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	res = vm_map(uctx, va, num_pages * SMALL_PAGE_SIZE, prot, flags,
+		     mobj, 0);
+	mobj_put(mobj);
+
+	return res;
+}
+
+/*
+ * Replays what ldelf does for a text relocation in the middle of a shared
+ * read-only segment: the relocated page is replaced by a private copy
+ * and the protection of the copy is restored afterwards. The copy is a
+ * region with other flags than the shared pages around it, so the
+ * protection can only be restored on the copy itself.
+ */
+static TEE_Result test_private_page(struct user_mode_ctx *uctx)
+{
+	const uint32_t rx = TEE_MATTR_UR | TEE_MATTR_PR | TEE_MATTR_UX;
+	const size_t seg_size = NUM_PAGES * SMALL_PAGE_SIZE;
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t vm_flags = 0;
+	uint16_t prot = 0;
+	vaddr_t seg_va = 0;
+	vaddr_t page = 0;
+	vaddr_t va = 0;
+
+	res = map_pages(uctx, &seg_va, NUM_PAGES, rx,
+			VM_FLAG_READONLY | VM_FLAG_SHAREABLE);
+	if (res)
+		return res;
+
+	res = map_pages(uctx, &va, 1, TEE_MATTR_URW | TEE_MATTR_PRW, 0);
+	if (res)
+		goto out;
+
+	page = seg_va + SMALL_PAGE_SIZE;
+	res = vm_unmap(uctx, page, SMALL_PAGE_SIZE);
+	if (res) {
+		vm_unmap(uctx, va, SMALL_PAGE_SIZE);
+		goto out;
+	}
+	res = vm_remap(uctx, &page, va, SMALL_PAGE_SIZE, 0, 0);
+	if (res) {
+		vm_unmap(uctx, va, SMALL_PAGE_SIZE);
+		goto out;
+	}
+
+	/* The flags of the whole segment differ between the pages */
+	if (vm_get_flags(uctx, seg_va, seg_size, &vm_flags) !=
+	    TEE_ERROR_BAD_PARAMETERS) {
+		EMSG("vm_get_flags() of mixed regions succeeded");
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = vm_get_flags(uctx, page, SMALL_PAGE_SIZE, &vm_flags);
+	if (res)
+		goto out;
+	if (vm_flags) {
+		EMSG("private page has flags %#"PRIx32, vm_flags);
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+	res = vm_set_prot(uctx, page, SMALL_PAGE_SIZE, rx);
+	if (res)
+		goto out;
+
+	/* All pages of the segment must now have the same protection */
+	res = vm_get_prot(uctx, seg_va, seg_size, &prot);
+	if (res)
+		goto out;
+	if (prot != rx) {
+		EMSG("segment has protection %#"PRIx16, prot);
+		res = TEE_ERROR_GENERIC;
+	}
+out:
+	vm_unmap(uctx, seg_va, seg_size);
+	return res;
+}
+
+TEE_Result core_vm_private_page_tests(uint32_t param_types,
+				      TEE_Param params[TEE_NUM_PARAMS] __unused)
+{
+	uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE,
+						   TEE_PARAM_TYPE_NONE);
+	struct ts_session *s = ts_get_calling_session();
+	struct user_mode_ctx *uctx = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	if (param_types != exp_param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* The pages are mapped in the address space of the calling TA */
+	if (!s || !is_user_mode_ctx(s->ctx))
+		return TEE_ERROR_ACCESS_DENIED;
+	uctx = to_user_mode_ctx(s->ctx);
+
+	res = user_mode_ctx_lock_exclusive(uctx);
+	if (res)
+		return res;
+	res = test_private_page(uctx);
+	user_mode_ctx_unlock(uctx);
+
+	return res;
+}
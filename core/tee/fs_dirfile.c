@@ -10,13 +10,42 @@
 #include <string.h>
 #include <tee/fs_dirfile.h>
 #include <types_ext.h>
+#include <util.h>
 
+#define IDX_MIN_BUCKETS		32
+#define IDX_MIN_DENTS		32
+
+/*
+ * struct dirfile_idx_ent - index record of a used directory entry
+ * @key:	hash of UUID and object ID of the entry
+ * @next:	index of the next entry in the same bucket, -1 terminates
+ */
+struct dirfile_idx_ent {
+	uint32_t key;
+	int next;
+};
+
+/*
+ * The index is kept in memory while the dirfile is open. It maps the
+ * (TA UUID, object ID) of each used directory entry to its position in
+ * the dirfile and records which directory entries are free. With it,
+ * looking up or allocating an entry doesn't require scanning dirf.db.
+ *
+ * The index only stores a hash of each key, a candidate entry is always
+ * read back and compared before it's accepted as a match.
+ */
 struct tee_fs_dirfile_dirh {
 	const struct tee_fs_dirfile_operations *fops;
 	struct tee_file_handle *fh;
 	int nbits;
 	bitstr_t *files;
 	size_t ndents;
+	int idx_size;
+	bitstr_t *idx_used;
+	struct dirfile_idx_ent *idx_ents;
+	int *idx_buckets;
+	size_t idx_nbuckets;
+	size_t idx_count;
 };
 
 struct dirfile_entry {
@@ -79,6 +108,155 @@ static bool test_file(struct tee_fs_dirfile_dirh *dirh, int idx)
 	return false;
 }
 
+static uint32_t dent_key(const TEE_UUID *uuid, const void *oid,
+			 size_t oidlen)
+{
+	const uint8_t *p = (const uint8_t *)uuid;
+	uint32_t h = 2166136261; /* 32-bit FNV-1a */
+	size_t n = 0;
+
+	for (n = 0; n < sizeof(*uuid); n++)
+		h = (h ^ p[n]) * 16777619;
+	p = oid;
+	for (n = 0; n < oidlen; n++)
+		h = (h ^ p[n]) * 16777619;
+
+	return h;
+}
+
+static bool idx_test(struct tee_fs_dirfile_dirh *dirh, int idx)
+{
+	if (idx < dirh->idx_size)
+		return bit_test(dirh->idx_used, idx);
+
+	return false;
+}
+
+static int *idx_bucket(struct tee_fs_dirfile_dirh *dirh, uint32_t key)
+{
+	return dirh->idx_buckets + (key & (dirh->idx_nbuckets - 1));
+}
+
+static void idx_rehash(struct tee_fs_dirfile_dirh *dirh, size_t nbuckets)
+{
+	int *old_buckets = dirh->idx_buckets;
+	int *p = NULL;
+	size_t n = 0;
+	int i = 0;
+
+	p = calloc(nbuckets, sizeof(*p));
+	if (!p)
+		return; /* Longer chains, but still a consistent index */
+	for (n = 0; n < nbuckets; n++)
+		p[n] = -1;
+
+	dirh->idx_buckets = p;
+	dirh->idx_nbuckets = nbuckets;
+	for (i = 0; i < dirh->idx_size; i++) {
+		if (bit_test(dirh->idx_used, i)) {
+			p = idx_bucket(dirh, dirh->idx_ents[i].key);
+			dirh->idx_ents[i].next = *p;
+			*p = i;
+		}
+	}
+
+	free(old_buckets);
+}
+
+/*
+ * Makes sure that directory entry @idx can be recorded in the index
+ * without further allocations. Called before the dirfile is updated so
+ * the index can't get out of sync with the dirfile due to a failed
+ * allocation.
+ */
+static TEE_Result idx_reserve(struct tee_fs_dirfile_dirh *dirh, int idx)
+{
+	struct dirfile_idx_ent *ents = NULL;
+	bitstr_t *used = NULL;
+	int sz = 0;
+
+	if (!dirh->idx_buckets) {
+		idx_rehash(dirh, IDX_MIN_BUCKETS);
+		if (!dirh->idx_buckets)
+			return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	if (idx < dirh->idx_size)
+		return TEE_SUCCESS;
+
+	sz = MAX(MAX(idx + 1, dirh->idx_size * 2), IDX_MIN_DENTS);
+	ents = realloc(dirh->idx_ents, sz * sizeof(*ents));
+	if (!ents)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	dirh->idx_ents = ents;
+
+	used = realloc(dirh->idx_used, bitstr_size(sz));
+	if (!used)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	dirh->idx_used = used;
+
+	bit_nclear(dirh->idx_used, dirh->idx_size, sz - 1);
+	dirh->idx_size = sz;
+
+	return TEE_SUCCESS;
+}
+
+static void idx_remove(struct tee_fs_dirfile_dirh *dirh, int idx)
+{
+	int *p = NULL;
+
+	if (!idx_test(dirh, idx))
+		return;
+
+	p = idx_bucket(dirh, dirh->idx_ents[idx].key);
+	while (*p != idx) {
+		assert(*p >= 0);
+		p = &dirh->idx_ents[*p].next;
+	}
+	*p = dirh->idx_ents[idx].next;
+
+	bit_clear(dirh->idx_used, idx);
+	dirh->idx_count--;
+}
+
+/* Must be preceded by a successful call to idx_reserve(dirh, idx) */
+static void idx_insert(struct tee_fs_dirfile_dirh *dirh, int idx,
+		       const struct dirfile_entry *dent)
+{
+	int *p = NULL;
+
+	assert(idx < dirh->idx_size && dirh->idx_buckets);
+
+	idx_remove(dirh, idx);
+	if (!dent->oidlen)
+		return;
+
+	if (dirh->idx_count >= dirh->idx_nbuckets * 2)
+		idx_rehash(dirh, dirh->idx_nbuckets * 2);
+
+	dirh->idx_ents[idx].key = dent_key(&dent->uuid, dent->oid,
+					   dent->oidlen);
+	p = idx_bucket(dirh, dirh->idx_ents[idx].key);
+	dirh->idx_ents[idx].next = *p;
+	*p = idx;
+
+	bit_set(dirh->idx_used, idx);
+	dirh->idx_count++;
+}
+
+/* Returns the first unused directory entry, or ndents if all are used */
+static int idx_first_free(struct tee_fs_dirfile_dirh *dirh)
+{
+	int i = -1;
+
+	if (dirh->ndents && dirh->idx_used)
+		bit_ffc(dirh->idx_used, (int)dirh->ndents, &i);
+	if (i == -1)
+		i = dirh->ndents;
+
+	return i;
+}
+
 static TEE_Result read_dent(struct tee_fs_dirfile_dirh *dirh, int idx,
 			    struct dirfile_entry *dent)
 {
@@ -99,10 +277,17 @@ static TEE_Result write_dent(struct tee_fs_dirfile_dirh *dirh, size_t n,
 {
 	TEE_Result res;
 
+	res = idx_reserve(dirh, n);
+	if (res)
+		return res;
+
 	res = dirh->fops->write(dirh->fh, sizeof(*dent) * n,
 				dent, sizeof(*dent));
-	if (!res && n >= dirh->ndents)
-		dirh->ndents = n + 1;
+	if (!res) {
+		if (n >= dirh->ndents)
+			dirh->ndents = n + 1;
+		idx_insert(dirh, n, dent);
+	}
 
 	return res;
 }
@@ -133,6 +318,10 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 			goto out;
 		}
 
+		res = idx_reserve(dirh, n);
+		if (res)
+			goto out;
+
 		if (!dent.oidlen)
 			continue;
 
@@ -149,6 +338,8 @@ TEE_Result tee_fs_dirfile_open(bool create, uint8_t *hash,
 		res = set_file(dirh, dent.file_number);
 		if (res != TEE_SUCCESS)
 			goto out;
+
+		idx_insert(dirh, n, &dent);
 	}
 out:
 	if (!res) {
@@ -165,6 +356,9 @@ void tee_fs_dirfile_close(struct tee_fs_dirfile_dirh *dirh)
 	if (dirh) {
 		dirh->fops->close(dirh->fh);
 		free(dirh->files);
+		free(dirh->idx_used);
+		free(dirh->idx_ents);
+		free(dirh->idx_buckets);
 		free(dirh);
 	}
 }
@@ -198,37 +392,41 @@ TEE_Result tee_fs_dirfile_find(struct tee_fs_dirfile_dirh *dirh,
 			       const TEE_UUID *uuid, const void *oid,
 			       size_t oidlen, struct tee_fs_dirfile_fileh *dfh)
 {
-	TEE_Result res;
-	struct dirfile_entry dent;
-	int n;
-	int first_free = -1;
+	TEE_Result res = TEE_SUCCESS;
+	struct dirfile_entry dent = { };
+	uint32_t key = 0;
+	int n = -1;
+
+	if (!oidlen) {
+		/* Find a free directory entry */
+		n = idx_first_free(dirh);
+		goto out;
+	}
+
+	if (oidlen > sizeof(dent.oid) || !dirh->idx_buckets)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	key = dent_key(uuid, oid, oidlen);
+	for (n = *idx_bucket(dirh, key); n >= 0;
+	     n = dirh->idx_ents[n].next) {
+		if (dirh->idx_ents[n].key != key)
+			continue;
 
-	for (n = 0;; n++) {
 		res = read_dent(dirh, n, &dent);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND && !oidlen) {
-			memset(&dent, 0, sizeof(dent));
-			if (first_free != -1)
-				n = first_free;
-			break;
-		}
 		if (res)
 			return res;
 
-		/* TODO check this loop when oidlen == 0 */
+		assert(test_file(dirh, dent.file_number));
 
-		if (!dent.oidlen && first_free == -1)
-			first_free = n;
-		if (dent.oidlen != oidlen)
-			continue;
-
-		assert(!oidlen || !dent.oidlen ||
-		       test_file(dirh, dent.file_number));
-
-		if (!memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
+		if (dent.oidlen == oidlen &&
+		    !memcmp(&dent.uuid, uuid, sizeof(dent.uuid)) &&
 		    !memcmp(&dent.oid, oid, oidlen))
 			break;
 	}
+	if (n < 0)
+		return TEE_ERROR_ITEM_NOT_FOUND;
 
+out:
 	if (dfh) {
 		dfh->idx = n;
 		dfh->file_number = dent.file_number;
@@ -348,6 +546,8 @@ TEE_Result tee_fs_dirfile_get_next(struct tee_fs_dirfile_dirh *dirh,
 		i = 0;
 
 	for (;; i++) {
+		if ((size_t)i < dirh->ndents && !idx_test(dirh, i))
+			continue;
 		res = read_dent(dirh, i, &dent);
 		if (res)
 			return res;
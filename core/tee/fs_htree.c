@@ -105,6 +105,14 @@ struct traverse_arg {
 	void *arg;
 };
 
+static TEE_Result rpc_write_flush(struct tee_fs_htree *ht)
+{
+	if (!ht->stor->rpc_write_flush)
+		return TEE_SUCCESS;
+
+	return ht->stor->rpc_write_flush(ht->stor_aux);
+}
+
 static TEE_Result rpc_read(struct tee_fs_htree *ht, enum tee_fs_htree_type type,
 			   size_t idx, size_t vers, void *data, size_t dlen)
 {
@@ -113,6 +121,10 @@ static TEE_Result rpc_read(struct tee_fs_htree *ht, enum tee_fs_htree_type type,
 	size_t bytes;
 	void *p;
 
+	res = rpc_write_flush(ht);
+	if (res != TEE_SUCCESS)
+		return res;
+
 	res = ht->stor->rpc_read_init(ht->stor_aux, &op, type, idx, vers, &p);
 	if (res != TEE_SUCCESS)
 		return res;
@@ -646,6 +658,9 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 		if (res != TEE_SUCCESS)
 			goto out;
 		res = rpc_write_head(ht, 0, &dummy_head);
+		if (res != TEE_SUCCESS)
+			goto out;
+		res = rpc_write_flush(ht);
 	} else {
 		res = init_head_from_data(ht, hash);
 		if (res != TEE_SUCCESS)
@@ -776,6 +791,10 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 		goto out;
 
 	/* All the nodes are written to storage now. Time to update root. */
+	res = rpc_write_flush(ht);
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	res = update_root(ht);
 	if (res != TEE_SUCCESS)
 		goto out;
@@ -784,6 +803,10 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 	if (res != TEE_SUCCESS)
 		goto out;
 
+	res = rpc_write_flush(ht);
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	ht->dirty = false;
 	if (hash)
 		memcpy(hash, ht->root.node.hash, sizeof(ht->root.node.hash));
@@ -876,6 +899,10 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 	if (res != TEE_SUCCESS)
 		goto out;
 
+	res = rpc_write_flush(ht);
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	block_vers = !!(node->node.flags & HTREE_NODE_COMMITTED_BLOCK);
 	res = ht->stor->rpc_read_init(ht->stor_aux, &op,
 				      TEE_FS_HTREE_TYPE_BLOCK, block_num,
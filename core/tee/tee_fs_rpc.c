@@ -201,6 +201,123 @@ TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op)
 	return operation_commit(op);
 }
 
+/* Whether normal world supports OPTEE_RPC_FS_WRITEV */
+static enum {
+	WRITEV_UNKNOWN,
+	WRITEV_SUPPORTED,
+	WRITEV_UNSUPPORTED,
+} writev_support;
+
+TEE_Result tee_fs_rpc_writev_init(struct tee_fs_rpc_writev *wv)
+{
+	*wv = (struct tee_fs_rpc_writev){ };
+	wv->buf_size = TEE_FS_RPC_WRITEV_BUF_SIZE;
+	wv->buf = thread_rpc_shm_cache_alloc(THREAD_SHM_CACHE_USER_FS_WRITEV,
+					     THREAD_SHM_TYPE_APPLICATION,
+					     wv->buf_size, &wv->mobj);
+	if (!wv->buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_writev_add(struct tee_fs_rpc_writev *wv,
+				 tee_fs_off_t offset, size_t data_len,
+				 void **data)
+{
+	struct tee_fs_rpc_extent ext = { };
+	size_t end = 0;
+
+	if (offset < 0)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (ADD_OVERFLOW(wv->used, sizeof(ext) + data_len, &end))
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (end > wv->buf_size) {
+		if (!wv->num_extents)
+			return TEE_ERROR_BAD_PARAMETERS;
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	ext.offset = offset;
+	ext.length = data_len;
+	memcpy(wv->buf + wv->used, &ext, sizeof(ext));
+	*data = wv->buf + wv->used + sizeof(ext);
+
+	wv->used = ROUNDUP(end, sizeof(uint64_t));
+	wv->num_extents++;
+
+	return TEE_SUCCESS;
+}
+
+/* Fallback for normal world not supporting OPTEE_RPC_FS_WRITEV */
+static TEE_Result writev_one_by_one(struct tee_fs_rpc_writev *wv,
+				    uint32_t id, int fd)
+{
+	struct tee_fs_rpc_operation op = { };
+	struct tee_fs_rpc_extent ext = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t pos = 0;
+	uint32_t n = 0;
+	void *data = NULL;
+
+	for (n = 0; n < wv->num_extents; n++) {
+		memcpy(&ext, wv->buf + pos, sizeof(ext));
+		pos += sizeof(ext);
+
+		res = tee_fs_rpc_write_init(&op, id, fd, ext.offset,
+					    ext.length, &data);
+		if (res)
+			return res;
+		memcpy(data, wv->buf + pos, ext.length);
+		res = tee_fs_rpc_write_final(&op);
+		if (res)
+			return res;
+
+		pos = ROUNDUP(pos + ext.length, sizeof(uint64_t));
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_writev_final(struct tee_fs_rpc_writev *wv,
+				   uint32_t id, int fd)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!wv->num_extents)
+		return TEE_SUCCESS;
+
+	if (writev_support != WRITEV_UNSUPPORTED) {
+		struct tee_fs_rpc_operation op = {
+			.id = id, .num_params = 2, .params = {
+				[0] = THREAD_PARAM_VALUE(IN,
+							 OPTEE_RPC_FS_WRITEV,
+							 fd, wv->num_extents),
+				[1] = THREAD_PARAM_MEMREF(IN, wv->mobj, 0,
+							  wv->used),
+			},
+		};
+
+		res = operation_commit(&op);
+		if (!res)
+			writev_support = WRITEV_SUPPORTED;
+		if (!res || writev_support == WRITEV_SUPPORTED ||
+		    (res != TEE_ERROR_NOT_SUPPORTED &&
+		     res != TEE_ERROR_BAD_PARAMETERS))
+			goto out;
+
+		DMSG("OPTEE_RPC_FS_WRITEV not supported by normal world");
+		writev_support = WRITEV_UNSUPPORTED;
+	}
+
+	res = writev_one_by_one(wv, id, fd);
+out:
+	wv->used = 0;
+	wv->num_extents = 0;
+	return res;
+}
+
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len)
 {
 	struct tee_fs_rpc_operation op = {
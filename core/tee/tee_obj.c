@@ -3,6 +3,8 @@
  * Copyright (c) 2014, STMicroelectronics International N.V.
  */
 
+#include <assert.h>
+#include <kernel/user_mode_ctx.h>
 #include <mm/vm.h>
 #include <stdlib.h>
 #include <tee_api_defines.h>
@@ -13,28 +15,57 @@
 #include <tee/tee_svc_storage.h>
 #include <trace.h>
 
-void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
+TEE_Result tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
 {
+	TEE_Result res = TEE_SUCCESS;
+	int h = 0;
+
+	user_mode_ctx_lock(&utc->uctx);
+	h = handle_get(&utc->object_db, o);
+	if (h < 0 || h > HANDLE_TAG_MAX_HANDLE) {
+		handle_put(&utc->object_db, h);
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	utc->handle_gen++;
+	o->id = handle_tag(h, utc->handle_gen);
 	TAILQ_INSERT_TAIL(&utc->objects, o, link);
+	res = user_ta_claim(utc, &o->claim);
+	assert(!res);
+out:
+	user_mode_ctx_unlock(&utc->uctx);
+	return res;
 }
 
-TEE_Result tee_obj_get(struct user_ta_ctx *utc, vaddr_t obj_id,
+TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj)
 {
-	struct tee_obj *o;
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_obj *o = NULL;
 
-	TAILQ_FOREACH(o, &utc->objects, link) {
-		if (obj_id == (vaddr_t)o) {
-			*obj = o;
-			return TEE_SUCCESS;
-		}
+	user_mode_ctx_lock(&utc->uctx);
+	o = handle_lookup(&utc->object_db, handle_untag(obj_id));
+	if (!o || o->id != obj_id) {
+		res = TEE_ERROR_BAD_STATE;
+		goto out;
 	}
-	return TEE_ERROR_BAD_STATE;
+
+	res = user_ta_claim(utc, &o->claim);
+	if (!res)
+		*obj = o;
+out:
+	user_mode_ctx_unlock(&utc->uctx);
+	return res;
 }
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o)
 {
+	user_mode_ctx_lock(&utc->uctx);
+	user_ta_unclaim(utc, &o->claim);
 	TAILQ_REMOVE(&utc->objects, o, link);
+	handle_put(&utc->object_db, handle_untag(o->id));
+	user_mode_ctx_unlock(&utc->uctx);
 
 	if ((o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT)) {
 		o->pobj->fops->close(&o->fh);
@@ -7,7 +7,6 @@
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/thread.h>
-#include <mempool.h>
 #include <mm/core_memprot.h>
 #include <mm/tee_pager.h>
 #include <optee_rpc_cmd.h>
@@ -29,11 +28,35 @@
 
 #define BLOCK_SIZE	(1 << BLOCK_SHIFT)
 
+/*
+ * Decrypted data block of an open file
+ *
+ * @link:	entry in the list of cached blocks of @fdp
+ * @lru_link:	entry in the LRU list of all files, most recently used first
+ * @fdp:	file the block belongs to
+ * @block_num:	index of the data block in the file
+ * @dirty:	modified since last written to the hash tree
+ * @data:	decrypted content of the block
+ */
+struct block_cache_entry {
+	TAILQ_ENTRY(block_cache_entry) link;
+	TAILQ_ENTRY(block_cache_entry) lru_link;
+	struct tee_fs_fd *fdp;
+	size_t block_num;
+	bool dirty;
+	uint8_t data[BLOCK_SIZE];
+};
+
+TAILQ_HEAD(block_cache_head, block_cache_entry);
+
 struct tee_fs_fd {
 	struct tee_fs_htree *ht;
 	int fd;
 	struct tee_fs_dirfile_fileh dfh;
 	const TEE_UUID *uuid;
+	struct block_cache_head block_cache;
+	struct tee_fs_rpc_writev wv;
+	bool wv_active;
 };
 
 struct tee_fs_dir {
@@ -50,14 +73,204 @@ static int pos_to_block_num(int position)
 
 static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
 
-static void *get_tmp_block(void)
+/*
+ * Up to CFG_REE_FS_BLOCK_CACHE_SIZE decrypted data blocks are cached in
+ * total, shared by all open files and protected by ree_fs_mutex. Modified
+ * blocks are only written to the hash tree when evicted or by
+ * block_cache_flush() just before the hash tree is synced to storage. The
+ * hash tree is committed by the write of its head only, so deferring the
+ * block writes to the sync doesn't change what's left in storage if the
+ * device is powered off in the middle of an operation.
+ */
+static struct block_cache_head block_cache_lru =
+	TAILQ_HEAD_INITIALIZER(block_cache_lru);
+static size_t block_cache_count;
+
+static void block_cache_free(struct block_cache_entry *e)
+{
+	TAILQ_REMOVE(&e->fdp->block_cache, e, link);
+	TAILQ_REMOVE(&block_cache_lru, e, lru_link);
+	block_cache_count--;
+	free(e);
+}
+
+static void block_cache_invalidate(struct tee_fs_fd *fdp)
+{
+	struct block_cache_entry *e = NULL;
+
+	while ((e = TAILQ_FIRST(&fdp->block_cache)))
+		block_cache_free(e);
+}
+
+/* Drop the cached blocks which are removed when truncating the file */
+static void block_cache_truncate(struct tee_fs_fd *fdp, size_t block_num)
+{
+	struct block_cache_entry *next = NULL;
+	struct block_cache_entry *e = NULL;
+
+	TAILQ_FOREACH_SAFE(e, &fdp->block_cache, link, next)
+		if (e->block_num > block_num)
+			block_cache_free(e);
+}
+
+static TEE_Result block_cache_write_back(struct tee_fs_fd *fdp,
+					 struct block_cache_entry *e)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!e->dirty)
+		return TEE_SUCCESS;
+
+	res = tee_fs_htree_write_block(&fdp->ht, e->block_num, e->data);
+	if (res)
+		return res;
+
+	e->dirty = false;
+	return TEE_SUCCESS;
+}
+
+/* Write back all modified blocks, in ascending order of block number */
+static TEE_Result block_cache_flush(struct tee_fs_fd *fdp)
 {
-	return mempool_alloc(mempool_default, BLOCK_SIZE);
+	struct block_cache_entry *next = NULL;
+	struct block_cache_entry *e = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	while (true) {
+		next = NULL;
+		TAILQ_FOREACH(e, &fdp->block_cache, link)
+			if (e->dirty &&
+			    (!next || e->block_num < next->block_num))
+				next = e;
+		if (!next)
+			return TEE_SUCCESS;
+
+		res = block_cache_write_back(fdp, next);
+		if (res) {
+			/* The hash tree is closed on error */
+			block_cache_invalidate(fdp);
+			return res;
+		}
+	}
 }
 
-static void put_tmp_block(void *tmp_block)
+/*
+ * Returns the least recently used block which can be recycled for @fdp,
+ * that is a clean block of any file or a modified block of @fdp. Modified
+ * blocks of other files are left alone, they can only remain after a
+ * failed operation since every successful one syncs its file.
+ */
+static struct block_cache_entry *block_cache_victim(struct tee_fs_fd *fdp)
 {
-	mempool_free(mempool_default, tmp_block);
+	struct block_cache_entry *e = NULL;
+
+	TAILQ_FOREACH_REVERSE(e, &block_cache_lru, block_cache_head, lru_link)
+		if (!e->dirty || e->fdp == fdp)
+			return e;
+
+	return NULL;
+}
+
+/*
+ * Returns the cache entry of block @block_num. If the block isn't cached
+ * yet a new entry is allocated, or a victim entry is written back if
+ * needed and recycled, then filled with the content of the block if @read
+ * or zeroes otherwise.
+ */
+static TEE_Result block_cache_get(struct tee_fs_fd *fdp, size_t block_num,
+				  bool read, struct block_cache_entry **entry)
+{
+	struct block_cache_entry *e = NULL;
+	TEE_Result res = TEE_SUCCESS;
+
+	COMPILE_TIME_ASSERT(CFG_REE_FS_BLOCK_CACHE_SIZE > 0);
+
+	TAILQ_FOREACH(e, &fdp->block_cache, link) {
+		if (e->block_num == block_num) {
+			TAILQ_REMOVE(&block_cache_lru, e, lru_link);
+			TAILQ_INSERT_HEAD(&block_cache_lru, e, lru_link);
+			*entry = e;
+			return TEE_SUCCESS;
+		}
+	}
+
+	if (block_cache_count < CFG_REE_FS_BLOCK_CACHE_SIZE) {
+		e = malloc(sizeof(*e));
+		if (e)
+			block_cache_count++;
+	}
+
+	if (!e) {
+		e = block_cache_victim(fdp);
+		if (!e)
+			return TEE_ERROR_OUT_OF_MEMORY;
+
+		res = block_cache_write_back(e->fdp, e);
+		if (res)
+			goto err;
+
+		TAILQ_REMOVE(&e->fdp->block_cache, e, link);
+		TAILQ_REMOVE(&block_cache_lru, e, lru_link);
+	}
+
+	e->fdp = fdp;
+	e->block_num = block_num;
+	e->dirty = false;
+	TAILQ_INSERT_HEAD(&fdp->block_cache, e, link);
+	TAILQ_INSERT_HEAD(&block_cache_lru, e, lru_link);
+
+	if (read) {
+		res = tee_fs_htree_read_block(&fdp->ht, block_num, e->data);
+		if (res)
+			goto err;
+	} else {
+		memset(e->data, 0, BLOCK_SIZE);
+	}
+
+	*entry = e;
+	return TEE_SUCCESS;
+err:
+	/* The hash tree is closed on error */
+	block_cache_invalidate(fdp);
+	return res;
+}
+
+static TEE_Result ree_fs_rpc_write_flush(void *aux)
+{
+	struct tee_fs_fd *fdp = aux;
+
+	if (!fdp->wv_active)
+		return TEE_SUCCESS;
+
+	return tee_fs_rpc_writev_final(&fdp->wv, OPTEE_RPC_CMD_FS, fdp->fd);
+}
+
+/*
+ * The modified data blocks and hash tree nodes are collected in vectored
+ * writes, the hash tree flushes them before and after writing its head.
+ * Without memory for the vectored writes each element is written with
+ * its own RPC.
+ */
+static TEE_Result sync_to_storage(struct tee_fs_fd *fdp)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	fdp->wv_active = !tee_fs_rpc_writev_init(&fdp->wv);
+
+	res = block_cache_flush(fdp);
+	if (res)
+		goto out;
+
+	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	if (res) {
+		block_cache_invalidate(fdp);
+		goto out;
+	}
+
+	res = ree_fs_rpc_write_flush(fdp);
+out:
+	fdp->wv_active = false;
+	return res;
 }
 
 static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
@@ -68,7 +281,7 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 	size_t end_block_num = pos_to_block_num(pos + len - 1);
 	size_t remain_bytes = len;
 	uint8_t *data_ptr = (uint8_t *)buf;
-	uint8_t *block;
+	struct block_cache_entry *block = NULL;
 	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
 
 	/*
@@ -79,10 +292,6 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 	if (!len)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	block = get_tmp_block();
-	if (!block)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_write = MIN(remain_bytes, (size_t)BLOCK_SIZE);
@@ -90,25 +299,20 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
-		if (start_block_num * BLOCK_SIZE <
-		    ROUNDUP(meta->length, BLOCK_SIZE)) {
-			res = tee_fs_htree_read_block(&fdp->ht,
-						      start_block_num, block);
-			if (res != TEE_SUCCESS)
-				goto exit;
-		} else {
-			memset(block, 0, BLOCK_SIZE);
-		}
+		/* A fully overwritten block doesn't need to be read first */
+		res = block_cache_get(fdp, start_block_num,
+				      size_to_write != BLOCK_SIZE &&
+				      start_block_num * BLOCK_SIZE <
+				      ROUNDUP(meta->length, BLOCK_SIZE),
+				      &block);
+		if (res != TEE_SUCCESS)
+			return res;
 
 		if (data_ptr)
-			memcpy(block + offset, data_ptr, size_to_write);
+			memcpy(block->data + offset, data_ptr, size_to_write);
 		else
-			memset(block + offset, 0, size_to_write);
-
-		res = tee_fs_htree_write_block(&fdp->ht, start_block_num,
-					       block);
-		if (res != TEE_SUCCESS)
-			goto exit;
+			memset(block->data + offset, 0, size_to_write);
+		block->dirty = true;
 
 		if (data_ptr)
 			data_ptr += size_to_write;
@@ -122,10 +326,7 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 		tee_fs_htree_meta_set_dirty(fdp->ht);
 	}
 
-exit:
-	if (block)
-		put_tmp_block(block);
-	return res;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result get_offs_size(enum tee_fs_htree_type type, size_t idx,
@@ -243,8 +444,30 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	return tee_fs_rpc_write_init(op, OPTEE_RPC_CMD_FS, fdp->fd,
-				     offs, size, data);
+	if (!fdp->wv_active)
+		return tee_fs_rpc_write_init(op, OPTEE_RPC_CMD_FS, fdp->fd,
+					     offs, size, data);
+
+	/* No parameters, written by ree_fs_rpc_write_flush() instead */
+	*op = (struct tee_fs_rpc_operation){ .id = OPTEE_RPC_CMD_FS };
+
+	res = tee_fs_rpc_writev_add(&fdp->wv, offs, size, data);
+	if (res == TEE_ERROR_SHORT_BUFFER) {
+		res = ree_fs_rpc_write_flush(fdp);
+		if (res)
+			return res;
+		res = tee_fs_rpc_writev_add(&fdp->wv, offs, size, data);
+	}
+
+	return res;
+}
+
+static TEE_Result ree_fs_rpc_write_final(struct tee_fs_rpc_operation *op)
+{
+	if (!op->num_params)
+		return TEE_SUCCESS;
+
+	return tee_fs_rpc_write_final(op);
 }
 
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
@@ -252,7 +475,8 @@ static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.rpc_read_init = ree_fs_rpc_read_init,
 	.rpc_read_final = tee_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
-	.rpc_write_final = tee_fs_rpc_write_final,
+	.rpc_write_final = ree_fs_rpc_write_final,
+	.rpc_write_flush = ree_fs_rpc_write_flush,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
@@ -281,6 +505,7 @@ static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
 					    new_file_len / BLOCK_SIZE);
 		if (res != TEE_SUCCESS)
 			return res;
+		block_cache_truncate(fdp, new_file_len / BLOCK_SIZE);
 
 		res = tee_fs_rpc_truncate(OPTEE_RPC_CMD_FS, fdp->fd,
 					  offs + sz);
@@ -302,7 +527,7 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 	int end_block_num;
 	size_t remain_bytes;
 	uint8_t *data_ptr = buf;
-	uint8_t *block = NULL;
+	struct block_cache_entry *block = NULL;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
 
@@ -314,20 +539,12 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 
 	*len = remain_bytes;
 
-	if (!remain_bytes) {
-		res = TEE_SUCCESS;
-		goto exit;
-	}
+	if (!remain_bytes)
+		return TEE_SUCCESS;
 
 	start_block_num = pos_to_block_num(pos);
 	end_block_num = pos_to_block_num(pos + remain_bytes - 1);
 
-	block = get_tmp_block();
-	if (!block) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto exit;
-	}
-
 	while (start_block_num <= end_block_num) {
 		size_t offset = pos % BLOCK_SIZE;
 		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
@@ -335,11 +552,11 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 		if (size_to_read + offset > BLOCK_SIZE)
 			size_to_read = BLOCK_SIZE - offset;
 
-		res = tee_fs_htree_read_block(&fdp->ht, start_block_num, block);
+		res = block_cache_get(fdp, start_block_num, true, &block);
 		if (res != TEE_SUCCESS)
-			goto exit;
+			return res;
 
-		memcpy(data_ptr, block + offset, size_to_read);
+		memcpy(data_ptr, block->data + offset, size_to_read);
 
 		data_ptr += size_to_read;
 		remain_bytes -= size_to_read;
@@ -347,11 +564,8 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 
 		start_block_num++;
 	}
-	res = TEE_SUCCESS;
-exit:
-	if (block)
-		put_tmp_block(block);
-	return res;
+
+	return TEE_SUCCESS;
 }
 
 static TEE_Result ree_fs_read(struct tee_file_handle *fh, size_t pos,
@@ -403,6 +617,7 @@ static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	fdp->fd = -1;
 	fdp->uuid = uuid;
+	TAILQ_INIT(&fdp->block_cache);
 
 	if (create)
 		res = tee_fs_rpc_create_dfh(OPTEE_RPC_CMD_FS,
@@ -440,6 +655,7 @@ static void ree_fs_close_primitive(struct tee_file_handle *fh)
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
 	if (fdp) {
+		block_cache_invalidate(fdp);
 		tee_fs_htree_close(&fdp->ht);
 		tee_fs_rpc_close(OPTEE_RPC_CMD_FS, fdp->fd);
 		free(fdp);
@@ -452,7 +668,7 @@ static TEE_Result ree_dirf_commit_writes(struct tee_file_handle *fh,
 	TEE_Result res;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 
 	if (!res && hash)
 		memcpy(hash, fdp->dfh.hash, sizeof(fdp->dfh.hash));
@@ -730,7 +946,7 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 	}
 
 	fdp = (struct tee_fs_fd *)*fh;
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
@@ -766,7 +982,7 @@ static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
 	if (res)
 		goto out;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
@@ -886,7 +1102,7 @@ static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 	if (res)
 		goto out;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
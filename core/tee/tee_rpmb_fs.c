@@ -3,7 +3,9 @@
  * Copyright (c) 2014, STMicroelectronics International N.V.
  */
 
+#include <arm.h>
 #include <assert.h>
+#include <config.h>
 #include <crypto/crypto.h>
 #include <kernel/huk_subkey.h>
 #include <kernel/misc.h>
@@ -56,6 +58,12 @@
 #define RPMB_BUF_MAX_ENTRIES (CFG_RPMB_FS_CACHE_ENTRIES + \
 			      CFG_RPMB_FS_RD_ENTRIES)
 
+/*
+ * Number of filename hash buckets used to index the FAT FS entries when
+ * CFG_RPMB_FS_FAT_CACHE is enabled.
+ */
+#define RPMB_FAT_HASH_BUCKETS	64
+
 /**
  * FS parameters: Information often used by internal functions.
  * fat_start_address will be set by rpmb_fs_setup().
@@ -98,6 +106,18 @@ struct rpmb_fat_entry_dir {
 	uint32_t num_total_read;
 	/* Indicates that last FAT FS entry was read. */
 	bool last_reached;
+	/* Write counter value the buffered entries are in sync with. */
+	uint32_t wr_cnt;
+	/*
+	 * Only used with CFG_RPMB_FS_FAT_CACHE where all FAT FS entries are
+	 * buffered. Active entries are chained from hash_head[] by the hash
+	 * of their filename, unused entries except the last one are chained
+	 * from free_head. A link is the index of an entry + 1, 0 ends a
+	 * chain.
+	 */
+	uint32_t *next;
+	uint32_t hash_head[RPMB_FAT_HASH_BUCKETS];
+	uint32_t free_head;
 };
 
 /**
@@ -279,6 +299,20 @@ static bool rpmb_dead;
  */
 static struct mutex rpmb_mutex = MUTEX_INITIALIZER;
 
+/*
+ * Write statistics reported by tee_rpmb_fs_get_stats(), protected by
+ * rpmb_mutex.
+ *
+ * @frames           Number of data frames written.
+ * @requests         Number of write requests sent to the device.
+ * @ticks            Counter ticks spent in write requests.
+ */
+static struct {
+	uint64_t frames;
+	uint64_t requests;
+	uint64_t ticks;
+} rpmb_stats;
+
 #ifdef CFG_RPMB_TESTKEY
 
 static const uint8_t rpmb_test_key[RPMB_KEY_MAC_SIZE] = {
@@ -408,6 +442,8 @@ struct tee_rpmb_mem {
 	struct mobj *phresp_mobj;
 	size_t req_size;
 	size_t resp_size;
+	/* Offset of the response in phresp_mobj */
+	size_t resp_offs;
 };
 
 static void tee_rpmb_free(struct tee_rpmb_mem *mem)
@@ -462,13 +498,45 @@ out:
 	return res;
 }
 
+/*
+ * Same as tee_rpmb_alloc() except that the request and the response are
+ * placed in one buffer taken from the per-thread RPC shared memory cache.
+ * This spares the alloc and free RPCs to normal world on each write. The
+ * returned memory must not be passed to tee_rpmb_free().
+ */
+static TEE_Result tee_rpmb_alloc_cached(size_t req_size, size_t resp_size,
+					struct tee_rpmb_mem *mem, void **req,
+					void **resp)
+{
+	size_t req_s = ROUNDUP(req_size, sizeof(uint64_t));
+	size_t resp_s = ROUNDUP(resp_size, sizeof(uint32_t));
+	struct mobj *mobj = NULL;
+	uint8_t *va = NULL;
+
+	va = thread_rpc_shm_cache_alloc(THREAD_SHM_CACHE_USER_RPMB,
+					THREAD_SHM_TYPE_APPLICATION,
+					req_s + resp_s, &mobj);
+	if (!va)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	mem->phreq_mobj = mobj;
+	mem->phresp_mobj = mobj;
+	mem->req_size = req_size;
+	mem->resp_size = resp_size;
+	mem->resp_offs = req_s;
+	*req = va;
+	*resp = va + req_s;
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result tee_rpmb_invoke(struct tee_rpmb_mem *mem)
 {
 	struct thread_param params[2] = {
 		[0] = THREAD_PARAM_MEMREF(IN, mem->phreq_mobj, 0,
 					  mem->req_size),
-		[1] = THREAD_PARAM_MEMREF(OUT, mem->phresp_mobj, 0,
-					  mem->resp_size),
+		[1] = THREAD_PARAM_MEMREF(OUT, mem->phresp_mobj,
+					  mem->resp_offs, mem->resp_size),
 	};
 
 	return thread_rpc_cmd(OPTEE_RPC_CMD_RPMB, 2, params);
@@ -1374,20 +1442,26 @@ out_of_retries:
 	return TEE_ERROR_COMMUNICATION;
 }
 
+/*
+ * Writes @blkcnt blocks as a pipeline of requests each carrying up to
+ * rel_wr_blkcnt frames. The write counter is only read from the device if
+ * it isn't already in sync, each following request is expected to
+ * increase it by one and is checked against that in write_req(). All
+ * requests are packed in the same RPC buffer which is kept in the thread
+ * shared memory cache.
+ */
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
 				     const uint8_t *fek, const TEE_UUID *uuid)
 {
-	TEE_Result res;
-	struct tee_rpmb_mem mem;
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_rpmb_mem mem = { };
 	struct rpmb_req *req = NULL;
 	struct rpmb_data_frame *resp = NULL;
-	uint32_t req_size;
-	uint32_t resp_size;
-	uint32_t nbr_writes;
-	uint16_t tmp_blkcnt;
-	uint16_t tmp_blk_idx;
-	uint16_t i;
+	uint16_t batch_blkcnt = 0;
+	uint16_t nbr_blks = 0;
+	uint32_t wr_cnt = 0;
+	uint64_t t = 0;
 
 	DMSG("Write %u block%s at index %u", blkcnt, ((blkcnt > 1) ? "s" : ""),
 	     blk_idx);
@@ -1403,47 +1477,46 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 	 * We need to split data when block count
 	 * is bigger than reliable block write count.
 	 */
-	if (blkcnt < rpmb_ctx->rel_wr_blkcnt)
-		req_size = sizeof(struct rpmb_req) +
-		    RPMB_DATA_FRAME_SIZE * blkcnt;
-	else
-		req_size = sizeof(struct rpmb_req) +
-		    RPMB_DATA_FRAME_SIZE * rpmb_ctx->rel_wr_blkcnt;
-
-	resp_size = RPMB_DATA_FRAME_SIZE;
-	res = tee_rpmb_alloc(req_size, resp_size, &mem,
-			     (void *)&req, (void *)&resp);
+	batch_blkcnt = MIN(blkcnt, rpmb_ctx->rel_wr_blkcnt);
+	res = tee_rpmb_alloc_cached(sizeof(struct rpmb_req) +
+				    RPMB_DATA_FRAME_SIZE * batch_blkcnt,
+				    RPMB_DATA_FRAME_SIZE, &mem,
+				    (void *)&req, (void *)&resp);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	nbr_writes = blkcnt / rpmb_ctx->rel_wr_blkcnt;
-	if (blkcnt % rpmb_ctx->rel_wr_blkcnt > 0)
-		nbr_writes += 1;
-
-	tmp_blkcnt = rpmb_ctx->rel_wr_blkcnt;
-	tmp_blk_idx = blk_idx;
-	for (i = 0; i < nbr_writes; i++) {
-		size_t offs = i * rpmb_ctx->rel_wr_blkcnt * RPMB_DATA_SIZE;
-
+	wr_cnt = rpmb_ctx->wr_cnt;
+	t = barrier_read_cntpct();
+	while (nbr_blks < blkcnt) {
 		/*
 		 * To handle the last write of block count which is
 		 * equal or smaller than reliable write block count.
 		 */
-		if (i == nbr_writes - 1)
-			tmp_blkcnt = blkcnt - rpmb_ctx->rel_wr_blkcnt *
-			    (nbr_writes - 1);
+		batch_blkcnt = MIN(blkcnt - nbr_blks, rpmb_ctx->rel_wr_blkcnt);
+		mem.req_size = sizeof(struct rpmb_req) +
+			       RPMB_DATA_FRAME_SIZE * batch_blkcnt;
 
-		res = write_req(dev_id, tmp_blk_idx, data_blks + offs,
-				tmp_blkcnt, fek, uuid, &mem, req, resp);
+		res = write_req(dev_id, blk_idx + nbr_blks,
+				data_blks + nbr_blks * RPMB_DATA_SIZE,
+				batch_blkcnt, fek, uuid, &mem, req, resp);
 		if (res)
-			goto out;
-
+			break;
 
-		tmp_blk_idx += tmp_blkcnt;
+		nbr_blks += batch_blkcnt;
+		rpmb_stats.requests++;
 	}
+	rpmb_stats.frames += nbr_blks;
+	rpmb_stats.ticks += barrier_read_cntpct() - t;
+
+	/*
+	 * The buffered FAT FS entries are updated by write_fat_entry() so
+	 * they remain in sync with writes done here. Any other change of
+	 * the write counter makes fat_entry_dir_init() read them again.
+	 */
+	if (!res && fat_entry_dir && fat_entry_dir->wr_cnt == wr_cnt &&
+	    rpmb_ctx->wr_cnt_synced)
+		fat_entry_dir->wr_cnt = rpmb_ctx->wr_cnt;
 
-out:
-	tee_rpmb_free(&mem);
 	return res;
 }
 
@@ -1474,6 +1547,7 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 	uint8_t *data_tmp = NULL;
 	uint16_t blk_idx;
 	uint16_t blkcnt;
+	uint16_t last = 0;
 	uint8_t byte_offset;
 
 	blk_idx = addr / RPMB_DATA_SIZE;
@@ -1494,11 +1568,37 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 			goto func_exit;
 		}
 
-		/* Read the complete blocks */
-		res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE, data_tmp,
-				    blkcnt * RPMB_DATA_SIZE, fek, uuid);
-		if (res != TEE_SUCCESS)
-			goto func_exit;
+		/*
+		 * Only the first and the last blocks are partially updated,
+		 * read those unless they can be read together.
+		 */
+		if (blkcnt <= 2) {
+			res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE,
+					    data_tmp, blkcnt * RPMB_DATA_SIZE,
+					    fek, uuid);
+			if (res != TEE_SUCCESS)
+				goto func_exit;
+		} else {
+			last = blkcnt - 1;
+			if (byte_offset) {
+				res = tee_rpmb_read(dev_id,
+						    blk_idx * RPMB_DATA_SIZE,
+						    data_tmp, RPMB_DATA_SIZE,
+						    fek, uuid);
+				if (res != TEE_SUCCESS)
+					goto func_exit;
+			}
+			if ((byte_offset + len) % RPMB_DATA_SIZE) {
+				res = tee_rpmb_read(dev_id,
+						    (blk_idx + last) *
+						    RPMB_DATA_SIZE,
+						    data_tmp +
+						    last * RPMB_DATA_SIZE,
+						    RPMB_DATA_SIZE, fek, uuid);
+				if (res != TEE_SUCCESS)
+					goto func_exit;
+			}
+		}
 
 		/* Partial update of the data blocks */
 		memcpy(data_tmp + byte_offset, data, len);
@@ -1587,11 +1687,152 @@ static void fat_entry_dir_free(void)
 {
 	if (fat_entry_dir) {
 		free(fat_entry_dir->rpmb_fat_entry_buf);
+		free(fat_entry_dir->next);
 		free(fat_entry_dir);
 		fat_entry_dir = NULL;
 	}
 }
 
+static uint32_t fat_entry_address(uint32_t idx)
+{
+	return RPMB_FS_FAT_START_ADDRESS + idx * sizeof(struct rpmb_fat_entry);
+}
+
+/* FNV-1a hash of a filename */
+static uint32_t fat_entry_hash(const char *filename)
+{
+	uint32_t h = 2166136261;
+	size_t n = 0;
+
+	for (n = 0; n < TEE_RPMB_FS_FILENAME_LENGTH && filename[n]; n++)
+		h = (h ^ (uint8_t)filename[n]) * 16777619;
+
+	return h;
+}
+
+/**
+ * fat_cache_chain: Return the head of the chain an entry in the FAT FS
+ * cache belongs to, or NULL for the last entry which isn't chained.
+ */
+static uint32_t *fat_cache_chain(const struct rpmb_fat_entry *fe)
+{
+	uint32_t h = 0;
+
+	if (fe->flags & FILE_IS_ACTIVE) {
+		h = fat_entry_hash(fe->filename) % RPMB_FAT_HASH_BUCKETS;
+		return fat_entry_dir->hash_head + h;
+	}
+	if (fe->flags & FILE_IS_LAST_ENTRY)
+		return NULL;
+	return &fat_entry_dir->free_head;
+}
+
+static void fat_cache_link(uint32_t idx)
+{
+	uint32_t *head = fat_cache_chain(fat_entry_dir->rpmb_fat_entry_buf +
+					 idx);
+
+	if (head) {
+		fat_entry_dir->next[idx] = *head;
+		*head = idx + 1;
+	}
+}
+
+static void fat_cache_unlink(uint32_t idx)
+{
+	uint32_t *link = fat_cache_chain(fat_entry_dir->rpmb_fat_entry_buf +
+					 idx);
+
+	if (!link)
+		return;
+
+	while (*link && *link != idx + 1)
+		link = fat_entry_dir->next + *link - 1;
+	if (*link)
+		*link = fat_entry_dir->next[idx];
+}
+
+/**
+ * fat_cache_find: Look up the active FAT FS entry of a file in the FAT FS
+ * cache, the index of the entry is returned in idx.
+ */
+static bool fat_cache_find(const char *filename, uint32_t *idx)
+{
+	struct rpmb_fat_entry *fe = fat_entry_dir->rpmb_fat_entry_buf;
+	uint32_t h = fat_entry_hash(filename) % RPMB_FAT_HASH_BUCKETS;
+	uint32_t link = fat_entry_dir->hash_head[h];
+	bool found = false;
+
+	/*
+	 * Keep going to find the first match in the FAT just as a
+	 * traversal of the FAT would.
+	 */
+	while (link) {
+		if (!strcmp(filename, fe[link - 1].filename) &&
+		    (!found || link - 1 < *idx)) {
+			*idx = link - 1;
+			found = true;
+		}
+		link = fat_entry_dir->next[link - 1];
+	}
+
+	return found;
+}
+
+/**
+ * fat_cache_load: Read in all FAT FS entries up to and including the
+ * last one and index them. Used instead of a partial read in when
+ * CFG_RPMB_FS_FAT_CACHE is enabled.
+ */
+static TEE_Result fat_cache_load(uint32_t fat_address)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct rpmb_fat_entry *fe = NULL;
+	uint32_t num_entries = 0;
+	uint32_t n = 0;
+
+	while (true) {
+		if (fat_address + CFG_RPMB_FS_RD_ENTRIES * sizeof(*fe) >
+		    fs_par->max_rpmb_address)
+			return TEE_ERROR_CORRUPT_OBJECT;
+
+		fe = realloc(fat_entry_dir->rpmb_fat_entry_buf,
+			     (num_entries + CFG_RPMB_FS_RD_ENTRIES) *
+			     sizeof(*fe));
+		if (!fe)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		fat_entry_dir->rpmb_fat_entry_buf = fe;
+
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+				    (uint8_t *)(fe + num_entries),
+				    CFG_RPMB_FS_RD_ENTRIES * sizeof(*fe),
+				    NULL, NULL);
+		if (res)
+			return res;
+
+		for (n = 0; n < CFG_RPMB_FS_RD_ENTRIES; n++)
+			if (fe[num_entries + n].flags & FILE_IS_LAST_ENTRY)
+				break;
+		fat_address += CFG_RPMB_FS_RD_ENTRIES * sizeof(*fe);
+		if (n < CFG_RPMB_FS_RD_ENTRIES) {
+			num_entries += n + 1;
+			break;
+		}
+		num_entries += CFG_RPMB_FS_RD_ENTRIES;
+	}
+
+	fat_entry_dir->next = calloc(num_entries, sizeof(uint32_t));
+	if (!fat_entry_dir->next)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	fat_entry_dir->num_buffered = num_entries;
+	/* Link in reverse so that the free list starts with the first one */
+	for (n = num_entries; n > 0; n--)
+		fat_cache_link(n - 1);
+
+	return TEE_SUCCESS;
+}
+
 /**
  * fat_entry_dir_init: Initialize the FAT FS entry buffer/cache
  * This function must be called before reading FAT FS entries using the
@@ -1604,9 +1845,18 @@ static TEE_Result fat_entry_dir_init(void)
 	struct rpmb_fat_entry *fe = NULL;
 	uint32_t fat_address = 0;
 	uint32_t num_elems_read = 0;
+	uint32_t wr_cnt = 0;
 
-	if (fat_entry_dir)
-		return TEE_SUCCESS;
+	if (fat_entry_dir) {
+		res = tee_rpmb_get_write_counter(CFG_RPMB_FS_DEV_ID, &wr_cnt);
+		if (res)
+			return res;
+		if (wr_cnt == fat_entry_dir->wr_cnt)
+			return TEE_SUCCESS;
+
+		DMSG("Write counter changed, dropping FAT cache");
+		fat_entry_dir_free();
+	}
 
 	res = rpmb_fs_setup();
 	if (res)
@@ -1616,9 +1866,22 @@ static TEE_Result fat_entry_dir_init(void)
 	if (res)
 		return res;
 
+	/* Reading doesn't change the write counter */
+	res = tee_rpmb_get_write_counter(CFG_RPMB_FS_DEV_ID, &wr_cnt);
+	if (res)
+		return res;
+
 	fat_entry_dir = calloc(1, sizeof(struct rpmb_fat_entry_dir));
 	if (!fat_entry_dir)
 		return TEE_ERROR_OUT_OF_MEMORY;
+	fat_entry_dir->wr_cnt = wr_cnt;
+
+	if (IS_ENABLED(CFG_RPMB_FS_FAT_CACHE)) {
+		res = fat_cache_load(fat_address);
+		if (res)
+			goto out;
+		return TEE_SUCCESS;
+	}
 
 	/*
 	 * If caching is enabled, read in up to the maximum cache size, but
@@ -1674,7 +1937,7 @@ static void fat_entry_dir_deinit(void)
 	if (!fat_entry_dir)
 		return;
 
-	if (!CFG_RPMB_FS_CACHE_ENTRIES) {
+	if (!CFG_RPMB_FS_CACHE_ENTRIES && !IS_ENABLED(CFG_RPMB_FS_FAT_CACHE)) {
 		fat_entry_dir_free();
 		return;
 	}
@@ -1684,7 +1947,8 @@ static void fat_entry_dir_deinit(void)
 	fat_entry_dir->num_total_read = 0;
 	fat_entry_dir->last_reached = false;
 
-	if (fat_entry_dir->num_buffered > CFG_RPMB_FS_CACHE_ENTRIES) {
+	if (!IS_ENABLED(CFG_RPMB_FS_FAT_CACHE) &&
+	    fat_entry_dir->num_buffered > CFG_RPMB_FS_CACHE_ENTRIES) {
 		fat_entry_dir->num_buffered = CFG_RPMB_FS_CACHE_ENTRIES;
 
 		fe = realloc(fe, fat_entry_dir->num_buffered * sizeof(*fe));
@@ -1701,6 +1965,47 @@ static void fat_entry_dir_deinit(void)
 	}
 }
 
+/**
+ * fat_cache_update: Updates a persisted FAT FS entry in the FAT FS cache,
+ * an entry written just after the last one is appended.
+ */
+static TEE_Result fat_cache_update(struct rpmb_fat_entry *fat_entry,
+				   uint32_t idx)
+{
+	struct rpmb_fat_entry *fe = NULL;
+	uint32_t *next = NULL;
+
+	if (idx > fat_entry_dir->num_buffered) {
+		/* Can't happen, but don't keep a cache with a hole in it */
+		fat_entry_dir_free();
+		return TEE_SUCCESS;
+	}
+
+	if (idx == fat_entry_dir->num_buffered) {
+		fe = realloc(fat_entry_dir->rpmb_fat_entry_buf,
+			     (idx + 1) * sizeof(*fe));
+		if (fe)
+			fat_entry_dir->rpmb_fat_entry_buf = fe;
+		next = realloc(fat_entry_dir->next, (idx + 1) * sizeof(*next));
+		if (next)
+			fat_entry_dir->next = next;
+		if (!fe || !next) {
+			/* The entries are read in again on next use */
+			fat_entry_dir_free();
+			return TEE_SUCCESS;
+		}
+		fat_entry_dir->num_buffered++;
+	} else {
+		fat_cache_unlink(idx);
+	}
+
+	memcpy(fat_entry_dir->rpmb_fat_entry_buf + idx, fat_entry,
+	       sizeof(*fat_entry));
+	fat_cache_link(idx);
+
+	return TEE_SUCCESS;
+}
+
 /**
  * fat_entry_dir_update: Updates a persisted FAT FS entry in the cache.
  * This function updates the FAT entry fat_entry that was written to address
@@ -1724,6 +2029,9 @@ static TEE_Result __maybe_unused fat_entry_dir_update
 	fat_entry_buf_idx = (fat_address - RPMB_FS_FAT_START_ADDRESS) /
 			     sizeof(struct rpmb_fat_entry);
 
+	if (IS_ENABLED(CFG_RPMB_FS_FAT_CACHE))
+		return fat_cache_update(fat_entry, fat_entry_buf_idx);
+
 	/* Only need to write if index points to an entry in cache. */
 	if (fat_entry_buf_idx < fat_entry_dir->num_buffered &&
 	    fat_entry_buf_idx < max_cache_entries) {
@@ -1970,7 +2278,8 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 	dump_fat();
 
 	/* If caching enabled, update a successfully written entry in cache. */
-	if (CFG_RPMB_FS_CACHE_ENTRIES && !res)
+	if ((CFG_RPMB_FS_CACHE_ENTRIES ||
+	     IS_ENABLED(CFG_RPMB_FS_FAT_CACHE)) && !res)
 		res = fat_entry_dir_update(&fh->fat_entry,
 					   fh->rpmb_fat_address);
 
@@ -2117,6 +2426,72 @@ static TEE_Result get_fat_start_address(uint32_t *addr)
 	return TEE_SUCCESS;
 }
 
+/**
+ * read_fat_cached: Same as read_fat() but served by the FAT FS cache when
+ * CFG_RPMB_FS_FAT_CACHE is enabled. The file is looked up in the filename
+ * index and an unused entry for a new file is taken from the free list,
+ * only filling in the memory pool needs a walk over the cached entries.
+ */
+static TEE_Result read_fat_cached(struct rpmb_file_handle *fh,
+				  tee_mm_pool_t *p)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct rpmb_fat_entry *fe = fat_entry_dir->rpmb_fat_entry_buf;
+	uint32_t last = fat_entry_dir->num_buffered - 1;
+	struct rpmb_file_handle last_fh = { };
+	uint32_t fat_address = 0;
+	uint32_t idx = 0;
+	uint32_t n = 0;
+
+	if (fat_cache_find(fh->filename, &idx)) {
+		fh->rpmb_fat_address = fat_entry_address(idx);
+		memcpy(&fh->fat_entry, fe + idx, sizeof(*fe));
+	}
+
+	if (p) {
+		/* Add existing files to memory pool. (write) */
+		for (n = 0; n < last; n++) {
+			if ((fe[n].flags & FILE_IS_ACTIVE) && fe[n].data_size &&
+			    !tee_mm_alloc2(p, fe[n].start_address,
+					   fe[n].data_size))
+				return TEE_ERROR_OUT_OF_MEMORY;
+		}
+
+		/*
+		 * Reuse an unused FAT entry, if the last entry is used the
+		 * FAT needs to be expanded.
+		 */
+		if (!fh->rpmb_fat_address) {
+			idx = last;
+			if (fat_entry_dir->free_head)
+				idx = fat_entry_dir->free_head - 1;
+			fh->rpmb_fat_address = fat_entry_address(idx);
+			memcpy(&fh->fat_entry, fe + idx, sizeof(*fe));
+		}
+
+		/* Represent the FAT table in the pool. */
+		fat_address = fat_entry_address(last + 1);
+		if (fh->rpmb_fat_address == fat_entry_address(last))
+			fat_address += sizeof(struct rpmb_fat_entry);
+
+		if (!tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address))
+			return TEE_ERROR_OUT_OF_MEMORY;
+
+		if (fh->rpmb_fat_address == fat_entry_address(last)) {
+			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
+			last_fh.rpmb_fat_address = fat_entry_address(last + 1);
+			res = write_fat_entry(&last_fh, true);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+	}
+
+	if (!fh->rpmb_fat_address)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	return TEE_SUCCESS;
+}
+
 /**
  * read_fat: Read FAT entries
  * Return matching FAT entry for read, rm rename and stat.
@@ -2139,6 +2514,11 @@ static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 	if (res)
 		goto out;
 
+	if (IS_ENABLED(CFG_RPMB_FS_FAT_CACHE)) {
+		res = read_fat_cached(fh, p);
+		goto out;
+	}
+
 	/*
 	 * The pool is used to represent the current RPMB layout. To find
 	 * a slot for the file tee_mm_alloc is called on the pool. Thus
@@ -3037,6 +3417,23 @@ TEE_Result tee_rpmb_fs_raw_open(const char *fname, bool create,
 	return res;
 }
 
+void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats, bool reset)
+{
+	uint64_t frq = read_cntfrq();
+
+	mutex_lock(&rpmb_mutex);
+
+	stats->frames = rpmb_stats.frames;
+	stats->requests = rpmb_stats.requests;
+	stats->bytes = rpmb_stats.frames * RPMB_DATA_SIZE;
+	stats->time_us = (rpmb_stats.ticks / frq) * 1000000 +
+			 ((rpmb_stats.ticks % frq) * 1000000) / frq;
+	if (reset)
+		memset(&rpmb_stats, 0, sizeof(rpmb_stats));
+
+	mutex_unlock(&rpmb_mutex);
+}
+
 bool __weak plat_rpmb_key_is_ready(void)
 {
 	return true;
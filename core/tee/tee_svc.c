@@ -12,7 +12,10 @@
 #include <kernel/tee_ta_manager.h>
 #include <kernel/tee_time.h>
 #include <kernel/trace_ta.h>
+#include <kernel/ts_store.h>
 #include <kernel/user_access.h>
+#include <kernel/user_mode_ctx.h>
+#include <kernel/user_ta.h>
 #include <mm/core_memprot.h>
 #include <mm/mobj.h>
 #include <mm/tee_mm.h>
@@ -211,6 +214,7 @@ const struct tee_props tee_propset_ta[] = {
 	 *	TA_PROP_STR_SINGLE_INSTANCE
 	 *	TA_PROP_STR_MULTI_SESSION
 	 *	TA_PROP_STR_KEEP_ALIVE
+	 *	TA_PROP_STR_CONCURRENT
 	 *	TA_PROP_STR_DATA_SIZE
 	 *	TA_PROP_STR_STACK_SIZE
 	 *	TA_PROP_STR_VERSION
@@ -546,6 +550,8 @@ static TEE_Result alloc_temp_sec_mem(size_t size, struct mobj **mobj,
 	*mobj = mobj_seccpy_shm_alloc(size);
 #else
 	*mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	if (!*mobj && ree_fs_ta_cache_shrink())
+		*mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
 #endif
 	if (!*mobj)
 		return TEE_ERROR_GENERIC;
@@ -787,14 +793,23 @@ TEE_Result syscall_open_ta_session(const TEE_UUID *dest,
 	clnt_id->login = TEE_LOGIN_TRUSTED_APP;
 	memcpy(&clnt_id->uuid, &sess->ctx->uuid, sizeof(TEE_UUID));
 
+	/*
+	 * Not serialized by user_ta_handle_svc(), the lock must not be held
+	 * while the called TA runs as it may call back into this TA. The
+	 * parameters are always copied when opening a session so the
+	 * called TA doesn't access the memory of this TA.
+	 */
+	user_mode_ctx_lock(&utc->uctx);
 	res = tee_svc_copy_param(sess, NULL, usr_param, param, tmp_buf_va,
 				 tmp_buf_size, &mobj_param);
 	if (res != TEE_SUCCESS)
 		goto function_exit;
 
+	user_mode_ctx_unlock(&utc->uctx);
 	res = tee_ta_open_session(&ret_o, &s, &utc->open_sessions, uuid,
 				  clnt_id, cancel_req_to, param);
 	vm_set_ctx(&utc->ta_ctx.ts_ctx);
+	user_mode_ctx_lock(&utc->uctx);
 	if (res != TEE_SUCCESS)
 		goto function_exit;
 
@@ -806,6 +821,7 @@ function_exit:
 	if (res == TEE_SUCCESS)
 		copy_to_user_private(ta_sess, &s->id, sizeof(s->id));
 	copy_to_user_private(ret_orig, &ret_o, sizeof(ret_o));
+	user_mode_ctx_unlock(&utc->uctx);
 
 out_free_only:
 	free_wipe(param);
@@ -844,6 +860,7 @@ TEE_Result syscall_invoke_ta_command(unsigned long ta_sess,
 	struct mobj *mobj_param = NULL;
 	void *tmp_buf_va[TEE_NUM_PARAMS] = { NULL };
 	size_t tmp_buf_size[TEE_NUM_PARAMS] = { };
+	bool borrow_mapping = false;
 
 	called_sess = tee_ta_get_session((uint32_t)ta_sess, true,
 				&utc->open_sessions);
@@ -853,13 +870,30 @@ TEE_Result syscall_invoke_ta_command(unsigned long ta_sess,
 	clnt_id.login = TEE_LOGIN_TRUSTED_APP;
 	memcpy(&clnt_id.uuid, &sess->ctx->uuid, sizeof(TEE_UUID));
 
+	/*
+	 * Not serialized by user_ta_handle_svc() as the called TA may run
+	 * for long or call back into this TA. A pseudo TA borrows the
+	 * mapping of this TA so the lock is held while it runs, unless
+	 * it's a concurrent pseudo TA which locks the context itself when
+	 * needed.
+	 */
+	user_mode_ctx_lock(&utc->uctx);
+	borrow_mapping = called_sess->ts_sess.ctx &&
+			 is_pseudo_ta_ctx(called_sess->ts_sess.ctx) &&
+			 !(to_ta_ctx(called_sess->ts_sess.ctx)->flags &
+			   TA_FLAG_CONCURRENT);
+
 	res = tee_svc_copy_param(sess, &called_sess->ts_sess, usr_param, &param,
 				 tmp_buf_va, tmp_buf_size, &mobj_param);
 	if (res != TEE_SUCCESS)
 		goto function_exit;
 
+	if (!borrow_mapping)
+		user_mode_ctx_unlock(&utc->uctx);
 	res = tee_ta_invoke_command(&ret_o, called_sess, &clnt_id,
 				    cancel_req_to, cmd_id, &param);
+	if (!borrow_mapping)
+		user_mode_ctx_lock(&utc->uctx);
 	if (res == TEE_ERROR_TARGET_DEAD)
 		goto function_exit;
 
@@ -885,6 +919,7 @@ function_exit:
 	tee_ta_put_session(called_sess);
 	mobj_put_wipe(mobj_param);
 	copy_to_user_private(ret_orig, &ret_o, sizeof(ret_o));
+	user_mode_ctx_unlock(&utc->uctx);
 	return res;
 }
 
@@ -963,6 +998,42 @@ TEE_Result syscall_wait(unsigned long timeout)
 	return res;
 }
 
+TEE_Result syscall_futex_wait(unsigned int *uaddr, unsigned long val)
+{
+	struct ts_session *s = ts_get_current_session();
+	struct user_ta_ctx *utc = to_user_ta_ctx(s->ctx);
+	TEE_Result res = TEE_SUCCESS;
+	unsigned int v = 0;
+
+	if (!utc->uctx.concurrent)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	/*
+	 * The value is read with futex_mu held and syscall_futex_wake()
+	 * takes it after the value has been updated, so the wakeup can't
+	 * be missed.
+	 */
+	mutex_lock(&utc->futex_mu);
+	if (utc->ta_ctx.panicked)
+		res = TEE_ERROR_TARGET_DEAD;
+	else
+		res = copy_from_user(&v, uaddr, sizeof(v));
+	if (!res && v == val)
+		condvar_wait(&utc->futex_cv, &utc->futex_mu);
+	mutex_unlock(&utc->futex_mu);
+
+	return res;
+}
+
+TEE_Result syscall_futex_wake(void)
+{
+	struct ts_session *s = ts_get_current_session();
+
+	user_ta_futex_wake(to_user_ta_ctx(s->ctx));
+
+	return TEE_SUCCESS;
+}
+
 TEE_Result syscall_get_time(unsigned long cat, TEE_Time *mytime)
 {
 	struct ts_session *s = ts_get_current_session();
@@ -11,6 +11,8 @@
 #include <crypto/crypto.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/user_access.h>
+#include <kernel/user_mode_ctx.h>
+#include <kernel/user_ta.h>
 #include <mm/vm.h>
 #include <stdlib_ext.h>
 #include <string_ext.h>
@@ -43,13 +45,15 @@ enum cryp_state {
 typedef void (*tee_cryp_ctx_finalize_func_t) (void *ctx);
 struct tee_cryp_state {
 	TAILQ_ENTRY(tee_cryp_state) link;
+	uint32_t id;	/* tagged handle in utc->cryp_state_db */
 	uint32_t algo;
 	uint32_t mode;
-	vaddr_t key1;
-	vaddr_t key2;
+	uint32_t key1;	/* object id of the first key, 0 if unused */
+	uint32_t key2;	/* object id of the second key, 0 if unused */
 	void *ctx;
 	tee_cryp_ctx_finalize_func_t ctx_finalize;
 	enum cryp_state state;
+	struct user_ta_claim claim;
 };
 
 struct tee_cryp_obj_secret {
@@ -890,8 +894,7 @@ TEE_Result syscall_cryp_obj_get_info(unsigned long obj, TEE_ObjectInfo *info)
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_obj *o = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -908,7 +911,7 @@ TEE_Result syscall_cryp_obj_restrict_usage(unsigned long obj,
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_obj *o = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -979,7 +982,7 @@ TEE_Result syscall_cryp_obj_get_attr(unsigned long obj, unsigned long attr_id,
 	const struct attr_ops *ops = NULL;
 	void *attr = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return TEE_ERROR_ITEM_NOT_FOUND;
 
@@ -1324,9 +1327,13 @@ TEE_Result syscall_cryp_obj_alloc(unsigned long obj_type,
 		return res;
 	}
 
-	tee_obj_add(to_user_ta_ctx(sess->ctx), o);
+	res = tee_obj_add(to_user_ta_ctx(sess->ctx), o);
+	if (res != TEE_SUCCESS) {
+		tee_obj_free(o);
+		return res;
+	}
 
-	res = copy_kaddr_to_uref(obj, o);
+	res = copy_to_user_private(obj, &o->id, sizeof(o->id));
 	if (res != TEE_SUCCESS)
 		tee_obj_close(to_user_ta_ctx(sess->ctx), o);
 	return res;
@@ -1338,7 +1345,7 @@ TEE_Result syscall_cryp_obj_close(unsigned long obj)
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_obj *o = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1359,7 +1366,7 @@ TEE_Result syscall_cryp_obj_reset(unsigned long obj)
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_obj *o = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1646,7 +1653,7 @@ TEE_Result syscall_cryp_obj_populate(unsigned long obj,
 	const struct tee_cryp_obj_type_props *type_props = NULL;
 	TEE_Attribute *attrs = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1697,13 +1704,11 @@ TEE_Result syscall_cryp_obj_copy(unsigned long dst, unsigned long src)
 	struct tee_obj *dst_o = NULL;
 	struct tee_obj *src_o = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  uref_to_vaddr(dst), &dst_o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), dst, &dst_o);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-			  uref_to_vaddr(src), &src_o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), src, &src_o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -1882,7 +1887,7 @@ TEE_Result syscall_obj_generate_key(unsigned long obj, unsigned long key_size,
 	size_t byte_size = 0;
 	TEE_Attribute *params = NULL;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2005,19 +2010,26 @@ out:
 }
 
 static TEE_Result tee_svc_cryp_get_state(struct ts_session *sess,
-					 vaddr_t state_id,
+					 uint32_t state_id,
 					 struct tee_cryp_state **state)
 {
-	struct tee_cryp_state *s;
 	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_cryp_state *s = NULL;
 
-	TAILQ_FOREACH(s, &utc->cryp_states, link) {
-		if (state_id == (vaddr_t)s) {
-			*state = s;
-			return TEE_SUCCESS;
-		}
+	user_mode_ctx_lock(&utc->uctx);
+	s = handle_lookup(&utc->cryp_state_db, handle_untag(state_id));
+	if (!s || s->id != state_id) {
+		res = TEE_ERROR_BAD_PARAMETERS;
+		goto out;
 	}
-	return TEE_ERROR_BAD_PARAMETERS;
+
+	res = user_ta_claim(utc, &s->claim);
+	if (!res)
+		*state = s;
+out:
+	user_mode_ctx_unlock(&utc->uctx);
+	return res;
 }
 
 static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
@@ -2029,7 +2041,11 @@ static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
 	if (tee_obj_get(utc, cs->key2, &o) == TEE_SUCCESS)
 		tee_obj_close(utc, o);
 
+	user_mode_ctx_lock(&utc->uctx);
+	user_ta_unclaim(utc, &cs->claim);
 	TAILQ_REMOVE(&utc->cryp_states, cs, link);
+	handle_put(&utc->cryp_state_db, handle_untag(cs->id));
+	user_mode_ctx_unlock(&utc->uctx);
 	if (cs->ctx_finalize != NULL)
 		cs->ctx_finalize(cs->ctx);
 
@@ -2168,9 +2184,10 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	struct tee_cryp_state *cs = NULL;
 	struct tee_obj *o1 = NULL;
 	struct tee_obj *o2 = NULL;
+	int h = 0;
 
 	if (key1 != 0) {
-		res = tee_obj_get(utc, uref_to_vaddr(key1), &o1);
+		res = tee_obj_get(utc, key1, &o1);
 		if (res != TEE_SUCCESS)
 			return res;
 		if (o1->busy)
@@ -2180,7 +2197,7 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 			return res;
 	}
 	if (key2 != 0) {
-		res = tee_obj_get(utc, uref_to_vaddr(key2), &o2);
+		res = tee_obj_get(utc, key2, &o2);
 		if (res != TEE_SUCCESS)
 			return res;
 		if (o2->busy)
@@ -2193,7 +2210,20 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	cs = calloc(1, sizeof(struct tee_cryp_state));
 	if (!cs)
 		return TEE_ERROR_OUT_OF_MEMORY;
+	user_mode_ctx_lock(&utc->uctx);
+	h = handle_get(&utc->cryp_state_db, cs);
+	if (h < 0 || h > HANDLE_TAG_MAX_HANDLE) {
+		handle_put(&utc->cryp_state_db, h);
+		user_mode_ctx_unlock(&utc->uctx);
+		free(cs);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	utc->handle_gen++;
+	cs->id = handle_tag(h, utc->handle_gen);
 	TAILQ_INSERT_TAIL(&utc->cryp_states, cs, link);
+	res = user_ta_claim(utc, &cs->claim);
+	assert(!res);
+	user_mode_ctx_unlock(&utc->uctx);
 	cs->algo = algo;
 	cs->mode = mode;
 	cs->state = CRYP_STATE_UNINITIALIZED;
@@ -2262,18 +2292,18 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = copy_kaddr_to_uref(state, cs);
+	res = copy_to_user_private(state, &cs->id, sizeof(cs->id));
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	/* Register keys */
 	if (o1 != NULL) {
 		o1->busy = true;
-		cs->key1 = (vaddr_t)o1;
+		cs->key1 = o1->id;
 	}
 	if (o2 != NULL) {
 		o2->busy = true;
-		cs->key2 = (vaddr_t)o2;
+		cs->key2 = o2->id;
 	}
 
 out:
@@ -2289,11 +2319,11 @@ TEE_Result syscall_cryp_state_copy(unsigned long dst, unsigned long src)
 	struct tee_cryp_state *cs_dst = NULL;
 	struct tee_cryp_state *cs_src = NULL;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(dst), &cs_dst);
+	res = tee_svc_cryp_get_state(sess, dst, &cs_dst);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(src), &cs_src);
+	res = tee_svc_cryp_get_state(sess, src, &cs_src);
 	if (res != TEE_SUCCESS)
 		return res;
 	if (cs_dst->algo != cs_src->algo || cs_dst->mode != cs_src->mode)
@@ -2336,7 +2366,7 @@ TEE_Result syscall_cryp_state_free(unsigned long state)
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_cryp_state *cs = NULL;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 	cryp_state_free(to_user_ta_ctx(sess->ctx), cs);
@@ -2351,7 +2381,7 @@ TEE_Result syscall_hash_init(unsigned long state,
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_cryp_state *cs = NULL;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2412,7 +2442,7 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2470,7 +2500,7 @@ TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2538,7 +2568,7 @@ TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
 	TEE_Result res = TEE_SUCCESS;
 	struct tee_obj *o = NULL;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2593,7 +2623,7 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 	TEE_Result res = TEE_SUCCESS;
 	size_t dlen = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2667,6 +2697,69 @@ TEE_Result syscall_cipher_final(unsigned long state, const void *src,
 					    src, src_len, dst, dst_len);
 }
 
+TEE_Result syscall_cipher_update_many(unsigned long state,
+			const struct utee_cipher_seg *usr_segs, size_t num_segs)
+{
+	struct utee_cipher_seg segs[UTEE_CIPHER_SEG_MAX] = { };
+	struct ts_session *sess = ts_get_current_session();
+	struct tee_cryp_state *cs = NULL;
+	struct user_mode_ctx *uctx = NULL;
+	TEE_Result res = TEE_SUCCESS;
+	size_t n = 0;
+
+	res = tee_svc_cryp_get_state(sess, state, &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (cs->state != CRYP_STATE_INITIALIZED)
+		return TEE_ERROR_BAD_STATE;
+
+	if (num_segs > ARRAY_SIZE(segs))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = copy_from_user(segs, usr_segs, num_segs * sizeof(*segs));
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/*
+	 * Check all segments before the first is processed so a bad
+	 * segment doesn't leave the operation half updated.
+	 */
+	uctx = &to_user_ta_ctx(sess->ctx)->uctx;
+	for (n = 0; n < num_segs; n++) {
+		res = vm_check_access_rights(uctx,
+					     TEE_MEMORY_ACCESS_READ |
+					     TEE_MEMORY_ACCESS_ANY_OWNER,
+					     (uaddr_t)segs[n].src,
+					     (size_t)segs[n].len);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		res = vm_check_access_rights(uctx,
+					     TEE_MEMORY_ACCESS_READ |
+					     TEE_MEMORY_ACCESS_WRITE |
+					     TEE_MEMORY_ACCESS_ANY_OWNER,
+					     (uaddr_t)segs[n].dst,
+					     (size_t)segs[n].len);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	for (n = 0; n < num_segs; n++) {
+		if (!segs[n].len)
+			continue;
+		res = tee_do_cipher_update(cs->ctx, cs->algo, cs->mode,
+					   false /* last_block */,
+					   (void *)(vaddr_t)segs[n].src,
+					   segs[n].len,
+					   (void *)(vaddr_t)segs[n].dst);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 #if defined(CFG_CRYPTO_HKDF)
 static TEE_Result get_hkdf_params(const TEE_Attribute *params,
 				  uint32_t param_count,
@@ -2928,7 +3021,7 @@ TEE_Result syscall_cryp_derive_key(unsigned long state,
 	TEE_Attribute *params = NULL;
 	size_t alloc_size = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -2947,7 +3040,7 @@ TEE_Result syscall_cryp_derive_key(unsigned long state,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = tee_obj_get(utc, uref_to_vaddr(derived_key), &so);
+	res = tee_obj_get(utc, derived_key, &so);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -3226,7 +3319,7 @@ TEE_Result syscall_authenc_init(unsigned long state, const void *nonce,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3263,7 +3356,7 @@ TEE_Result syscall_authenc_update_aad(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3291,7 +3384,7 @@ TEE_Result syscall_authenc_update_payload(unsigned long state,
 	TEE_Result res = TEE_SUCCESS;
 	size_t dlen = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3350,7 +3443,7 @@ TEE_Result syscall_authenc_enc_final(unsigned long state, const void *src_data,
 	size_t dlen = 0;
 	size_t tlen = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3434,7 +3527,7 @@ TEE_Result syscall_authenc_dec_final(unsigned long state,
 	TEE_Result res = TEE_SUCCESS;
 	size_t dlen = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3533,7 +3626,7 @@ TEE_Result syscall_asymm_operate(unsigned long state,
 	int salt_len = 0;
 	TEE_Attribute *params = NULL;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -3709,7 +3802,7 @@ TEE_Result syscall_asymm_verify(unsigned long state,
 	uint32_t hash_algo = 0;
 	int salt_len = 0;
 
-	res = tee_svc_cryp_get_state(sess, uref_to_vaddr(state), &cs);
+	res = tee_svc_cryp_get_state(sess, state, &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
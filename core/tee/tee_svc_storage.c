@@ -11,6 +11,8 @@
 #include <kernel/tee_ta_manager.h>
 #include <kernel/ts_manager.h>
 #include <kernel/user_access.h>
+#include <kernel/user_mode_ctx.h>
+#include <kernel/user_ta.h>
 #include <mm/vm.h>
 #include <string.h>
 #include <tee_api_defines_extensions.h>
@@ -63,21 +65,28 @@ struct tee_storage_enum {
 	TAILQ_ENTRY(tee_storage_enum) link;
 	struct tee_fs_dir *dir;
 	const struct tee_file_operations *fops;
+	struct user_ta_claim claim;
 };
 
 static TEE_Result tee_svc_storage_get_enum(struct user_ta_ctx *utc,
 					   vaddr_t enum_id,
 					   struct tee_storage_enum **e_out)
 {
+	TEE_Result res = TEE_ERROR_BAD_PARAMETERS;
 	struct tee_storage_enum *e;
 
+	user_mode_ctx_lock(&utc->uctx);
 	TAILQ_FOREACH(e, &utc->storage_enums, link) {
 		if (enum_id == (vaddr_t)e) {
-			*e_out = e;
-			return TEE_SUCCESS;
+			res = user_ta_claim(utc, &e->claim);
+			if (!res)
+				*e_out = e;
+			break;
 		}
 	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	user_mode_ctx_unlock(&utc->uctx);
+
+	return res;
 }
 
 static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
@@ -86,7 +95,10 @@ static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
 	if (e == NULL || utc == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
+	user_mode_ctx_lock(&utc->uctx);
+	user_ta_unclaim(utc, &e->claim);
 	TAILQ_REMOVE(&utc->storage_enums, e, link);
+	user_mode_ctx_unlock(&utc->uctx);
 
 	if (e->fops)
 		e->fops->closedir(e->dir);
@@ -308,7 +320,13 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 	o->info.handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
 			      TEE_HANDLE_FLAG_INITIALIZED | flags;
 	o->pobj = po;
-	tee_obj_add(utc, o);
+	res = tee_obj_add(utc, o);
+	if (res != TEE_SUCCESS) {
+		tee_obj_free(o);
+		tee_pobj_release(po);
+		o = NULL;
+		goto err;
+	}
 
 	res = tee_svc_storage_read_head(o);
 	if (res != TEE_SUCCESS) {
@@ -319,7 +337,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 		goto oclose;
 	}
 
-	res = copy_kaddr_to_uref(obj, o);
+	res = copy_to_user_private(obj, &o->id, sizeof(o->id));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -467,7 +485,7 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	o->pobj = po;
 
 	if (attr != TEE_HANDLE_NULL) {
-		res = tee_obj_get(utc, uref_to_vaddr(attr), &attr_o);
+		res = tee_obj_get(utc, attr, &attr_o);
 		if (res != TEE_SUCCESS)
 			goto err;
 		/* The supplied handle must be one of an initialized object */
@@ -482,10 +500,14 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	if (res != TEE_SUCCESS)
 		goto err;
 
+	res = tee_obj_add(utc, o);
+	if (res != TEE_SUCCESS) {
+		fops->remove(po);
+		goto err;
+	}
 	po = NULL; /* o owns it from now on */
-	tee_obj_add(utc, o);
 
-	res = copy_kaddr_to_uref(obj, o);
+	res = copy_to_user_private(obj, &o->id, sizeof(o->id));
 	if (res != TEE_SUCCESS)
 		goto oclose;
 
@@ -520,7 +542,7 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 	uint8_t *data = NULL;
 	size_t len = 0;
 
-	res = tee_obj_get(utc, uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -564,7 +586,7 @@ TEE_Result syscall_storage_obj_rename(unsigned long obj, void *object_id,
 	if (object_id_len > TEE_OBJECT_ID_MAX_LEN)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	res = tee_obj_get(utc, uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -621,13 +643,13 @@ TEE_Result syscall_storage_alloc_enum(uint32_t *obj_enum)
 	if (obj_enum == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	e = malloc(sizeof(struct tee_storage_enum));
+	e = calloc(1, sizeof(struct tee_storage_enum));
 	if (e == NULL)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	e->dir = NULL;
-	e->fops = NULL;
+	user_mode_ctx_lock(&utc->uctx);
 	TAILQ_INSERT_TAIL(&utc->storage_enums, e, link);
+	user_mode_ctx_unlock(&utc->uctx);
 
 	return copy_kaddr_to_uref(obj_enum, e);
 }
@@ -777,7 +799,7 @@ TEE_Result syscall_storage_obj_read(unsigned long obj, void *data, size_t len,
 	size_t pos_tmp = 0;
 	size_t bytes = 0;
 
-	res = tee_obj_get(utc, uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -833,7 +855,7 @@ TEE_Result syscall_storage_obj_write(unsigned long obj, void *data, size_t len)
 	struct tee_obj *o = NULL;
 	size_t pos_tmp = 0;
 
-	res = tee_obj_get(utc, uref_to_vaddr(obj), &o);
+	res = tee_obj_get(utc, obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -883,7 +905,7 @@ TEE_Result syscall_storage_obj_trunc(unsigned long obj, size_t len)
 	size_t off = 0;
 	size_t attr_size = 0;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
@@ -936,7 +958,7 @@ TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 	struct tee_obj *o = NULL;
 	tee_fs_off_t new_pos = 0;
 
-	res = tee_obj_get(to_user_ta_ctx(sess->ctx), uref_to_vaddr(obj), &o);
+	res = tee_obj_get(to_user_ta_ctx(sess->ctx), obj, &o);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -22,8 +22,12 @@ bool ftrace_init(struct ftrace_buf **fbuf_ptr)
 	struct __ftrace_info *finfo = NULL;
 	struct ta_elf *elf = TAILQ_FIRST(&main_elf_queue);
 	TEE_Result res = TEE_SUCCESS;
+	size_t num_lookups = 0;
+	size_t num_cached = 0;
+	uint64_t reloc_us = 0;
 	vaddr_t val = 0;
 	int count = 0;
+	int n = 0;
 	size_t fbuf_size = 0;
 
 	res = ta_elf_resolve_sym("__ftrace_info", &val, NULL, NULL);
@@ -50,6 +54,16 @@ bool ftrace_init(struct ftrace_buf **fbuf_ptr)
 			 (void *)&elf->uuid, elf->load_addr);
 	assert(count < MAX_HEADER_STRLEN);
 
+	/* Relocation statistics, skipped if they don't fit in the header */
+	ta_elf_get_reloc_stats(&reloc_us, &num_lookups, &num_cached);
+	n = snprintk((char *)fbuf + fbuf->head_off + count,
+		     MAX_HEADER_STRLEN - count,
+		     "Relocation: %" PRIu64 " us, %zu symbol lookups"
+		     " (%zu cached)\n",
+		     reloc_us, num_lookups, num_cached);
+	if (n > 0 && n < MAX_HEADER_STRLEN - count)
+		count += n;
+
 	fbuf->ret_func_ptr = finfo->ret_ptr.ptr64;
 	fbuf->ret_idx = 0;
 	fbuf->lr_idx = 0;
@@ -213,10 +213,10 @@ static void save_hashtab_from_segment(struct ta_elf *elf, unsigned int type,
 
 	for (n = 0; n < num_dyns; n++) {
 		read_dyn(elf, addr, n, &tag, &val);
-		if (tag == DT_HASH) {
+		if (tag == DT_HASH)
 			elf->hashtab = (void *)(val + elf->load_addr);
-			break;
-		}
+		else if (tag == DT_GNU_HASH)
+			elf->gnu_hashtab = (void *)(val + elf->load_addr);
 	}
 }
 
@@ -260,6 +260,93 @@ static void check_hashtab(struct ta_elf *elf, void *ptr, size_t num_buckets,
 	check_range(elf, "DT_HASH", ptr, sz);
 }
 
+static void check_gnu_hashtab(struct ta_elf *elf)
+{
+	/*
+	 * The table starts with four words: num_buckets, symoffset,
+	 * bloom_size and bloom_shift. They are followed by bloom_size
+	 * ELFCLASS sized Bloom filter words, num_buckets bucket words and
+	 * one hash value word for each symbol from symoffset to the end of
+	 * the dynamic symbol table. Like check_hashtab() the header is
+	 * checked first and then the complete table.
+	 */
+	uint32_t *hashtab = elf->gnu_hashtab;
+	size_t bloom_words = 0;
+	size_t num_words = 4;
+	size_t sz = 0;
+
+	if (elf->is_32bit) {
+		if (!ALIGNMENT_IS_OK(hashtab, uint32_t))
+			err(TEE_ERROR_BAD_FORMAT,
+			    "Bad alignment of DT_GNU_HASH %p", hashtab);
+	} else {
+		if (!ALIGNMENT_IS_OK(hashtab, uint64_t))
+			err(TEE_ERROR_BAD_FORMAT,
+			    "Bad alignment of DT_GNU_HASH %p", hashtab);
+	}
+
+	check_range(elf, "DT_GNU_HASH", hashtab, num_words * sizeof(uint32_t));
+
+	if (!hashtab[0] || !hashtab[2] || hashtab[3] >= 32 ||
+	    hashtab[1] > elf->num_dynsyms)
+		err(TEE_ERROR_BAD_FORMAT, "Bad DT_GNU_HASH header");
+
+	bloom_words = hashtab[2];
+	if (!elf->is_32bit)
+		bloom_words *= 2;
+
+	if (ADD_OVERFLOW(num_words, bloom_words, &num_words) ||
+	    ADD_OVERFLOW(num_words, hashtab[0], &num_words) ||
+	    ADD_OVERFLOW(num_words, elf->num_dynsyms - hashtab[1],
+			 &num_words) ||
+	    MUL_OVERFLOW(num_words, sizeof(uint32_t), &sz))
+		err(TEE_ERROR_BAD_FORMAT, "DT_GNU_HASH overflow");
+
+	check_range(elf, "DT_GNU_HASH", hashtab, sz);
+}
+
+static bool is_weak_undef(struct ta_elf *elf, size_t idx)
+{
+	if (elf->is_32bit) {
+		Elf32_Sym *sym = elf->dynsymtab;
+
+		return ELF32_ST_BIND(sym[idx].st_info) == STB_WEAK &&
+		       sym[idx].st_shndx == SHN_UNDEF;
+	} else {
+		Elf64_Sym *sym = elf->dynsymtab;
+
+		return ELF64_ST_BIND(sym[idx].st_info) == STB_WEAK &&
+		       sym[idx].st_shndx == SHN_UNDEF;
+	}
+}
+
+/*
+ * Undefined symbols are placed before symoffset and are not part of the
+ * DT_GNU_HASH table. Weak undefined symbols may still be resolved (to
+ * zero) so their indexes are saved to avoid scanning the symbol table on
+ * each lookup.
+ */
+static void save_weak_undef(struct ta_elf *elf)
+{
+	uint32_t symoffset = ((uint32_t *)elf->gnu_hashtab)[1];
+	size_t num = 0;
+	size_t n = 0;
+
+	for (n = 1; n < symoffset; n++)
+		if (is_weak_undef(elf, n))
+			num++;
+	if (!num)
+		return;
+
+	elf->weak_undef = calloc(num, sizeof(uint32_t));
+	if (!elf->weak_undef)
+		err(TEE_ERROR_OUT_OF_MEMORY, "calloc");
+
+	for (n = 1; n < symoffset; n++)
+		if (is_weak_undef(elf, n))
+			elf->weak_undef[elf->num_weak_undef++] = n;
+}
+
 static void save_hashtab(struct ta_elf *elf)
 {
 	uint32_t *hashtab = NULL;
@@ -281,6 +368,12 @@ static void save_hashtab(struct ta_elf *elf)
 						  phdr[n].p_memsz);
 	}
 
+	if (elf->gnu_hashtab) {
+		check_gnu_hashtab(elf);
+		save_weak_undef(elf);
+		return;
+	}
+
 	check_hashtab(elf, elf->hashtab, 0, 0);
 	hashtab = elf->hashtab;
 	check_hashtab(elf, elf->hashtab, hashtab[0], hashtab[1]);
@@ -1028,10 +1121,12 @@ static void clean_elf_load_main(struct ta_elf *elf)
 			err(res, "sys_unmap");
 
 		TAILQ_REMOVE(&elf->segs, seg, link);
+		free(seg->private_pages);
 		free(seg);
 	}
 
 	free(elf->shdr);
+	free(elf->weak_undef);
 	memset(&elf->is_32bit, 0,
 	       (vaddr_t)&elf->uuid - (vaddr_t)&elf->is_32bit);
 
@@ -1178,13 +1273,126 @@ void ta_elf_load_dependency(struct ta_elf *elf, bool is_32bit)
 	set_tls_offset(elf);
 }
 
+static void make_page_private(struct ta_elf *elf, struct segment *seg,
+			      size_t page_idx)
+{
+	vaddr_t page = elf->load_addr + seg->vaddr +
+		       page_idx * SMALL_PAGE_SIZE;
+	TEE_Result res = TEE_SUCCESS;
+	vaddr_t va = 0;
+
+	/*
+	 * Copy the page via a temporary private mapping which then replaces
+	 * the shared mapping of the page.
+	 */
+	res = sys_map_zi(SMALL_PAGE_SIZE, 0, &va, 0, 0);
+	if (res)
+		err(res, "sys_map_zi");
+	memcpy((void *)va, (void *)page, SMALL_PAGE_SIZE);
+	res = sys_unmap(page, SMALL_PAGE_SIZE);
+	if (res)
+		err(res, "sys_unmap");
+	res = sys_remap(va, &page, SMALL_PAGE_SIZE, 0, 0);
+	if (res)
+		err(res, "sys_remap");
+}
+
+/*
+ * Read-only segments are mapped shared between all instances of a TA, see
+ * populate_segments(). If a relocation targets such a segment only the
+ * pages written to are replaced by private copies, the rest of the
+ * segment stays shared. The protection of the copied pages is restored
+ * by ta_elf_finalize_mappings().
+ */
+void ta_elf_make_writeable(struct ta_elf *elf, vaddr_t offs, size_t len)
+{
+	struct segment *seg = NULL;
+	size_t first = 0;
+	size_t last = 0;
+	size_t n = 0;
+	vaddr_t end = 0;
+
+	if (elf->is_legacy || !len)
+		return;
+	if (ADD_OVERFLOW(offs, len - 1, &end))
+		err(TEE_ERROR_BAD_FORMAT, "Relocation offset overflow");
+
+	TAILQ_FOREACH(seg, &elf->segs, link) {
+		if (seg->vaddr > end)
+			break;
+		if (offs >= seg->vaddr + seg->memsz || (seg->flags & PF_W))
+			continue;
+
+		if (!seg->private_pages) {
+			n = roundup(seg->memsz) / SMALL_PAGE_SIZE;
+			seg->private_pages = bit_alloc(n);
+			if (!seg->private_pages)
+				err(TEE_ERROR_OUT_OF_MEMORY, "bit_alloc");
+		}
+
+		first = (MAX(offs, seg->vaddr) - seg->vaddr) / SMALL_PAGE_SIZE;
+		last = (MIN(end, seg->vaddr + seg->memsz - 1) - seg->vaddr) /
+		       SMALL_PAGE_SIZE;
+		for (n = first; n <= last; n++) {
+			if (!bit_test(seg->private_pages, n)) {
+				make_page_private(elf, seg, n);
+				bit_set(seg->private_pages, n);
+			}
+		}
+	}
+}
+
+/*
+ * Restores the protection of the pages copied by ta_elf_make_writeable().
+ * Each run of copied pages is a separate region with other flags than the
+ * shared regions around it, so only the copied pages are updated, the
+ * shared pages are already mapped with the final protection.
+ */
+static void finalize_private_pages(struct ta_elf *elf, struct segment *seg)
+{
+	size_t num_pages = roundup(seg->memsz) / SMALL_PAGE_SIZE;
+	vaddr_t va = elf->load_addr + seg->vaddr;
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t flags = 0;
+	size_t first = 0;
+	size_t n = 0;
+
+	if (seg->flags & PF_X)
+		flags |= LDELF_MAP_FLAG_EXECUTABLE;
+
+	while (first < num_pages) {
+		if (!bit_test(seg->private_pages, first)) {
+			first++;
+			continue;
+		}
+		for (n = first + 1; n < num_pages; n++)
+			if (!bit_test(seg->private_pages, n))
+				break;
+
+		res = sys_set_prot(va + first * SMALL_PAGE_SIZE,
+				   (n - first) * SMALL_PAGE_SIZE, flags);
+		if (res)
+			err(res, "sys_set_prot");
+		first = n;
+	}
+}
+
 void ta_elf_finalize_mappings(struct ta_elf *elf)
 {
 	TEE_Result res = TEE_SUCCESS;
 	struct segment *seg = NULL;
 
-	if (!elf->is_legacy)
+	if (!elf->is_legacy) {
+		TAILQ_FOREACH(seg, &elf->segs, link) {
+			if (!seg->private_pages)
+				continue;
+
+			finalize_private_pages(elf, seg);
+			free(seg->private_pages);
+			seg->private_pages = NULL;
+		}
 		return;
+	}
 
 	TAILQ_FOREACH(seg, &elf->segs, link) {
 		vaddr_t va = elf->load_addr + seg->vaddr;
@@ -6,6 +6,7 @@
 #ifndef TA_ELF_H
 #define TA_ELF_H
 
+#include <bitstring.h>
 #include <ldelf.h>
 #include <stdarg.h>
 #include <sys/queue.h>
@@ -20,6 +21,8 @@ struct segment {
 	size_t flags;
 	size_t align;
 	bool remapped_writeable;
+	/* Pages of a shared read-only segment copied for relocation */
+	bitstr_t *private_pages;
 	TAILQ_ENTRY(segment) link;
 };
 
@@ -58,6 +61,14 @@ struct ta_elf {
 
 	/* DT_HASH hash table for faster resolution of external symbols */
 	void *hashtab;
+	/* DT_GNU_HASH hash table, used instead of DT_HASH if present */
+	void *gnu_hashtab;
+	/*
+	 * Indexes of the weak undefined symbols in dynsymtab, these are
+	 * not covered by DT_GNU_HASH
+	 */
+	uint32_t *weak_undef;
+	size_t num_weak_undef;
 
 	/* DT_SONAME */
 	char *soname;
@@ -100,6 +111,7 @@ void ta_elf_load_main(const TEE_UUID *uuid, uint32_t *is_32bit, uint64_t *sp,
 void ta_elf_finalize_load_main(uint64_t *entry);
 void ta_elf_load_dependency(struct ta_elf *elf, bool is_32bit);
 void ta_elf_relocate(struct ta_elf *elf);
+void ta_elf_make_writeable(struct ta_elf *elf, vaddr_t offs, size_t len);
 void ta_elf_finalize_mappings(struct ta_elf *elf);
 
 void ta_elf_print_mappings(void *pctx, print_func_t print_func,
@@ -118,6 +130,10 @@ static inline void ta_elf_stack_trace_a64(uint64_t fp __unused,
 
 TEE_Result ta_elf_resolve_sym(const char *name, vaddr_t *val,
 			      struct ta_elf **found_elf, struct ta_elf *elf);
+#ifdef CFG_FTRACE_SUPPORT
+void ta_elf_get_reloc_stats(uint64_t *us, size_t *num_lookups,
+			    size_t *num_cached);
+#endif
 TEE_Result ta_elf_add_library(const TEE_UUID *uuid);
 TEE_Result ta_elf_set_init_fini_info_compat(bool is_32bit);
 TEE_Result ta_elf_set_elf_phdr_info(bool is_32bit);
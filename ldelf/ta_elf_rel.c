@@ -16,6 +16,68 @@
 #include "sys.h"
 #include "ta_elf.h"
 
+#ifdef CFG_FTRACE_SUPPORT
+#include <arm_user_sysreg.h>
+#endif
+
+/*
+ * Symbols looked up while relocating are cached since the same external
+ * symbol is typically imported by several relocation sections and
+ * modules. Modules are only appended to main_elf_queue so a cached
+ * result remains valid when more modules are loaded later.
+ */
+#define SYM_CACHE_SIZE		128
+
+struct sym_cache_entry {
+	const char *name;
+	uint32_t hash;
+	vaddr_t val;
+	struct ta_elf *elf;
+};
+
+struct sym_hash {
+	uint32_t elf_hash;	/* Used with DT_HASH */
+	uint32_t gnu_hash;	/* Used with DT_GNU_HASH */
+};
+
+static struct sym_cache_entry sym_cache[SYM_CACHE_SIZE];
+
+static struct {
+	uint64_t ticks;
+	size_t num_lookups;
+	size_t num_cached;
+} reloc_stats;
+
+#ifdef CFG_FTRACE_SUPPORT
+static uint64_t reloc_timestamp(void)
+{
+	return barrier_read_cntpct();
+}
+
+void ta_elf_get_reloc_stats(uint64_t *us, size_t *num_lookups,
+			    size_t *num_cached)
+{
+	*us = reloc_stats.ticks * 1000000 / read_cntfrq();
+	*num_lookups = reloc_stats.num_lookups;
+	*num_cached = reloc_stats.num_cached;
+}
+#else
+static uint64_t reloc_timestamp(void)
+{
+	return 0;
+}
+#endif
+
+static uint32_t gnu_hash(const char *name)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	uint32_t h = 5381;
+
+	while (*p)
+		h = (h << 5) + h + *p++;
+	return h;
+}
+
 static uint32_t elf_hash(const char *name)
 {
 	const unsigned char *p = (const unsigned char *)name;
@@ -78,21 +140,118 @@ static bool __resolve_sym(struct ta_elf *elf, unsigned int st_bind,
 	return true;
 }
 
-static TEE_Result resolve_sym_helper(uint32_t hash, const char *name,
-				     vaddr_t *val, struct ta_elf *elf,
-				     bool weak_ok)
+static bool resolve_sym_idx(struct ta_elf *elf, size_t idx, const char *name,
+			    vaddr_t *val, bool weak_ok)
+{
+	if (elf->is_32bit) {
+		Elf32_Sym *sym = elf->dynsymtab;
+
+		return __resolve_sym(elf, ELF32_ST_BIND(sym[idx].st_info),
+				     ELF32_ST_TYPE(sym[idx].st_info),
+				     sym[idx].st_shndx, sym[idx].st_name,
+				     sym[idx].st_value, name, val, weak_ok);
+	} else {
+		Elf64_Sym *sym = elf->dynsymtab;
+
+		return __resolve_sym(elf, ELF64_ST_BIND(sym[idx].st_info),
+				     ELF64_ST_TYPE(sym[idx].st_info),
+				     sym[idx].st_shndx, sym[idx].st_name,
+				     sym[idx].st_value, name, val, weak_ok);
+	}
+}
+
+/*
+ * See https://sourceware.org/ml/binutils/2006-10/msg00377.html for a
+ * description of the DT_GNU_HASH table, the layout is checked by
+ * check_gnu_hashtab() when the ELF is loaded.
+ */
+static TEE_Result resolve_sym_gnu_helper(uint32_t hash, const char *name,
+					 vaddr_t *val, struct ta_elf *elf,
+					 bool weak_ok)
+{
+	uint32_t *hashtab = elf->gnu_hashtab;
+	uint32_t nbuckets = hashtab[0];
+	uint32_t symoffset = hashtab[1];
+	uint32_t bloom_size = hashtab[2];
+	uint32_t bloom_shift = hashtab[3];
+	uint32_t *bucket = NULL;
+	uint32_t *chain = NULL;
+	unsigned int word_bits = 0;
+	uint64_t bloom_word = 0;
+	uint64_t mask = 0;
+	uint32_t h = 0;
+	size_t n = 0;
+
+	if (elf->is_32bit) {
+		uint32_t *bloom = hashtab + 4;
+
+		word_bits = 32;
+		bloom_word = bloom[(hash / word_bits) % bloom_size];
+		bucket = bloom + bloom_size;
+	} else {
+		uint64_t *bloom = (uint64_t *)(hashtab + 4);
+
+		word_bits = 64;
+		bloom_word = bloom[(hash / word_bits) % bloom_size];
+		bucket = (uint32_t *)(bloom + bloom_size);
+	}
+	chain = bucket + nbuckets;
+
+	/* Two bits must be set in the Bloom filter if the symbol is here */
+	mask = BIT64(hash % word_bits) |
+	       BIT64((hash >> bloom_shift) % word_bits);
+	if ((bloom_word & mask) != mask)
+		goto weak_undef;
+
+	for (n = bucket[hash % nbuckets]; n; n++) {
+		if (n < symoffset || n >= elf->num_dynsyms)
+			err(TEE_ERROR_BAD_FORMAT, "Index out of range");
+		/* Spectre V1 pattern, see resolve_sym_helper() */
+		n = confine_array_index(n, elf->num_dynsyms);
+		/* Bit 0 of the hash value marks the end of the chain */
+		h = chain[n - symoffset];
+		if ((h | 1) == (hash | 1) &&
+		    resolve_sym_idx(elf, n, name, val, weak_ok))
+			return TEE_SUCCESS;
+		if (h & 1)
+			break;
+	}
+
+weak_undef:
+	if (weak_ok)
+		for (n = 0; n < elf->num_weak_undef; n++)
+			if (resolve_sym_idx(elf, elf->weak_undef[n], name, val,
+					    weak_ok))
+				return TEE_SUCCESS;
+
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
+
+static TEE_Result resolve_sym_helper(const struct sym_hash *sym_hash,
+				     const char *name, vaddr_t *val,
+				     struct ta_elf *elf, bool weak_ok)
 {
 	/*
 	 * Using uint32_t here for convenience because both Elf64_Word
 	 * and Elf32_Word are 32-bit types
 	 */
+	uint32_t hash = sym_hash->elf_hash;
 	uint32_t *hashtab = elf->hashtab;
-	uint32_t nbuckets = hashtab[0];
-	uint32_t nchains = hashtab[1];
-	uint32_t *bucket = &hashtab[2];
-	uint32_t *chain = &bucket[nbuckets];
+	uint32_t nbuckets = 0;
+	uint32_t nchains = 0;
+	uint32_t *bucket = NULL;
+	uint32_t *chain = NULL;
 	size_t n = 0;
 
+	if (elf->gnu_hashtab)
+		return resolve_sym_gnu_helper(sym_hash->gnu_hash, name, val,
+					      elf, weak_ok);
+
+	nbuckets = hashtab[0];
+	nchains = hashtab[1];
+	bucket = &hashtab[2];
+	chain = &bucket[nbuckets];
+
 	if (elf->is_32bit) {
 		Elf32_Sym *sym = elf->dynsymtab;
 
@@ -142,20 +301,11 @@ static TEE_Result resolve_sym_helper(uint32_t hash, const char *name,
 	return TEE_ERROR_ITEM_NOT_FOUND;
 }
 
-/*
- * Look for named symbol in @elf, or all modules if @elf == NULL. Global symbols
- * are searched first, then weak ones. Last option, when at least one weak but
- * undefined symbol exists, resolve to zero. Otherwise return
- * TEE_ERROR_ITEM_NOT_FOUND.
- * @val (if != 0) receives the symbol value
- * @found_elf (if != 0) receives the module where the symbol is found
- */
-TEE_Result ta_elf_resolve_sym(const char *name, vaddr_t *val,
-			      struct ta_elf **found_elf,
-			      struct ta_elf *elf)
+static TEE_Result resolve_sym_hashed(const struct sym_hash *hash,
+				     const char *name, vaddr_t *val,
+				     struct ta_elf **found_elf,
+				     struct ta_elf *elf)
 {
-	uint32_t hash = elf_hash(name);
-
 	if (elf) {
 		/* Search global symbols */
 		if (!resolve_sym_helper(hash, name, val, elf,
@@ -184,6 +334,26 @@ success:
 	return TEE_SUCCESS;
 }
 
+/*
+ * Look for named symbol in @elf, or all modules if @elf == NULL. Global symbols
+ * are searched first, then weak ones. Last option, when at least one weak but
+ * undefined symbol exists, resolve to zero. Otherwise return
+ * TEE_ERROR_ITEM_NOT_FOUND.
+ * @val (if != 0) receives the symbol value
+ * @found_elf (if != 0) receives the module where the symbol is found
+ */
+TEE_Result ta_elf_resolve_sym(const char *name, vaddr_t *val,
+			      struct ta_elf **found_elf,
+			      struct ta_elf *elf)
+{
+	struct sym_hash hash = {
+		.elf_hash = elf_hash(name),
+		.gnu_hash = gnu_hash(name),
+	};
+
+	return resolve_sym_hashed(&hash, name, val, found_elf, elf);
+}
+
 static void e32_get_sym_name(const Elf32_Sym *sym_tab, size_t num_syms,
 			     const char *str_tab, size_t str_tab_size,
 			     Elf32_Rel *rel, const char **name)
@@ -204,10 +374,28 @@ static void e32_get_sym_name(const Elf32_Sym *sym_tab, size_t num_syms,
 
 static void resolve_sym(const char *name, vaddr_t *val, struct ta_elf **mod)
 {
-	TEE_Result res = ta_elf_resolve_sym(name, val, mod, NULL);
+	struct sym_hash hash = { .gnu_hash = gnu_hash(name) };
+	struct sym_cache_entry *ce = sym_cache + hash.gnu_hash % SYM_CACHE_SIZE;
+	TEE_Result res = TEE_SUCCESS;
 
-	if (res)
-		err(res, "Symbol %s not found", name);
+	reloc_stats.num_lookups++;
+	if (ce->name && ce->hash == hash.gnu_hash && !strcmp(ce->name, name)) {
+		reloc_stats.num_cached++;
+	} else {
+		hash.elf_hash = elf_hash(name);
+		res = resolve_sym_hashed(&hash, name, &ce->val, &ce->elf, NULL);
+		if (res) {
+			ce->name = NULL;
+			err(res, "Symbol %s not found", name);
+		}
+		ce->name = name;
+		ce->hash = hash.gnu_hash;
+	}
+
+	if (val)
+		*val = ce->val;
+	if (mod)
+		*mod = ce->elf;
 }
 
 static void e32_process_dyn_rel(const Elf32_Sym *sym_tab, size_t num_syms,
@@ -332,6 +520,7 @@ static void e32_relocate(struct ta_elf *elf, unsigned int rel_sidx)
 			err(TEE_ERROR_BAD_FORMAT,
 			    "Relocation offset out of range");
 		where = (Elf32_Addr *)(elf->load_addr + rel->r_offset);
+		ta_elf_make_writeable(elf, rel->r_offset, sizeof(*where));
 
 		switch (ELF32_R_TYPE(rel->r_info)) {
 		case R_ARM_NONE:
@@ -550,6 +739,7 @@ static void e64_relocate(struct ta_elf *elf, unsigned int rel_sidx)
 			    "Relocation offset out of range");
 
 		where = (Elf64_Addr *)(elf->load_addr + rela->r_offset);
+		ta_elf_make_writeable(elf, rela->r_offset, sizeof(*where));
 
 		switch (ELF64_R_TYPE(rela->r_info)) {
 		case R_AARCH64_NONE:
@@ -608,6 +798,7 @@ static void __noreturn e64_relocate(struct ta_elf *elf __unused,
 
 void ta_elf_relocate(struct ta_elf *elf)
 {
+	uint64_t t = reloc_timestamp();
 	size_t n = 0;
 
 	if (elf->is_32bit) {
@@ -624,4 +815,6 @@ void ta_elf_relocate(struct ta_elf *elf)
 				e64_relocate(elf, n);
 
 	}
+
+	reloc_stats.ticks += reloc_timestamp() - t;
 }
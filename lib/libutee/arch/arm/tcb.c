@@ -5,12 +5,14 @@
 /*
  * Support for Thread-Local Storage (TLS) ABIs for ARMv7/Aarch32 and Aarch64.
  *
- * TAs are currently single-threaded, so the only benefit of implementing these
- * ABIs is to support toolchains that need them even when the target program is
- * single-threaded. Such as, the g++ compiler from the GCC toolchain targeting a
- * "Posix thread" Linux runtime, which OP-TEE has been using for quite some time
- * (arm-linux-gnueabihf-* and aarch64-linux-gnu-*). This allows building C++ TAs
- * without having to build a specific toolchain with --disable-threads.
+ * TAs don't create threads, but the core may execute several sessions of a TA
+ * with TA_FLAG_CONCURRENT at the same time on different stacks. Each stack is
+ * given a TCB of its own. Implementing these ABIs also supports toolchains that
+ * need them even when the target program is single-threaded. Such as, the g++
+ * compiler from the GCC toolchain targeting a "Posix thread" Linux runtime,
+ * which OP-TEE has been using for quite some time (arm-linux-gnueabihf-* and
+ * aarch64-linux-gnu-*). This allows building C++ TAs without having to build a
+ * specific toolchain with --disable-threads.
  *
  * This implementation is based on [1].
  *
@@ -38,6 +40,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
+#include <umutex.h>
+#include "tee_api_private.h"
 #include "user_ta_header.h"
 
 /* DTV - Dynamic Thread Vector
@@ -70,25 +74,66 @@ struct tcb_head {
 };
 
 /*
- * Since TAs are single threaded, only one TCB is needed. This would need to
- * change if multi-threading is introduced.
+ * struct tcb_slot - TCB of one of the stacks the TA is entered on
+ * @stack_top:	Top of the stack, identifies the slot
+ * @tcb:	TCB used while executing on this stack
+ * @tls_size:	Size of the TLS blocks in @tcb
+ * @next:	Next slot
+ *
+ * Slots are added as the core enters the TA on new stacks and are never
+ * freed, so they can be looked up without holding _tcb_lock.
  */
-static struct tcb_head *_tcb;
+struct tcb_slot {
+	vaddr_t stack_top;
+	struct tcb_head *tcb;
+	size_t tls_size;
+	struct tcb_slot *next;
+};
+
+/* The first slot is needed before the heap is initialized */
+static struct tcb_slot _first_slot;
+static struct tcb_slot *_tcb_slots;
+static struct umutex _tcb_lock = UMUTEX_INITIALIZER;
+/* Size of the TLS blocks of all loaded ELF modules */
 static size_t _tls_size;
 
-#define TCB_SIZE(tls_size) (sizeof(*_tcb) + (tls_size))
+#define TCB_SIZE(tls_size) (sizeof(struct tcb_head) + (tls_size))
 
-/*
- * Initialize or update the TCB.
- * Called on application initialization and when additional shared objects are
- * loaded via dlopen().
- */
-void __utee_tcb_init(void)
+/* Returns the slot of the stack holding @sp */
+static struct tcb_slot *find_slot(vaddr_t sp)
+{
+	struct tcb_slot *slot = __atomic_load_n(&_tcb_slots, __ATOMIC_ACQUIRE);
+	struct tcb_slot *best = NULL;
+
+	/* Stacks don't overlap, the closest stack top above @sp is ours */
+	for (; slot; slot = slot->next)
+		if (slot->stack_top > sp &&
+		    (!best || slot->stack_top < best->stack_top))
+			best = slot;
+
+	return best;
+}
+
+static struct tcb_slot *find_current_slot(void)
+{
+	uint8_t marker = 0;
+
+	return find_slot((vaddr_t)&marker);
+}
+
+static struct tcb_head *get_tcb(void)
+{
+	struct tcb_slot *slot = find_current_slot();
+
+	assert(slot && slot->tcb);
+	return slot->tcb;
+}
+
+static size_t get_total_tls_size(void)
 {
 	struct dl_phdr_info *dlpi = NULL;
 	const Elf_Phdr *phdr = NULL;
 	size_t total_size = 0;
-	size_t size = 0;
 	size_t i = 0;
 	size_t j = 0;
 
@@ -104,23 +149,38 @@ void __utee_tcb_init(void)
 		}
 	}
 
+	return total_size;
+}
+
+/* (Re-)allocates the TCB of @slot to hold @total_size bytes of TLS blocks */
+static void update_slot(struct tcb_slot *slot, size_t total_size)
+{
+	struct tcb_head *tcb = slot->tcb;
+	struct dl_phdr_info *dlpi = NULL;
+	const Elf_Phdr *phdr = NULL;
+	size_t size = 0;
+	size_t i = 0;
+	size_t j = 0;
+
 	/* ELF modules currently cannot be unmapped */
-	assert(total_size >= _tls_size);
+	assert(total_size >= slot->tls_size);
 
-	if (total_size == _tls_size)
+	if (total_size == slot->tls_size)
 		return;
 
 	/* (Re-)allocate the TCB */
-	_tcb = realloc(_tcb, TCB_SIZE(total_size));
-	if (!_tcb) {
+	tcb = realloc(tcb, TCB_SIZE(total_size));
+	if (!tcb) {
 		EMSG("TCB allocation failed (%zu bytes)", TCB_SIZE(total_size));
 		abort();
 	}
+	if (!slot->tcb)
+		tcb->dtv = NULL;
 
 	/* (Re-)allocate the DTV. + 1 since dtv[0] holds the size */
 	size = DTV_SIZE((__elf_phdr_info.count + 1) * sizeof(union dtv));
-	_tcb->dtv = realloc(_tcb->dtv, size);
-	if (!_tcb->dtv) {
+	tcb->dtv = realloc(tcb->dtv, size);
+	if (!tcb->dtv) {
 		EMSG("DTV allocation failed (%zu bytes)", size);
 		abort();
 	}
@@ -133,33 +193,101 @@ void __utee_tcb_init(void)
 			phdr = dlpi->dlpi_phdr + j;
 			if (phdr->p_type != PT_TLS)
 				continue;
-			if (size + phdr->p_memsz <= _tls_size) {
+			tcb->dtv[i + 1].tls = tcb->tls + size;
+			if (size + phdr->p_memsz <= slot->tls_size) {
 				/* Already copied */
+				size += phdr->p_memsz;
 				break;
 			}
-			_tcb->dtv[i + 1].tls = _tcb->tls + size;
 			/* Copy .tdata */
-			memcpy(_tcb->tls + size,
+			memcpy(tcb->tls + size,
 			       (void *)(dlpi->dlpi_addr + phdr->p_vaddr),
 			       phdr->p_filesz);
 			/* Initialize .tbss */
-			memset(_tcb->tls + size + phdr->p_filesz, 0,
+			memset(tcb->tls + size + phdr->p_filesz, 0,
 			       phdr->p_memsz - phdr->p_filesz);
 			size += phdr->p_memsz;
 		}
 	}
-	_tcb->dtv[0].size = i;
+	tcb->dtv[0].size = i;
+
+	slot->tcb = tcb;
+	slot->tls_size = total_size;
+}
 
-	_tls_size = total_size;
+static void set_thread_pointer(struct tcb_slot *slot __maybe_unused)
+{
 #ifdef ARM64
 	/*
 	 * Aarch64 ABI requirement: the thread pointer shall point to the
 	 * thread's TCB. ARMv7 and Aarch32 access the TCB via _tls_get_addr().
 	 */
-	write_tpidr_el0((vaddr_t)_tcb);
+	write_tpidr_el0((vaddr_t)slot->tcb);
 #endif
 }
 
+void __utee_tcb_enter(void *stack_top)
+{
+	struct tcb_slot *slot = NULL;
+
+	umutex_lock(&_tcb_lock);
+
+	for (slot = _tcb_slots; slot; slot = slot->next)
+		if (slot->stack_top == (vaddr_t)stack_top)
+			break;
+
+	if (!slot) {
+		if (!_tcb_slots) {
+			slot = &_first_slot;
+		} else {
+			slot = calloc(1, sizeof(*slot));
+			if (!slot) {
+				EMSG("TCB slot allocation failed");
+				abort();
+			}
+		}
+		slot->stack_top = (vaddr_t)stack_top;
+		slot->next = _tcb_slots;
+		__atomic_store_n(&_tcb_slots, slot, __ATOMIC_RELEASE);
+	}
+
+	/*
+	 * A library may have been loaded with dlopen() since this stack
+	 * was used last time.
+	 */
+	if (_tls_size)
+		update_slot(slot, _tls_size);
+
+	umutex_unlock(&_tcb_lock);
+
+	if (slot->tcb)
+		set_thread_pointer(slot);
+}
+
+/*
+ * Initialize or update the TCB of the current stack.
+ * Called on application initialization and when additional shared objects are
+ * loaded via dlopen(), the other stacks are updated by __utee_tcb_enter().
+ */
+void __utee_tcb_init(void)
+{
+	struct tcb_slot *slot = NULL;
+	size_t total_size = get_total_tls_size();
+
+	umutex_lock(&_tcb_lock);
+
+	slot = find_current_slot();
+	assert(slot);
+	if (total_size > _tls_size)
+		_tls_size = total_size;
+	update_slot(slot, _tls_size);
+
+	umutex_unlock(&_tcb_lock);
+
+	if (slot->tcb)
+		set_thread_pointer(slot);
+}
+
 struct tls_index {
 	unsigned long module;
 	unsigned long offset;
@@ -169,7 +297,7 @@ void *__tls_get_addr(struct tls_index *ti);
 
 void *__tls_get_addr(struct tls_index *ti)
 {
-	return _tcb->dtv[ti->module].tls + ti->offset;
+	return get_tcb()->dtv[ti->module].tls + ti->offset;
 }
 
 int dl_iterate_phdr(int (*callback)(struct dl_phdr_info *, size_t, void *),
@@ -181,11 +309,8 @@ int dl_iterate_phdr(int (*callback)(struct dl_phdr_info *, size_t, void *),
 	int st = 0;
 
 	/*
-	 * dlpi_tls_data is thread-specific so if we were to support
-	 * multi-threading, we would need one copy of struct dl_phdr_info per
-	 * thread. Could be a pre-allocated area, or could be allocated on the
-	 * heap. Doing the latter here so that it would at least work if/when we
-	 * add thread support. Further optimization can always come later.
+	 * dlpi_tls_data is thread-specific so one copy of struct
+	 * dl_phdr_info is needed per thread, it's allocated on the heap.
 	 */
 	dlpi = calloc(1, sizeof(*dlpi));
 	if (!dlpi) {
@@ -198,7 +323,7 @@ int dl_iterate_phdr(int (*callback)(struct dl_phdr_info *, size_t, void *),
 		dlpi->dlpi_tls_data = NULL;
 		id = dlpi->dlpi_tls_modid;
 		if (id)
-			dlpi->dlpi_tls_data = _tcb->dtv[id].tls;
+			dlpi->dlpi_tls_data = get_tcb()->dtv[id].tls;
 		st = callback(dlpi, sizeof(*dlpi), data);
 	}
 
@@ -11,6 +11,7 @@
 #include <tee_api.h>
 #include <tee_ta_api.h>
 #include <tee_internal_api_extensions.h>
+#include <umutex.h>
 #include <user_ta_header.h>
 #include <utee_syscalls.h>
 #include <tee_arith_internal.h>
@@ -26,7 +27,13 @@ struct ta_session {
 static TAILQ_HEAD(ta_sessions, ta_session) ta_sessions =
 		TAILQ_HEAD_INITIALIZER(ta_sessions);
 
+/*
+ * Only updated when opening or closing a session, which the core never
+ * does concurrently with any other entry into the TA instance.
+ */
 static bool init_done;
+/* Protects ta_sessions */
+static struct umutex ta_sessions_lock = UMUTEX_INITIALIZER;
 
 /* From user_ta_header.c, built within TA */
 extern uint8_t ta_heap[];
@@ -183,11 +190,14 @@ static struct ta_session *ta_header_get_session(uint32_t session_id)
 {
 	struct ta_session *itr;
 
+	umutex_lock(&ta_sessions_lock);
 	TAILQ_FOREACH(itr, &ta_sessions, link) {
 		if (itr->session_id == session_id)
-			return itr;
+			break;
 	}
-	return NULL;
+	umutex_unlock(&ta_sessions_lock);
+
+	return itr;
 }
 
 static TEE_Result ta_header_add_session(uint32_t session_id)
@@ -211,7 +221,9 @@ static TEE_Result ta_header_add_session(uint32_t session_id)
 		return TEE_ERROR_OUT_OF_MEMORY;
 	itr->session_id = session_id;
 	itr->session_ctx = 0;
+	umutex_lock(&ta_sessions_lock);
 	TAILQ_INSERT_TAIL(&ta_sessions, itr, link);
+	umutex_unlock(&ta_sessions_lock);
 
 	return TEE_SUCCESS;
 }
@@ -220,21 +232,26 @@ static void ta_header_remove_session(uint32_t session_id)
 {
 	struct ta_session *itr;
 	bool keep_alive;
+	bool empty;
 
+	umutex_lock(&ta_sessions_lock);
 	TAILQ_FOREACH(itr, &ta_sessions, link) {
 		if (itr->session_id == session_id) {
 			TAILQ_REMOVE(&ta_sessions, itr, link);
+			empty = TAILQ_EMPTY(&ta_sessions);
+			umutex_unlock(&ta_sessions_lock);
 			TEE_Free(itr);
 
 			keep_alive =
 				(ta_head.flags & TA_FLAG_SINGLE_INSTANCE) &&
 				(ta_head.flags & TA_FLAG_INSTANCE_KEEP_ALIVE);
-			if (TAILQ_EMPTY(&ta_sessions) && !keep_alive)
+			if (empty && !keep_alive)
 				uninit_instance();
 
 			return;
 		}
 	}
+	umutex_unlock(&ta_sessions_lock);
 }
 
 static void to_utee_params(struct utee_params *up, uint32_t param_types,
@@ -366,6 +383,9 @@ TEE_Result __utee_entry(unsigned long func, unsigned long session_id,
 {
 	TEE_Result res;
 
+	/* The core enters a concurrent TA on one stack per thread */
+	__utee_tcb_enter(up);
+
 	switch (func) {
 	case UTEE_ENTRY_FUNC_OPEN_SESSION:
 		res = entry_open_session(session_id, up);
@@ -23,4 +23,18 @@
 #define BENCHMARK_CMD_GET_MEMREF		BENCHMARK_CMD(2)
 #define BENCHMARK_CMD_UNREGISTER		BENCHMARK_CMD(3)
 
+/*
+ * Get the latency percentiles of the std SMC entries, that is the time
+ * needed to select a thread for a new call. Requires CFG_TEE_BENCHMARK.
+ *
+ * [out]	value[0].a	50th percentile in nanoseconds
+ * [out]	value[0].b	90th percentile in nanoseconds
+ * [out]	value[1].a	99th percentile in nanoseconds
+ * [out]	value[1].b	Maximum in nanoseconds
+ * [out]	value[2].a	Number of entries
+ * [out]	value[2].b	Number of entries reusing the thread last freed
+ *				on the same core
+ */
+#define BENCHMARK_CMD_GET_ENTRY_LATENCY		BENCHMARK_CMD(4)
+
 #endif /* __PTA_BENCHMARK_H */
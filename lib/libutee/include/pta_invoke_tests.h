@@ -103,5 +103,85 @@
  */
 #define PTA_INVOKE_TESTS_CMD_MEMREF_NULL	10
 
+/*
+ * Secure storage directory file lookup performance, the dirfile is
+ * populated with a number of objects before each object is looked up.
+ *
+ * [in]     value[0].a	number of objects
+ * [in/out] memref[1]	buffer used as backing store for the dirfile
+ * [out]    value[2].a	microseconds to open the populated dirfile
+ * [out]    value[2].b	average nanoseconds per object lookup
+ */
+#define PTA_INVOKE_TESTS_CMD_FS_DIRFILE_PERF	11
+
+/*
+ * Core heap performance, intended to be invoked concurrently from several
+ * threads to measure contention.
+ *
+ * [in]     value[0].a	number of iterations
+ * [in]     value[0].b	max allocation size in bytes
+ * [out]    value[1].a	average nanoseconds per malloc() and free() pair
+ */
+#define PTA_INVOKE_TESTS_CMD_MALLOC_PERF	12
+
+/*
+ * REE FS write performance, a secure storage object is written with a
+ * number of small writes followed by the same number of large writes.
+ * The object is removed when done.
+ *
+ * [in]     value[0].a	number of writes of each size
+ * [in]     value[0].b	size of the small writes in bytes
+ * [in]     memref[1]	content of each large write
+ * [out]    value[2].a	microseconds spent in the small writes
+ * [out]    value[2].b	microseconds spent in the large writes
+ */
+#define PTA_INVOKE_TESTS_CMD_REE_FS_PERF	13
+
+/*
+ * Pager page save performance, pages of a read/write paged fobj are
+ * encrypted one at a time and then in batches. Only supported with
+ * CFG_WITH_PAGER=y.
+ *
+ * [in]     value[0].a	number of pages in the fobj
+ * [in]     value[0].b	number of times each page is saved in each mode
+ * [out]    value[1].a	pages per second saved one at a time
+ * [out]    value[1].b	pages per second saved in batches
+ */
+#define PTA_INVOKE_TESTS_CMD_PAGER_SAVE_PERF	14
+
+/*
+ * User buffer access check performance, vm_check_access_rights() is
+ * called on a buffer in the address space of the calling TA, which must
+ * be readable and writable. Only supported when called from a TA.
+ *
+ * [in]     value[0].a	virtual address of the buffer in the calling TA
+ * [in]     value[0].b	size of the buffer in bytes
+ * [in]     value[1].a	number of iterations
+ * [out]    value[2].a	average nanoseconds per access check
+ */
+#define PTA_INVOKE_TESTS_CMD_VM_ACCESS_PERF	15
+
+/*
+ * Replace a page in the middle of a shared read-only mapping with a
+ * private copy and restore its protection, as ldelf does for a text
+ * relocation, in the address space of the calling TA. Only supported
+ * when called from a TA.
+ */
+#define PTA_INVOKE_TESTS_CMD_VM_PRIVATE_PAGE	16
+
+/*
+ * Wait until a number of callers are executing this command at the same
+ * time. Invoked from several sessions of a TA with TA_FLAG_CONCURRENT,
+ * each session entered through a separate call from normal world, it
+ * checks that the sessions execute in parallel and that invoking a
+ * concurrent pseudo TA doesn't serialize them.
+ *
+ * [in]     value[0].a	number of callers to wait for
+ * [in]     value[0].b	timeout in milliseconds
+ *
+ * Returns TEE_ERROR_BUSY if the callers didn't meet before the timeout.
+ */
+#define PTA_INVOKE_TESTS_CMD_RENDEZVOUS		17
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
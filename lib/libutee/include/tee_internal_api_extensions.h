@@ -55,6 +55,37 @@ void *tee_map_zi(size_t len, uint32_t flags);
  */
 TEE_Result tee_unmap(void *buf, size_t len);
 
+/*
+ * Segment of input and output data for TEE_CipherUpdateSegments()
+ */
+typedef struct {
+	const void *src;
+	void *dst;
+	size_t len;
+} TEE_CipherSegment;
+
+/*
+ * TEE_CipherUpdateSegments() - Process several buffers with a cipher
+ * @operation:	Cipher operation as for TEE_CipherUpdate()
+ * @segs:	Segments to process in order
+ * @num_segs:	Number of segments in @segs
+ *
+ * Each segment is processed completely, @segs[n].len bytes are written to
+ * @segs[n].dst which may be equal to @segs[n].src. The data is passed
+ * directly to the cipher in as few system calls as possible, so there
+ * must not be any data buffered in the operation and for block cipher
+ * modes each segment must be a multiple of the block size.
+ * TEE_ALG_AES_CTS and TEE_ALG_AES_XTS aren't supported.
+ *
+ * Return TEE_SUCCESS on success, TEE_ERROR_BAD_STATE if data is buffered
+ * by an earlier TEE_CipherUpdate() or TEE_ERROR_BAD_PARAMETERS if the
+ * algorithm or a segment length isn't supported. Panics as
+ * TEE_CipherUpdate() on other errors.
+ */
+TEE_Result TEE_CipherUpdateSegments(TEE_OperationHandle operation,
+				    const TEE_CipherSegment *segs,
+				    size_t num_segs);
+
 /*
  * Convert a UUID string @s into a TEE_UUID @uuid
  * Expected format for @s is: xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
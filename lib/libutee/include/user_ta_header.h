@@ -19,8 +19,14 @@
 #define TA_FLAG_REMAP_SUPPORT		0	 /* Deprecated, was (1 << 6) */
 #define TA_FLAG_CACHE_MAINTENANCE	(1 << 7) /* use cache flush syscall */
 	/*
-	 * TA instance can execute multiple sessions concurrently
-	 * (pseudo-TAs only).
+	 * TA instance can execute multiple sessions concurrently. User TAs
+	 * must also be single instance and multi session, and execute
+	 * serialized anyway with CFG_PAGED_USER_TA=y. Sessions of user TAs
+	 * are still opened one at a time and the last session is closed
+	 * alone, a TA opening a session on a busy concurrent TA gets
+	 * TEE_ERROR_BUSY. An object or operation handle can only be used
+	 * by one thread at a time, the other threads get TEE_ERROR_BUSY
+	 * from the syscalls.
 	 */
 #define TA_FLAG_CONCURRENT		(1 << 8)
 	/*
@@ -111,6 +117,7 @@ extern struct __elf_phdr_info __elf_phdr_info;
 #define TA_PROP_STR_SINGLE_INSTANCE	"gpd.ta.singleInstance"
 #define TA_PROP_STR_MULTI_SESSION	"gpd.ta.multiSession"
 #define TA_PROP_STR_KEEP_ALIVE		"gpd.ta.instanceKeepAlive"
+#define TA_PROP_STR_CONCURRENT		"gpd.ta.concurrent"
 #define TA_PROP_STR_DATA_SIZE		"gpd.ta.dataSize"
 #define TA_PROP_STR_STACK_SIZE		"gpd.ta.stackSize"
 #define TA_PROP_STR_VERSION		"gpd.ta.version"
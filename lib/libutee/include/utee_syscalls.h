@@ -76,6 +76,14 @@ TEE_Result _utee_mask_cancellation(uint32_t *old_mask);
 
 TEE_Result _utee_wait(unsigned long timeout);
 
+/*
+ * Sleeps unless *uaddr != val, until woken by _utee_futex_wake(). Used
+ * by umutex_lock() in TAs with TA_FLAG_CONCURRENT.
+ */
+TEE_Result _utee_futex_wait(unsigned int *uaddr, unsigned long val);
+/* Wakes all threads of the TA sleeping in _utee_futex_wait() */
+TEE_Result _utee_futex_wake(void);
+
 /* cat has type enum _utee_time_category */
 TEE_Result _utee_get_time(unsigned long cat, TEE_Time *time);
 
@@ -100,6 +108,10 @@ TEE_Result _utee_cipher_update(unsigned long state, const void *src,
 			       size_t src_len, void *dest, uint64_t *dest_len);
 TEE_Result _utee_cipher_final(unsigned long state, const void *src,
 			      size_t src_len, void *dest, uint64_t *dest_len);
+/* num_segs is at most UTEE_CIPHER_SEG_MAX */
+TEE_Result _utee_cipher_update_many(unsigned long state,
+				    const struct utee_cipher_seg *segs,
+				    size_t num_segs);
 
 /* Generic Object Functions */
 TEE_Result _utee_cryp_obj_get_info(unsigned long obj, TEE_ObjectInfo *info);
@@ -47,4 +47,17 @@ struct utee_attribute {
 	uint32_t attribute_id;
 };
 
+/* Max number of segments passed to _utee_cipher_update_many() */
+#define UTEE_CIPHER_SEG_MAX	16
+
+/*
+ * Segment of a cipher update, @len bytes are read from @src and the same
+ * number of bytes are written to @dst. @src and @dst may be equal.
+ */
+struct utee_cipher_seg {
+	uint64_t src;
+	uint64_t dst;
+	uint64_t len;
+};
+
 #endif /* UTEE_TYPES_H */
@@ -1036,6 +1036,56 @@ out:
 	return res;
 }
 
+TEE_Result TEE_CipherUpdateSegments(TEE_OperationHandle operation,
+				    const TEE_CipherSegment *segs,
+				    size_t num_segs)
+{
+	struct utee_cipher_seg usegs[UTEE_CIPHER_SEG_MAX] = { };
+	TEE_Result res = TEE_SUCCESS;
+	size_t num = 0;
+	size_t n = 0;
+	size_t m = 0;
+
+	if (operation == TEE_HANDLE_NULL || (!segs && num_segs))
+		TEE_Panic(0);
+
+	if (operation->info.operationClass != TEE_OPERATION_CIPHER ||
+	    !(operation->info.handleState & TEE_HANDLE_FLAG_INITIALIZED) ||
+	    operation->operationState != TEE_OPERATION_STATE_ACTIVE)
+		TEE_Panic(0);
+
+	/*
+	 * The segments bypass op->buffer, which is only possible when
+	 * nothing is held back for a later update or the final block.
+	 */
+	if (operation->buffer_two_blocks)
+		return TEE_ERROR_BAD_PARAMETERS;
+	if (operation->buffer_offs)
+		return TEE_ERROR_BAD_STATE;
+
+	for (n = 0; n < num_segs; n++) {
+		if (!segs[n].src && segs[n].len)
+			TEE_Panic(0);
+		if (segs[n].len % operation->block_size)
+			return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	for (n = 0; n < num_segs; n += num) {
+		num = MIN(num_segs - n, (size_t)UTEE_CIPHER_SEG_MAX);
+		for (m = 0; m < num; m++) {
+			usegs[m].src = (uintptr_t)segs[n + m].src;
+			usegs[m].dst = (uintptr_t)segs[n + m].dst;
+			usegs[m].len = segs[n + m].len;
+		}
+
+		res = _utee_cipher_update_many(operation->state, usegs, num);
+		if (res != TEE_SUCCESS)
+			TEE_Panic(res);
+	}
+
+	return TEE_SUCCESS;
+}
+
 TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
 			     const void *srcData, uint32_t srcLen,
 			     void *destData, uint32_t *destLen)
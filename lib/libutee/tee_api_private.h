@@ -15,6 +15,12 @@ void __utee_from_attr(struct utee_attribute *ua, const TEE_Attribute *attrs,
 TEE_Result __utee_entry(unsigned long func, unsigned long session_id,
 			struct utee_params *up, unsigned long cmd_id);
 
+/*
+ * Selects the TCB of the stack starting at @stack_top, called each time
+ * the TA is entered
+ */
+void __utee_tcb_enter(void *stack_top);
+
 
 #if defined(CFG_TA_GPROF_SUPPORT)
 void __utee_gprof_init(void);
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <compiler.h>
+#include <tee_internal_api.h>
+#include <umutex.h>
+#include <user_ta_header.h>
+#include <utee_syscalls.h>
+
+#ifdef __LDELF__
+
+/* ldelf always executes alone in the TA context */
+bool umutex_ext_is_concurrent(void)
+{
+	return false;
+}
+
+void umutex_ext_wait(unsigned int *state __unused, unsigned int val __unused)
+{
+}
+
+void umutex_ext_wake(void)
+{
+}
+
+#else /*__LDELF__*/
+
+/* From user_ta_header.c, built within TA */
+extern struct ta_head ta_head;
+
+bool umutex_ext_is_concurrent(void)
+{
+	return ta_head.flags & TA_FLAG_CONCURRENT;
+}
+
+void umutex_ext_wait(unsigned int *state, unsigned int val)
+{
+	TEE_Result res = _utee_futex_wait(state, val);
+
+	/* Fails if another thread has panicked the TA meanwhile */
+	if (res)
+		TEE_Panic(res);
+}
+
+void umutex_ext_wake(void)
+{
+	TEE_Result res = _utee_futex_wake();
+
+	if (res)
+		TEE_Panic(res);
+}
+
+#endif /*__LDELF__*/
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+#ifndef __UMUTEX_H
+#define __UMUTEX_H
+
+#include <types_ext.h>
+
+/*
+ * struct umutex - Mutex shared by the threads of a user mode context
+ * @state:	UMUTEX_UNLOCKED, UMUTEX_LOCKED or UMUTEX_CONTENDED
+ *
+ * Only several threads of a TA with TA_FLAG_CONCURRENT execute in the
+ * same context, umutex_lock() and umutex_unlock() do nothing for other
+ * TAs and ldelf. A thread failing to get the mutex retries a bounded
+ * number of times in case the owner is about to release it, then sleeps
+ * in the core until it's released.
+ */
+struct umutex {
+	unsigned int state;
+};
+
+#define UMUTEX_UNLOCKED		0
+#define UMUTEX_LOCKED		1
+#define UMUTEX_CONTENDED	2	/* Locked, threads may be sleeping */
+
+#define UMUTEX_INITIALIZER	{ .state = UMUTEX_UNLOCKED }
+
+void umutex_lock(struct umutex *m);
+void umutex_unlock(struct umutex *m);
+
+/*
+ * Implemented by the user mode library libutils is linked with.
+ * umutex_ext_is_concurrent() returns true if several threads may execute
+ * in the context. umutex_ext_wait() sleeps unless *@state != @val or until
+ * woken by umutex_ext_wake(), which wakes all threads sleeping in the
+ * context. Spurious wakeups are allowed.
+ */
+bool umutex_ext_is_concurrent(void);
+void umutex_ext_wait(unsigned int *state, unsigned int val);
+void umutex_ext_wake(void);
+
+#endif /*__UMUTEX_H*/
@@ -16,6 +16,8 @@
 #include <kernel/mutex.h>
 #include <kernel/panic.h>
 #include <kernel/thread.h>
+#else
+#include <umutex.h>
 #endif
 
 /*
@@ -63,6 +65,8 @@ struct mempool {
 #if defined(__KERNEL__)
 	void (*release_mem)(void *ptr, size_t size);
 	struct recursive_mutex mu;
+#else
+	struct umutex mu;
 #endif
 };
 
@@ -94,6 +98,27 @@ static void put_pool(struct mempool *pool __maybe_unused)
 #endif
 }
 
+/*
+ * The threads of a TA with TA_FLAG_CONCURRENT share the pools of the TA,
+ * for instance the one behind the TEE_BigInt functions. Items of
+ * different threads are allocated and freed interleaved so in user mode
+ * the pool is only locked while it's updated. The kernel instead keeps
+ * the pool locked with get_pool() as long as any item is allocated.
+ */
+static void lock_pool(struct mempool *pool __maybe_unused)
+{
+#if !defined(__KERNEL__)
+	umutex_lock(&pool->mu);
+#endif
+}
+
+static void unlock_pool(struct mempool *pool __maybe_unused)
+{
+#if !defined(__KERNEL__)
+	umutex_unlock(&pool->mu);
+#endif
+}
+
 struct mempool *
 mempool_alloc_pool(void *data, size_t size,
 		   void (*release_mem)(void *ptr, size_t size) __maybe_unused)
@@ -123,6 +148,7 @@ void *mempool_alloc(struct mempool *pool, size_t size)
 	struct mempool_item *last_item = NULL;
 
 	get_pool(pool);
+	lock_pool(pool);
 
 	if (pool->last_offset < 0) {
 		offset = 0;
@@ -155,10 +181,12 @@ void *mempool_alloc(struct mempool *pool, size_t size)
 		     (size_t)pool->max_last_offset);
 	}
 #endif
+	unlock_pool(pool);
 
 	return new_item + 1;
 
 error:
+	unlock_pool(pool);
 	EMSG("Failed to allocate %zu bytes, please tune the pool size", size);
 	put_pool(pool);
 	return NULL;
@@ -191,6 +219,7 @@ void mempool_free(struct mempool *pool, void *ptr)
 
 	item = (struct mempool_item *)((vaddr_t)ptr -
 				       sizeof(struct mempool_item));
+	lock_pool(pool);
 	if (item->prev_item_offset >= 0) {
 		prev_item = (struct mempool_item *)(pool->data +
 						    item->prev_item_offset);
@@ -206,5 +235,6 @@ void mempool_free(struct mempool *pool, void *ptr)
 	}
 
 	pool->last_offset = last_offset;
+	unlock_pool(pool);
 	put_pool(pool);
 }
@@ -8,6 +8,9 @@ srcs-y += mempool.c
 srcs-y += nex_strdup.c
 srcs-y += consttime_memcmp.c
 srcs-y += memzero_explicit.c
+ifneq ($(sm),core)
+srcs-y += umutex.c
+endif
 
 subdirs-$(arch_arm) += arch/$(ARCH)
 subdirs-y += ftrace
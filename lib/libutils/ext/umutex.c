@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2021, Linaro Limited
+ */
+
+#include <compiler.h>
+#include <umutex.h>
+
+/* Attempts to get a locked mutex before sleeping */
+#define UMUTEX_SPIN_COUNT	100
+
+void umutex_lock(struct umutex *m)
+{
+	unsigned int state = UMUTEX_UNLOCKED;
+	unsigned int n = 0;
+
+	if (!umutex_ext_is_concurrent())
+		return;
+
+	for (n = 0; n < UMUTEX_SPIN_COUNT; n++) {
+		state = UMUTEX_UNLOCKED;
+		if (__compiler_compare_and_swap(&m->state, &state,
+						UMUTEX_LOCKED))
+			return;
+		/* Don't overtake threads already sleeping */
+		if (state == UMUTEX_CONTENDED)
+			break;
+	}
+
+	/*
+	 * The mutex is taken as contended even if no other thread is
+	 * sleeping any longer, at worst umutex_unlock() makes a needless
+	 * wakeup.
+	 */
+	while (__atomic_exchange_n(&m->state, UMUTEX_CONTENDED,
+				   __ATOMIC_ACQUIRE) != UMUTEX_UNLOCKED)
+		umutex_ext_wait(&m->state, UMUTEX_CONTENDED);
+}
+
+void umutex_unlock(struct umutex *m)
+{
+	if (!umutex_ext_is_concurrent())
+		return;
+
+	if (__atomic_exchange_n(&m->state, UMUTEX_UNLOCKED,
+				__ATOMIC_RELEASE) == UMUTEX_CONTENDED)
+		umutex_ext_wake();
+}
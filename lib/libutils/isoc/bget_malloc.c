@@ -77,6 +77,11 @@
 #define BufStats    1
 #endif
 
+#if defined(__KERNEL__) && defined(CFG_CORE_MALLOC_MAGAZINES) && \
+	!defined(ENABLE_MDBG) && !defined(CFG_CORE_SANITIZE_KADDRESS)
+#define WITH_MAGAZINES	1
+#endif
+
 #include <compiler.h>
 #include <malloc.h>
 #include <stdbool.h>
@@ -90,6 +95,7 @@
 #if defined(__KERNEL__)
 /* Compiling for TEE Core */
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/thread.h>
 #include <kernel/spinlock.h>
 #include <kernel/unwind.h>
@@ -117,6 +123,7 @@ static __maybe_unused void *memcpy_unchecked(void *dst, const void *src,
 
 #else /*__KERNEL__*/
 /* Compiling for TA */
+#include <umutex.h>
 
 static void tag_asan_free(void *buf __unused, size_t len __unused)
 {
@@ -146,6 +153,36 @@ struct malloc_pool {
 	size_t len;
 };
 
+#ifdef WITH_MAGAZINES
+/*
+ * Small buffers are cached per core in size classes from
+ * BIT(MAG_MIN_SHIFT) to BIT(MAG_MAX_SHIFT) bytes. A class holds buffers
+ * of at least the class size and less than twice the class size.
+ */
+#define MAG_MIN_SHIFT		4
+#define MAG_MAX_SHIFT		9
+#define MAG_NUM_CLASSES		(MAG_MAX_SHIFT - MAG_MIN_SHIFT + 1)
+#define MAG_SIZE		8
+#define MAG_BATCH		(MAG_SIZE / 2)
+
+/*
+ * struct malloc_mag - per core cache of small buffers
+ * @lock:	Protects this struct, only contended when the caches of all
+ *		cores are flushed
+ * @cached:	Number of bytes in buffers held by this struct
+ * @count:	Number of buffers in each size class
+ * @bufs:	Buffers in each size class
+ *
+ * The buffers held here are allocated as far as bget is concerned.
+ */
+struct malloc_mag {
+	unsigned int lock;
+	size_t cached;
+	unsigned int count[MAG_NUM_CLASSES];
+	void *bufs[MAG_NUM_CLASSES][MAG_SIZE];
+};
+#endif
+
 struct malloc_ctx {
 	struct bpoolset poolset;
 	struct malloc_pool *pool;
@@ -155,6 +192,11 @@ struct malloc_ctx {
 #endif
 #ifdef __KERNEL__
 	unsigned int spinlock;
+#else
+	struct umutex mu;
+#endif
+#ifdef WITH_MAGAZINES
+	struct malloc_mag mag[CFG_TEE_CORE_NB_CORE];
 #endif
 };
 
@@ -172,14 +214,17 @@ static void malloc_unlock(struct malloc_ctx *ctx, uint32_t exceptions)
 
 #else  /* __KERNEL__ */
 
-static uint32_t malloc_lock(struct malloc_ctx *ctx __unused)
+/* Several threads may execute in a TA with TA_FLAG_CONCURRENT */
+static uint32_t malloc_lock(struct malloc_ctx *ctx)
 {
+	umutex_lock(&ctx->mu);
 	return 0;
 }
 
-static void malloc_unlock(struct malloc_ctx *ctx __unused,
+static void malloc_unlock(struct malloc_ctx *ctx,
 			  uint32_t exceptions __unused)
 {
+	umutex_unlock(&ctx->mu);
 }
 
 #endif	/* __KERNEL__ */
@@ -205,11 +250,16 @@ static void print_oom(size_t req_size __maybe_unused, void *ctx __maybe_unused)
 
 #ifdef BufStats
 
-static void raw_malloc_return_hook(void *p, size_t requested_size,
-				   struct malloc_ctx *ctx)
+static void update_max_allocated(struct malloc_ctx *ctx)
 {
 	if (ctx->poolset.totalloc > ctx->mstats.max_allocated)
 		ctx->mstats.max_allocated = ctx->poolset.totalloc;
+}
+
+static void raw_malloc_return_hook(void *p, size_t requested_size,
+				   struct malloc_ctx *ctx)
+{
+	update_max_allocated(ctx);
 
 	if (!p) {
 		ctx->mstats.num_alloc_fail++;
@@ -238,13 +288,36 @@ void malloc_reset_stats(void)
 	gen_malloc_reset_stats(&malloc_ctx);
 }
 
+#ifdef WITH_MAGAZINES
+static size_t mag_cached_bytes(struct malloc_ctx *ctx)
+{
+	size_t res = 0;
+	size_t n = 0;
+
+	/* Only an estimate since the caches of other cores may change */
+	for (n = 0; n < ARRAY_SIZE(ctx->mag); n++)
+		res += ctx->mag[n].cached;
+
+	return res;
+}
+#else
+static size_t mag_cached_bytes(struct malloc_ctx *ctx __unused)
+{
+	return 0;
+}
+#endif
+
 static void gen_malloc_get_stats(struct malloc_ctx *ctx,
 				 struct malloc_stats *stats)
 {
 	uint32_t exceptions = malloc_lock(ctx);
 
 	memcpy_unchecked(stats, &ctx->mstats, sizeof(*stats));
-	stats->allocated = ctx->poolset.totalloc;
+	/*
+	 * Buffers held in the per core caches aren't counted as allocated,
+	 * but max_allocated includes them.
+	 */
+	stats->allocated = ctx->poolset.totalloc - mag_cached_bytes(ctx);
 	malloc_unlock(ctx, exceptions);
 }
 
@@ -255,6 +328,10 @@ void malloc_get_stats(struct malloc_stats *stats)
 
 #else /* BufStats */
 
+static void __maybe_unused update_max_allocated(struct malloc_ctx *ctx __unused)
+{
+}
+
 static void raw_malloc_return_hook(void *p, size_t requested_size,
 				   struct malloc_ctx *ctx )
 {
@@ -686,33 +763,240 @@ void mdbg_check(int bufdump)
 }
 #else
 
-void *malloc(size_t size)
+#ifdef WITH_MAGAZINES
+/* Returns the size class which can serve an allocation of @size bytes */
+static int mag_alloc_class(size_t size)
+{
+	int shift = MAG_MIN_SHIFT;
+
+	if (size > BIT(MAG_MAX_SHIFT))
+		return -1;
+	while (BIT(shift) < size)
+		shift++;
+
+	return shift - MAG_MIN_SHIFT;
+}
+
+/* Returns the size class which a freed buffer of @size bytes belongs to */
+static int mag_free_class(size_t size)
+{
+	int shift = MAG_MAX_SHIFT;
+
+	if (size < BIT(MAG_MIN_SHIFT) || size >= BIT(MAG_MAX_SHIFT + 1))
+		return -1;
+	while (BIT(shift) > size)
+		shift--;
+
+	return shift - MAG_MIN_SHIFT;
+}
+
+static struct malloc_mag *mag_lock(struct malloc_ctx *ctx,
+				   uint32_t *exceptions)
+{
+	struct malloc_mag *mag = NULL;
+
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	mag = ctx->mag + get_core_pos();
+	cpu_spin_lock(&mag->lock);
+
+	return mag;
+}
+
+static void mag_unlock(struct malloc_mag *mag, uint32_t exceptions)
+{
+	cpu_spin_unlock(&mag->lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+static void mag_push(struct malloc_mag *mag, int c, void *p)
+{
+	assert(mag->count[c] < MAG_SIZE);
+	mag->bufs[c][mag->count[c]] = p;
+	mag->count[c]++;
+	mag->cached += bget_buf_size(p);
+}
+
+static void *mag_pop(struct malloc_mag *mag, int c)
+{
+	void *p = NULL;
+
+	if (!mag->count[c])
+		return NULL;
+
+	mag->count[c]--;
+	p = mag->bufs[c][mag->count[c]];
+	mag->cached -= bget_buf_size(p);
+
+	return p;
+}
+
+/* Called with the cache of the current core locked */
+static void mag_refill(struct malloc_ctx *ctx, struct malloc_mag *mag, int c)
+{
+	uint32_t exceptions = malloc_lock(ctx);
+	unsigned int n = 0;
+	void *p = NULL;
+
+	raw_malloc_validate_pools(ctx);
+
+	for (n = 0; n < MAG_BATCH; n++) {
+		p = bget(SizeQ, 0, BIT(c + MAG_MIN_SHIFT), &ctx->poolset);
+		if (!p)
+			break;
+		mag_push(mag, c, p);
+	}
+	update_max_allocated(ctx);
+
+	malloc_unlock(ctx, exceptions);
+}
+
+/* Returns up to @count buffers of size class @c to bget */
+static void mag_drain(struct malloc_ctx *ctx, struct malloc_mag *mag, int c,
+		      unsigned int count)
+{
+	uint32_t exceptions = malloc_lock(ctx);
+	unsigned int n = 0;
+
+	for (n = 0; n < count && mag->count[c]; n++)
+		raw_free(mag_pop(mag, c), ctx, false);
+
+	malloc_unlock(ctx, exceptions);
+}
+
+/*
+ * Returns all buffers in the caches of all cores to bget, used as a last
+ * resort before an allocation fails.
+ */
+static void mag_flush_all(struct malloc_ctx *ctx)
+{
+	uint32_t exceptions = 0;
+	size_t n = 0;
+	int c = 0;
+
+	for (n = 0; n < ARRAY_SIZE(ctx->mag); n++) {
+		exceptions = cpu_spin_lock_xsave(&ctx->mag[n].lock);
+		for (c = 0; c < MAG_NUM_CLASSES; c++)
+			mag_drain(ctx, ctx->mag + n, c, MAG_SIZE);
+		cpu_spin_unlock_xrestore(&ctx->mag[n].lock, exceptions);
+	}
+}
+
+static void *gen_malloc(struct malloc_ctx *ctx, size_t size)
+{
+	int c = mag_alloc_class(size);
+	struct malloc_mag *mag = NULL;
+	uint32_t exceptions = 0;
+	void *p = NULL;
+
+	if (c >= 0) {
+		mag = mag_lock(ctx, &exceptions);
+		p = mag_pop(mag, c);
+		if (!p) {
+			mag_refill(ctx, mag, c);
+			p = mag_pop(mag, c);
+		}
+		mag_unlock(mag, exceptions);
+		if (p)
+			return p;
+
+		mag_flush_all(ctx);
+	}
+
+	exceptions = malloc_lock(ctx);
+	p = raw_malloc(0, 0, size, ctx);
+	malloc_unlock(ctx, exceptions);
+	return p;
+}
+
+static void gen_free(struct malloc_ctx *ctx, void *ptr, bool wipe)
+{
+	struct malloc_mag *mag = NULL;
+	uint32_t exceptions = 0;
+	int c = -1;
+
+	if (!ptr)
+		return;
+
+	/* Buffers to be wiped are returned directly to bget */
+	if (!wipe)
+		c = mag_free_class(bget_buf_size(ptr));
+
+	if (c >= 0) {
+		mag = mag_lock(ctx, &exceptions);
+		if (mag->count[c] == MAG_SIZE)
+			mag_drain(ctx, mag, c, MAG_BATCH);
+		mag_push(mag, c, ptr);
+		mag_unlock(mag, exceptions);
+		return;
+	}
+
+	exceptions = malloc_lock(ctx);
+	raw_free(ptr, ctx, wipe);
+	malloc_unlock(ctx, exceptions);
+}
+
+static void *gen_calloc(struct malloc_ctx *ctx, size_t nmemb, size_t size)
+{
+	uint32_t exceptions = 0;
+	size_t s = 0;
+	void *p = NULL;
+
+	if (!MUL_OVERFLOW(nmemb, size, &s) && mag_alloc_class(s) >= 0) {
+		p = gen_malloc(ctx, s);
+		if (p)
+			memset(p, 0, s);
+		return p;
+	}
+
+	exceptions = malloc_lock(ctx);
+	p = raw_calloc(0, 0, nmemb, size, ctx);
+	malloc_unlock(ctx, exceptions);
+	return p;
+}
+#else /*WITH_MAGAZINES*/
+static void *gen_malloc(struct malloc_ctx *ctx, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions = malloc_lock(ctx);
 
-	p = raw_malloc(0, 0, size, &malloc_ctx);
-	malloc_unlock(&malloc_ctx, exceptions);
+	p = raw_malloc(0, 0, size, ctx);
+	malloc_unlock(ctx, exceptions);
 	return p;
 }
 
-static void free_helper(void *ptr, bool wipe)
+static void gen_free(struct malloc_ctx *ctx, void *ptr, bool wipe)
 {
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions = malloc_lock(ctx);
 
-	raw_free(ptr, &malloc_ctx, wipe);
-	malloc_unlock(&malloc_ctx, exceptions);
+	raw_free(ptr, ctx, wipe);
+	malloc_unlock(ctx, exceptions);
 }
 
-void *calloc(size_t nmemb, size_t size)
+static void *gen_calloc(struct malloc_ctx *ctx, size_t nmemb, size_t size)
 {
 	void *p;
-	uint32_t exceptions = malloc_lock(&malloc_ctx);
+	uint32_t exceptions = malloc_lock(ctx);
 
-	p = raw_calloc(0, 0, nmemb, size, &malloc_ctx);
-	malloc_unlock(&malloc_ctx, exceptions);
+	p = raw_calloc(0, 0, nmemb, size, ctx);
+	malloc_unlock(ctx, exceptions);
 	return p;
 }
+#endif /*WITH_MAGAZINES*/
+
+void *malloc(size_t size)
+{
+	return gen_malloc(&malloc_ctx, size);
+}
+
+static void free_helper(void *ptr, bool wipe)
+{
+	gen_free(&malloc_ctx, ptr, wipe);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	return gen_calloc(&malloc_ctx, nmemb, size);
+}
 
 static void *realloc_unlocked(struct malloc_ctx *ctx, void *ptr,
 			      size_t size)
@@ -884,22 +1168,12 @@ bool malloc_buffer_overlaps_heap(void *buf, size_t len)
 
 void *nex_malloc(size_t size)
 {
-	void *p;
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
-
-	p = raw_malloc(0, 0, size, &nex_malloc_ctx);
-	malloc_unlock(&nex_malloc_ctx, exceptions);
-	return p;
+	return gen_malloc(&nex_malloc_ctx, size);
 }
 
 void *nex_calloc(size_t nmemb, size_t size)
 {
-	void *p;
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
-
-	p = raw_calloc(0, 0, nmemb, size, &nex_malloc_ctx);
-	malloc_unlock(&nex_malloc_ctx, exceptions);
-	return p;
+	return gen_calloc(&nex_malloc_ctx, nmemb, size);
 }
 
 void *nex_realloc(void *ptr, size_t size)
@@ -924,10 +1198,7 @@ void *nex_memalign(size_t alignment, size_t size)
 
 void nex_free(void *ptr)
 {
-	uint32_t exceptions = malloc_lock(&nex_malloc_ctx);
-
-	raw_free(ptr, &nex_malloc_ctx, false /* !wipe */);
-	malloc_unlock(&nex_malloc_ctx, exceptions);
+	gen_free(&nex_malloc_ctx, ptr, false /* !wipe */);
 }
 
 #else  /* ENABLE_MDBG */
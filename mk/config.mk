@@ -139,6 +139,14 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Number of decrypted 4 kB data blocks cached by the REE FS, shared by all
+# open files. Modified blocks are written back in one ordered pass when the
+# file hash tree is synced to storage instead of once per update. The cache
+# takes at most this many blocks from the core heap (see
+# CFG_CORE_HEAP_SIZE) regardless of the number of open files, the default
+# uses 16 kB. Must be at least 1.
+CFG_REE_FS_BLOCK_CACHE_SIZE ?= 4
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -180,6 +188,15 @@ CFG_RPMB_FS_RD_ENTRIES ?= 8
 # in case the cache is too small to hold all elements when traversing.
 CFG_RPMB_FS_CACHE_ENTRIES ?= 0
 
+# When enabled, all FAT FS entries are kept in heap memory after they have
+# first been read in, together with an index from filename to FAT entry.
+# Opening a file then needs no RPMB reads and creating a file finds an
+# unused FAT entry directly. The cache follows the writes made by the RPMB
+# FS and is read in again if the RPMB write counter changed otherwise.
+# Costs sizeof(struct rpmb_fat_entry) + 4 bytes of heap memory per FAT FS
+# entry. CFG_RPMB_FS_CACHE_ENTRIES is ignored when this is enabled.
+CFG_RPMB_FS_FAT_CACHE ?= n
+
 # Enables RPMB key programming by the TEE, in case the RPMB partition has not
 # been configured yet.
 # !!! Security warning !!!
@@ -285,6 +302,22 @@ CFG_REE_FS_TA ?= y
 CFG_REE_FS_TA_BUFFERED ?= n
 $(eval $(call cfg-depends-all,CFG_REE_FS_TA_BUFFERED,CFG_REE_FS_TA))
 
+# Number of verified TA binaries kept in the "Secure DDR" pool by the
+# buffered REE FS TA store after their last session is closed. The signed
+# header of a TA is still fetched from normal world and verified when the
+# TA is loaded, if its digest matches a cached binary the rest of the TA
+# isn't copied, decrypted and hashed again. A TA updated in normal world
+# replaces the cached binary, the rollback protection of bootstrap and
+# encrypted TAs is still checked. Cached binaries not in use are freed when
+# the "Secure DDR" pool runs out of memory. Requires
+# CFG_REE_FS_TA_BUFFERED=y.
+CFG_REE_FS_TA_CACHE_ENTRIES ?= 0
+ifneq ($(CFG_REE_FS_TA_CACHE_ENTRIES),0)
+ifneq ($(CFG_REE_FS_TA_BUFFERED),y)
+$(error CFG_REE_FS_TA_CACHE_ENTRIES requires CFG_REE_FS_TA_BUFFERED=y)
+endif
+endif
+
 # Support for loading user TAs from a special section in the TEE binary.
 # Such TAs are available even before tee-supplicant is available (hence their
 # name), but note that many services exported to TAs may need tee-supplicant,
@@ -341,6 +374,11 @@ CFG_WITH_PAGER ?= n
 CFG_LOCKDEP ?= n
 CFG_LOCKDEP_RECORD_STACK ?= y
 
+# Max time in microseconds a thread spins on a mutex write locked by a
+# thread running on another core before it waits in normal world for the
+# mutex, which costs a round trip to normal world. 0 disables spinning.
+CFG_MUTEX_SPIN_US ?= 20
+
 # BestFit algorithm in bget reduces the fragmentation of the heap when running
 # with the pager enabled or lockdep
 CFG_CORE_BGET_BESTFIT ?= $(call cfg-one-enabled, CFG_WITH_PAGER CFG_LOCKDEP)
@@ -348,6 +386,27 @@ CFG_CORE_BGET_BESTFIT ?= $(call cfg-one-enabled, CFG_WITH_PAGER CFG_LOCKDEP)
 # Use the pager for user TAs
 CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 
+# Page replacement policy of the pager. The default policy unmaps (hides)
+# a third of the pageable pages on each fault to track which pages are in
+# use. With CFG_PAGER_CLOCK=y a CLOCK (second chance) policy is used
+# instead, pages are only hidden while searching for a page to evict.
+CFG_PAGER_CLOCK ?= n
+
+# Maximum number of pages the pager loads ahead of a fault in a read-only
+# area when the faults in the area are sequential, 0 disables fault-around.
+# Only unused physical pages are used for the pages loaded ahead.
+CFG_PAGER_FAULT_AROUND ?= 0
+
+# Maximum number of dirty pages the pager saves at once when evicting a
+# dirty page. Hidden dirty pages near the eviction point are encrypted
+# together with the evicted page, 1 saves only the evicted page.
+CFG_PAGER_WRITEBACK_BATCH ?= 1
+
+# When saving a read/write paged page which is filled with a repeated
+# 64-bit value, for instance zeroes, only the value is kept instead of
+# encrypting and storing the page.
+CFG_PAGER_SAME_FILLED ?= y
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -427,6 +486,12 @@ CFG_CORE_HEAP_SIZE ?= 65536
 # is enabled
 CFG_CORE_NEX_HEAP_SIZE ?= 16384
 
+# Caches small heap buffers (16 to 512 bytes) per core in front of the
+# core heap. Reduces contention on the heap lock when many threads
+# allocate concurrently at the cost of some memory held in the caches.
+# Ignored with CFG_TEE_CORE_MALLOC_DEBUG=y or CFG_CORE_SANITIZE_KADDRESS=y.
+CFG_CORE_MALLOC_MAGAZINES ?= n
+
 # TA profiling.
 # When this option is enabled, OP-TEE can execute Trusted Applications
 # instrumented with GCC's -pg flag and will output profiling information
@@ -103,6 +103,9 @@ const struct user_ta_property ta_props[] = {
 	{TA_PROP_STR_KEEP_ALIVE, USER_TA_PROP_TYPE_BOOL,
 	 &(const bool){(TA_FLAGS & TA_FLAG_INSTANCE_KEEP_ALIVE) != 0}},
 
+	{TA_PROP_STR_CONCURRENT, USER_TA_PROP_TYPE_BOOL,
+	 &(const bool){(TA_FLAGS & TA_FLAG_CONCURRENT) != 0}},
+
 	{TA_PROP_STR_DATA_SIZE, USER_TA_PROP_TYPE_U32,
 	 &(const uint32_t){TA_DATA_SIZE}},
 
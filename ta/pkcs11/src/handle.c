@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
+#include <util.h>
 
 #include "handle.h"
 
@@ -17,6 +18,99 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+/*
+ * Unused locations in db->ptrs form a singly linked list starting at
+ * db->free_head. An unused location holds the index of the next unused
+ * location shifted left one bit with bit 0 set, this can't be mistaken
+ * for a pointer since those are at least 2 byte aligned. Index 0 is
+ * reserved as invalid handle so it also terminates the list.
+ */
+static void *free_slot(uint32_t next_free)
+{
+	return (void *)(((uintptr_t)next_free << 1) | 1);
+}
+
+static bool is_free_slot(void *p)
+{
+	return (uintptr_t)p & 1;
+}
+
+static uint32_t next_free(void *p)
+{
+	return (uintptr_t)p >> 1;
+}
+
+static bool is_valid_handle(struct handle_db *db, uint32_t handle)
+{
+	return db && handle && handle < db->max_ptrs &&
+	       !is_free_slot(db->ptrs[handle]);
+}
+
+/* Links the unused locations [begin, end) in ascending order */
+static void link_free_slots(struct handle_db *db, uint32_t begin,
+			    uint32_t end)
+{
+	uint32_t n = 0;
+
+	for (n = end; n > begin; n--) {
+		db->ptrs[n - 1] = free_slot(db->free_head);
+		db->free_head = n - 1;
+	}
+}
+
+/* Truncates the ptrs array, all dropped locations must be unused */
+static void shrink(struct handle_db *db, uint32_t new_max_ptrs)
+{
+	uint32_t n = 0;
+	void *p = NULL;
+
+	p = TEE_Realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+	if (!p)
+		return;
+	db->ptrs = p;
+	db->max_ptrs = new_max_ptrs;
+
+	/* Rebuild the list of unused locations without the dropped ones */
+	db->free_head = 0;
+	for (n = new_max_ptrs - 1; n > 0; n--) {
+		if (is_free_slot(db->ptrs[n])) {
+			db->ptrs[n] = free_slot(db->free_head);
+			db->free_head = n;
+		}
+	}
+}
+
+/*
+ * Shrinks the ptrs array to the initial capacity when the database
+ * becomes empty, or to half its size when the number of used handles
+ * drops to a quarter of the capacity and the upper half is unused. The
+ * latter is only checked when crossing the threshold so the array is
+ * scanned at most once per a number of operations proportional to its
+ * size.
+ */
+static void maybe_shrink(struct handle_db *db)
+{
+	uint32_t new_max_ptrs = db->max_ptrs / 2;
+	uint32_t n = 0;
+
+	if (db->max_ptrs <= HANDLE_DB_INITIAL_MAX_PTRS)
+		return;
+
+	if (!db->num_used) {
+		shrink(db, HANDLE_DB_INITIAL_MAX_PTRS);
+		return;
+	}
+
+	if (db->num_used != db->max_ptrs / 4)
+		return;
+
+	for (n = new_max_ptrs; n < db->max_ptrs; n++)
+		if (!is_free_slot(db->ptrs[n]))
+			return;
+
+	shrink(db, new_max_ptrs);
+}
+
 void handle_db_init(struct handle_db *db)
 {
 	TEE_MemFill(db, 0, sizeof(*db));
@@ -26,8 +120,7 @@ void handle_db_destroy(struct handle_db *db)
 {
 	if (db) {
 		TEE_Free(db->ptrs);
-		db->ptrs = NULL;
-		db->max_ptrs = 0;
+		handle_db_init(db);
 	}
 }
 
@@ -37,33 +130,34 @@ uint32_t handle_get(struct handle_db *db, void *ptr)
 	void *p = NULL;
 	uint32_t new_max_ptrs = 0;
 
-	if (!db || !ptr)
+	if (!db || !ptr || is_free_slot(ptr))
 		return 0;
 
-	/* Try to find an empty location (index 0 is reserved as invalid) */
-	for (n = 1; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
+	if (!db->free_head) {
+		/* No location available, grow the ptrs array */
+		if (db->max_ptrs)
+			new_max_ptrs = db->max_ptrs * 2;
+		else
+			new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
+		if (new_max_ptrs <= db->max_ptrs)
+			return 0;
+
+		p = TEE_Realloc(db->ptrs, new_max_ptrs * sizeof(void *));
+		if (!p)
+			return 0;
+		db->ptrs = p;
+		/* Index 0 is reserved as invalid */
+		if (!db->max_ptrs)
+			db->ptrs[0] = NULL;
+		link_free_slots(db, MAX(db->max_ptrs, 1U), new_max_ptrs);
+		db->max_ptrs = new_max_ptrs;
 	}
 
-	/* No location available, grow the ptrs array */
-	if (db->max_ptrs)
-		new_max_ptrs = db->max_ptrs * 2;
-	else
-		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-
-	p = TEE_Realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
-		return 0;
-	db->ptrs = p;
-	TEE_MemFill(db->ptrs + db->max_ptrs, 0,
-		    (new_max_ptrs - db->max_ptrs) * sizeof(void *));
-	db->max_ptrs = new_max_ptrs;
-
-	/* Since n stopped at db->max_ptrs there is an empty location there */
+	n = db->free_head;
+	db->free_head = next_free(db->ptrs[n]);
 	db->ptrs[n] = ptr;
+	db->num_used++;
+
 	return n;
 }
 
@@ -71,17 +165,22 @@ void *handle_put(struct handle_db *db, uint32_t handle)
 {
 	void *p = NULL;
 
-	if (!db || !handle || handle >= db->max_ptrs)
+	if (!is_valid_handle(db, handle))
 		return NULL;
 
 	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	db->ptrs[handle] = free_slot(db->free_head);
+	db->free_head = handle;
+	db->num_used--;
+
+	maybe_shrink(db);
+
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, uint32_t handle)
 {
-	if (!db || !handle || handle >= db->max_ptrs)
+	if (!is_valid_handle(db, handle))
 		return NULL;
 
 	return db->ptrs[handle];
@@ -91,7 +190,7 @@ uint32_t handle_lookup_handle(struct handle_db *db, void *ptr)
 {
 	uint32_t n = 0;
 
-	if (ptr) {
+	if (ptr && !is_free_slot(ptr)) {
 		for (n = 1; n < db->max_ptrs; n++)
 			if (db->ptrs[n] == ptr)
 				return n;
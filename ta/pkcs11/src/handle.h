@@ -8,9 +8,21 @@
 
 #include <stddef.h>
 
+/*
+ * struct handle_db - database of handles
+ * @ptrs:	Array of pointers indexed by handle, unused locations are
+ *		linked in a list of free locations
+ * @max_ptrs:	Number of locations in @ptrs
+ * @num_used:	Number of used locations in @ptrs
+ * @free_head:	Index of the first free location, 0 if there's none
+ *
+ * Allocating, releasing and looking up a handle are all O(1) operations.
+ */
 struct handle_db {
 	void **ptrs;
 	uint32_t max_ptrs;
+	uint32_t num_used;
+	uint32_t free_head;
 };
 
 /*
@@ -27,13 +39,15 @@ void handle_db_destroy(struct handle_db *db);
 
 /*
  * Allocate a new handle ID and assigns the supplied pointer to it,
+ * ptr must be at least 2 byte aligned.
  * The function returns > 0 on success and 0 on failure.
  */
 uint32_t handle_get(struct handle_db *db, void *ptr);
 
 /*
  * Deallocate a handle. Returns the associated pointer of the handle
- * if the handle was valid or NULL if it's invalid.
+ * if the handle was valid or NULL if it's invalid. The database may be
+ * shrunk when enough handles have been deallocated.
  */
 void *handle_put(struct handle_db *db, uint32_t handle);
 
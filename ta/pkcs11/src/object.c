@@ -8,6 +8,7 @@
 #include <string_ext.h>
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
+#include <util.h>
 
 #include "attributes.h"
 #include "handle.h"
@@ -64,6 +65,121 @@ static void cleanup_volatile_obj_ref(struct pkcs11_object *obj)
 	TEE_Free(obj);
 }
 
+/* FNV-1a hash of an attribute value, never 0 as 0 stands for no attribute */
+static uint32_t index_hash(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	uint32_t hash = 2166136261;
+	size_t n = 0;
+
+	for (n = 0; n < size; n++)
+		hash = (hash ^ p[n]) * 16777619;
+
+	return hash ? hash : 1;
+}
+
+static size_t index_bucket(uint32_t hash)
+{
+	return hash & (PKCS11_TOKEN_INDEX_BUCKETS - 1);
+}
+
+static void set_obj_index(struct pkcs11_obj_index *idx, struct obj_attrs *head)
+{
+	void *value = NULL;
+	uint32_t size = 0;
+
+	idx->class = get_class(head);
+	idx->key_type = get_key_type(head);
+
+	idx->id_hash = 0;
+	if (get_attribute_ptr(head, PKCS11_CKA_ID, &value, &size) ==
+	    PKCS11_CKR_OK)
+		idx->id_hash = index_hash(value, size);
+
+	idx->label_hash = 0;
+	if (get_attribute_ptr(head, PKCS11_CKA_LABEL, &value, &size) ==
+	    PKCS11_CKR_OK)
+		idx->label_hash = index_hash(value, size);
+
+	idx->valid = true;
+}
+
+/*
+ * Return false if the object digest @idx proves the object does not match
+ * the search reference digest @ref. Objects without a digest always pass.
+ */
+static bool obj_index_match(struct pkcs11_obj_index *idx,
+			    struct pkcs11_obj_index *ref)
+{
+	if (!idx->valid)
+		return true;
+
+	if (ref->class != PKCS11_CKO_UNDEFINED_ID && ref->class != idx->class)
+		return false;
+
+	if (ref->key_type != PKCS11_CKK_UNDEFINED_ID &&
+	    ref->key_type != idx->key_type)
+		return false;
+
+	if (ref->id_hash && ref->id_hash != idx->id_hash)
+		return false;
+
+	if (ref->label_hash && ref->label_hash != idx->label_hash)
+		return false;
+
+	return true;
+}
+
+/*
+ * Reference token object @obj from the token indexes. Attributes of a
+ * persistent object not yet in memory are loaded to compute the object
+ * digest and released afterward. An object which attributes cannot be
+ * loaded is moved to the unindexed list, searches then scan all objects.
+ */
+void token_index_add_object(struct ck_token *token, struct pkcs11_object *obj)
+{
+	struct object_list *bucket = NULL;
+	bool new_load = false;
+
+	assert(!obj->index.linked);
+
+	if (!obj->index.valid) {
+		if (!obj->attributes) {
+			if (load_persistent_object_attributes(obj)) {
+				LIST_INSERT_HEAD(&token->unindexed_list, obj,
+						 id_link);
+				obj->index.linked = true;
+				return;
+			}
+
+			new_load = true;
+		}
+
+		set_obj_index(&obj->index, obj->attributes);
+
+		if (new_load)
+			release_persistent_object_attributes(obj);
+	}
+
+	bucket = token->id_index + index_bucket(obj->index.id_hash);
+	LIST_INSERT_HEAD(bucket, obj, id_link);
+	bucket = token->label_index + index_bucket(obj->index.label_hash);
+	LIST_INSERT_HEAD(bucket, obj, label_link);
+	obj->index.linked = true;
+}
+
+static void token_index_remove_object(struct pkcs11_object *obj)
+{
+	if (!obj->index.linked)
+		return;
+
+	LIST_REMOVE(obj, id_link);
+	if (obj->index.valid)
+		LIST_REMOVE(obj, label_link);
+
+	obj->index.linked = false;
+}
+
 /* Release resources of a persistent object including volatile resources */
 void cleanup_persistent_object(struct pkcs11_object *obj,
 			       struct ck_token *token)
@@ -87,6 +203,7 @@ void cleanup_persistent_object(struct pkcs11_object *obj,
 	obj->attribs_hdl = TEE_HANDLE_NULL;
 	destroy_object_uuid(token, obj);
 
+	token_index_remove_object(obj);
 	LIST_REMOVE(obj, link);
 
 	cleanup_volatile_obj_ref(obj);
@@ -160,6 +277,9 @@ static struct pkcs11_object *create_obj_instance(struct obj_attrs *head)
 	obj->attribs_hdl = TEE_HANDLE_NULL;
 	obj->attributes = head;
 
+	if (head)
+		set_obj_index(&obj->index, head);
+
 	return obj;
 }
 
@@ -245,6 +365,7 @@ enum pkcs11_rc create_object(void *sess, struct obj_attrs *head,
 			goto err;
 
 		LIST_INSERT_HEAD(&session->token->object_list, obj, link);
+		token_index_add_object(session->token, obj);
 	} else {
 		rc = PKCS11_CKR_OK;
 		LIST_INSERT_HEAD(get_session_objects(session), obj, link);
@@ -428,6 +549,9 @@ enum pkcs11_rc entry_destroy_object(struct pkcs11_client *client,
 	return rc;
 }
 
+/* Initial number of handles allocated in a search context */
+#define FIND_CTX_MIN_HANDLES	16
+
 static void release_find_obj_context(struct pkcs11_find_objects *find_ctx)
 {
 	if (!find_ctx)
@@ -441,13 +565,18 @@ static void release_find_obj_context(struct pkcs11_find_objects *find_ctx)
 static enum pkcs11_rc find_ctx_add(struct pkcs11_find_objects *find_ctx,
 				   uint32_t handle)
 {
-	uint32_t *hdls = TEE_Realloc(find_ctx->handles,
-				     (find_ctx->count + 1) * sizeof(*hdls));
+	if (find_ctx->count == find_ctx->alloced) {
+		size_t alloced = MAX(2 * find_ctx->alloced,
+				     (size_t)FIND_CTX_MIN_HANDLES);
+		uint32_t *hdls = TEE_Realloc(find_ctx->handles,
+					     alloced * sizeof(*hdls));
 
-	if (!hdls)
-		return PKCS11_CKR_DEVICE_MEMORY;
+		if (!hdls)
+			return PKCS11_CKR_DEVICE_MEMORY;
 
-	find_ctx->handles = hdls;
+		find_ctx->handles = hdls;
+		find_ctx->alloced = alloced;
+	}
 
 	*(find_ctx->handles + find_ctx->count) = handle;
 	find_ctx->count++;
@@ -455,6 +584,46 @@ static enum pkcs11_rc find_ctx_add(struct pkcs11_find_objects *find_ctx,
 	return PKCS11_CKR_OK;
 }
 
+/* Add token object @obj to the search results if it matches @req_attrs */
+static enum pkcs11_rc find_token_object(struct pkcs11_session *session,
+					struct pkcs11_find_objects *find_ctx,
+					struct pkcs11_object *obj,
+					struct obj_attrs *req_attrs,
+					struct pkcs11_obj_index *req_index)
+{
+	uint32_t handle = 0;
+	bool new_load = false;
+
+	if (!obj_index_match(&obj->index, req_index))
+		return PKCS11_CKR_OK;
+
+	if (!obj->attributes) {
+		if (load_persistent_object_attributes(obj))
+			return PKCS11_CKR_GENERAL_ERROR;
+
+		new_load = true;
+	}
+
+	if (!obj->attributes ||
+	    check_access_attrs_against_token(session, obj->attributes) ||
+	    !attributes_match_reference(obj->attributes, req_attrs)) {
+		if (new_load)
+			release_persistent_object_attributes(obj);
+
+		return PKCS11_CKR_OK;
+	}
+
+	/* Object may not yet be published in the session */
+	handle = pkcs11_object2handle(obj, session);
+	if (!handle) {
+		handle = handle_get(&session->object_handle_db, obj);
+		if (!handle)
+			return PKCS11_CKR_DEVICE_MEMORY;
+	}
+
+	return find_ctx_add(find_ctx, handle);
+}
+
 enum pkcs11_rc entry_find_objects_init(struct pkcs11_client *client,
 				       uint32_t ptypes, TEE_Param *params)
 {
@@ -470,6 +639,9 @@ enum pkcs11_rc entry_find_objects_init(struct pkcs11_client *client,
 	struct obj_attrs *req_attrs = NULL;
 	struct pkcs11_object *obj = NULL;
 	struct pkcs11_find_objects *find_ctx = NULL;
+	struct pkcs11_obj_index req_index = { };
+	struct object_list *bucket = NULL;
+	struct ck_token *token = NULL;
 
 	if (!client || ptypes != exp_pt)
 		return PKCS11_CKR_ARGUMENTS_BAD;
@@ -534,11 +706,17 @@ enum pkcs11_rc entry_find_objects_init(struct pkcs11_client *client,
 	}
 
 	/*
-	 * Scan all objects (sessions and persistent ones) and set a list of
-	 * candidates that match caller attributes.
+	 * Scan session objects and the indexed persistent objects and set a
+	 * list of candidates that match caller attributes. The attribute
+	 * digests discard most non-matching objects without loading their
+	 * attributes from the secure storage.
 	 */
+	set_obj_index(&req_index, req_attrs);
 
 	LIST_FOREACH(obj, &session->object_list, link) {
+		if (!obj_index_match(&obj->index, &req_index))
+			continue;
+
 		if (check_access_attrs_against_token(session, obj->attributes))
 			continue;
 
@@ -550,41 +728,35 @@ enum pkcs11_rc entry_find_objects_init(struct pkcs11_client *client,
 			goto out;
 	}
 
-	LIST_FOREACH(obj, &session->token->object_list, link) {
-		uint32_t handle = 0;
-		bool new_load = false;
+	token = session->token;
 
-		if (!obj->attributes) {
-			rc = load_persistent_object_attributes(obj);
-			if (rc)
-				return PKCS11_CKR_GENERAL_ERROR;
+	if (req_index.id_hash && LIST_EMPTY(&token->unindexed_list)) {
+		bucket = token->id_index + index_bucket(req_index.id_hash);
 
-			new_load = true;
+		LIST_FOREACH(obj, bucket, id_link) {
+			rc = find_token_object(session, find_ctx, obj,
+					       req_attrs, &req_index);
+			if (rc)
+				goto out;
 		}
-
-		if (!obj->attributes ||
-		    check_access_attrs_against_token(session,
-						     obj->attributes) ||
-		    !attributes_match_reference(obj->attributes, req_attrs)) {
-			if (new_load)
-				release_persistent_object_attributes(obj);
-
-			continue;
+	} else if (req_index.label_hash &&
+		   LIST_EMPTY(&token->unindexed_list)) {
+		bucket = token->label_index +
+			 index_bucket(req_index.label_hash);
+
+		LIST_FOREACH(obj, bucket, label_link) {
+			rc = find_token_object(session, find_ctx, obj,
+					       req_attrs, &req_index);
+			if (rc)
+				goto out;
 		}
-
-		/* Object may not yet be published in the session */
-		handle = pkcs11_object2handle(obj, session);
-		if (!handle) {
-			handle = handle_get(&session->object_handle_db, obj);
-			if (!handle) {
-				rc = PKCS11_CKR_DEVICE_MEMORY;
+	} else {
+		LIST_FOREACH(obj, &token->object_list, link) {
+			rc = find_token_object(session, find_ctx, obj,
+					       req_attrs, &req_index);
+			if (rc)
 				goto out;
-			}
 		}
-
-		rc = find_ctx_add(find_ctx, handle);
-		if (rc)
-			goto out;
 	}
 
 	find_ctx->attributes = req_attrs;
@@ -15,8 +15,30 @@ struct obj_attrs;
 struct pkcs11_client;
 struct pkcs11_session;
 
+/*
+ * Digest of the object attributes used to select candidates in object search
+ *
+ * valid: true if the digest was computed from the object attributes
+ * linked: true if the object is referenced from its token index
+ * class: CKA_CLASS value or PKCS11_CKO_UNDEFINED_ID
+ * key_type: CKA_KEY_TYPE value or PKCS11_CKK_UNDEFINED_ID
+ * id_hash: hash of the CKA_ID value, 0 if the object has no CKA_ID
+ * label_hash: hash of the CKA_LABEL value, 0 if the object has no CKA_LABEL
+ */
+struct pkcs11_obj_index {
+	bool valid;
+	bool linked;
+	uint32_t class;
+	uint32_t key_type;
+	uint32_t id_hash;
+	uint32_t label_hash;
+};
+
 /*
  * link: objects are referenced in a double-linked list
+ * id_link: link in the token CKA_ID index bucket or unindexed objects list
+ * label_link: link in the token index bucket of the object CKA_LABEL
+ * index: digest of the attributes looked up by object search
  * attributes: pointer to the serialized object attributes
  * key_handle: GPD TEE object handle if used in an operation
  * key_type: GPD TEE key type (shortcut used for processing)
@@ -25,6 +47,9 @@ struct pkcs11_session;
  */
 struct pkcs11_object {
 	LIST_ENTRY(pkcs11_object) link;
+	LIST_ENTRY(pkcs11_object) id_link;
+	LIST_ENTRY(pkcs11_object) label_link;
+	struct pkcs11_obj_index index;
 	struct obj_attrs *attributes;
 	TEE_ObjectHandle key_handle;
 	uint32_t key_type;
@@ -46,6 +71,9 @@ struct pkcs11_object *create_token_object(struct obj_attrs *head,
 enum pkcs11_rc create_object(void *session, struct obj_attrs *attributes,
 			     uint32_t *handle);
 
+void token_index_add_object(struct ck_token *token,
+			    struct pkcs11_object *obj);
+
 void cleanup_persistent_object(struct pkcs11_object *obj,
 			       struct ck_token *token);
 
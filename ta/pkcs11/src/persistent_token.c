@@ -551,11 +551,17 @@ struct ck_token *init_persistent_db(unsigned int token_id)
 	struct token_persistent_main *db_main = NULL;
 	struct token_persistent_objs *db_objs = NULL;
 	void *ptr = NULL;
+	size_t n = 0;
 
 	if (!token)
 		return NULL;
 
 	LIST_INIT(&token->object_list);
+	LIST_INIT(&token->unindexed_list);
+	for (n = 0; n < PKCS11_TOKEN_INDEX_BUCKETS; n++) {
+		LIST_INIT(&token->id_index[n]);
+		LIST_INIT(&token->label_index[n]);
+	}
 
 	db_main = TEE_Malloc(sizeof(*db_main), TEE_MALLOC_FILL_ZERO);
 	db_objs = TEE_Malloc(sizeof(*db_objs), TEE_MALLOC_FILL_ZERO);
@@ -611,6 +617,7 @@ struct ck_token *init_persistent_db(unsigned int token_id)
 				TEE_Panic(0);
 
 			LIST_INSERT_HEAD(&token->object_list, obj, link);
+			token_index_add_object(token, obj);
 		}
 
 	} else if (res == TEE_ERROR_ITEM_NOT_FOUND) {
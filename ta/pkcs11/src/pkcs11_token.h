@@ -44,6 +44,9 @@ struct pkcs11_client;
 #define PKCS11_TOKEN_SO_PIN_COUNT_MAX	7
 #define PKCS11_TOKEN_USER_PIN_COUNT_MAX	7
 
+/* Number of hash buckets of the token object indexes, a power of 2 */
+#define PKCS11_TOKEN_INDEX_BUCKETS	128
+
 /*
  * Persistent state of the token
  *
@@ -93,6 +96,9 @@ struct token_persistent_objs {
  * @session_count - Counter for opened Pkcs11 sessions
  * @rw_session_count - Count for opened Pkcs11 read/write sessions
  * @object_list - List of the objects owned by the token
+ * @id_index - Token objects hashed on their CKA_ID attribute
+ * @label_index - Token objects hashed on their CKA_LABEL attribute
+ * @unindexed_list - Token objects which attributes could not be indexed
  * @db_main - Volatile copy of the persistent main database
  * @db_objs - Volatile copy of the persistent object database
  */
@@ -101,6 +107,9 @@ struct ck_token {
 	uint32_t session_count;
 	uint32_t rw_session_count;
 	struct object_list object_list;
+	struct object_list id_index[PKCS11_TOKEN_INDEX_BUCKETS];
+	struct object_list label_index[PKCS11_TOKEN_INDEX_BUCKETS];
+	struct object_list unindexed_list;
 	/* Copy in RAM of the persistent database */
 	struct token_persistent_main *db_main;
 	struct token_persistent_objs *db_objs;
@@ -153,12 +162,14 @@ struct active_processing {
  *
  * @attributes - matching attributes list searched (null if no search)
  * @count - number of matching handle found
+ * @alloced - number of handles the @handles array can hold
  * @handles - array of handle of matching objects
  * @next - index of the next object handle to return to C_FindObject
  */
 struct pkcs11_find_objects {
 	void *attributes;
 	size_t count;
+	size_t alloced;
 	uint32_t *handles;
 	size_t next;
 };